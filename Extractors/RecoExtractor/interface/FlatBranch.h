@@ -0,0 +1,181 @@
+#ifndef FLATBRANCH_H
+#define FLATBRANCH_H
+
+/**
+ * FlatBranch
+ * \brief: Optional flat (CSR) storage of the std::vector< std::vector<int> > branches
+ *
+ * In the flat layout a nested branch NAME is written as two plain vectors:
+ *
+ * NAME_values  : all the elements, row after row
+ * NAME_offsets : size n+1, row i is made of values[offsets[i]] to values[offsets[i+1]-1]
+ *
+ * Writer side: the producer keeps filling its nested vector as before, and calls
+ * flatten() just before the tree Fill (nothing is done for the nested layout).
+ *
+ * Reader side: setAddress() looks which layout is in the tree, and row(i) then gives
+ * a read-only view of row i (IntSpan) in both cases, without copy.
+ *
+ * This header only depends on ROOT, it is also used by the SectorMaker tools.
+ */
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "TTree.h"
+
+
+// A read-only view of a row of ints
+
+struct IntSpan
+{
+  IntSpan(): first(0), last(0) {}
+  IntSpan(const int *f, const int *l): first(f), last(l) {}
+
+  int  size() const  {return static_cast<int>(last-first);}
+  bool empty() const {return first==last;}
+
+  const int* begin() const {return first;}
+  const int* end() const   {return last;}
+
+  int operator[](int i) const {return first[i];}
+  int at(int i) const
+  {
+    if (i<0 || i>=size()) throw std::out_of_range("IntSpan::at");
+    return first[i];
+  }
+
+  std::vector<int> vec() const {return std::vector<int>(first,last);}
+
+  const int *first;
+  const int *last;
+};
+
+
+class FlatBranch
+{
+ public:
+
+  FlatBranch(): m_flat(false), m_read(false), m_own(false), m_nested(0),
+    m_values(new std::vector<int>), m_offsets(new std::vector<int>) {}
+
+  ~FlatBranch()
+  {
+    delete m_values;
+    delete m_offsets;
+    if (m_own) delete m_nested;
+  }
+
+
+  // Writer side: creates NAME (nested) or NAME_values/NAME_offsets (flat)
+
+  void branch(TTree *tree, std::string name, std::vector< std::vector<int> > *nested, bool flat)
+  {
+    if (m_own) delete m_nested;
+
+    m_flat   = flat;
+    m_read   = false;
+    m_own    = false;
+    m_nested = nested;
+
+    if (!m_flat)
+    {
+      tree->Branch(name.c_str(), &m_nested);
+      return;
+    }
+
+    tree->Branch((name+"_values").c_str(),  &m_values);
+    tree->Branch((name+"_offsets").c_str(), &m_offsets);
+  }
+
+  // Copy the nested vector in the flat one (to call before Fill)
+
+  void flatten()
+  {
+    if (!m_flat) return;
+
+    m_values->clear();
+    m_offsets->clear();
+    m_offsets->push_back(0);
+
+    for (unsigned int i=0;i<m_nested->size();++i)
+    {
+      m_values->insert(m_values->end(),m_nested->at(i).begin(),m_nested->at(i).end());
+      m_offsets->push_back(static_cast<int>(m_values->size()));
+    }
+  }
+
+
+  // Reader side: connects to the layout found in the tree, returns false
+  // if the branch is not there. If the layout is nested, the rows are read
+  // in nested (allocated here if 0)
+
+  bool setAddress(TTree *tree, std::string name, std::vector< std::vector<int> > *nested=0)
+  {
+    m_read = true;
+
+    if (tree->GetBranch((name+"_values").c_str()))
+    {
+      m_flat = true;
+
+      tree->SetBranchStatus((name+"_values").c_str(),1);
+      tree->SetBranchStatus((name+"_offsets").c_str(),1);
+      tree->SetBranchAddress((name+"_values").c_str(),  &m_values);
+      tree->SetBranchAddress((name+"_offsets").c_str(), &m_offsets);
+      return true;
+    }
+
+    m_flat = false;
+
+    if (!tree->GetBranch(name.c_str())) return false;
+
+    if (m_own) delete m_nested;
+
+    m_own    = (nested==0);
+    m_nested = (m_own) ? new std::vector< std::vector<int> > : nested;
+
+    tree->SetBranchStatus(name.c_str(),1);
+    tree->SetBranchAddress(name.c_str(), &m_nested);
+    return true;
+  }
+
+
+  // Access to the rows (the nested vector is used on the writer side)
+
+  bool isFlat() const {return m_flat;}
+
+  int  size() const
+  {
+    if (m_flat && m_read)
+      return (m_offsets->empty()) ? 0 : static_cast<int>(m_offsets->size())-1;
+
+    return (m_nested) ? static_cast<int>(m_nested->size()) : 0;
+  }
+
+  IntSpan row(int i) const
+  {
+    if (m_flat && m_read)
+      return IntSpan(m_values->data()+m_offsets->at(i),m_values->data()+m_offsets->at(i+1));
+
+    const std::vector<int> &r = m_nested->at(i);
+    return IntSpan(r.data(),r.data()+r.size());
+  }
+
+ private:
+
+  // Not copyable, the vectors given to the tree belong to the object
+
+  FlatBranch(const FlatBranch&);
+  FlatBranch& operator=(const FlatBranch&);
+
+  bool m_flat;  // Flat layout in the tree
+  bool m_read;  // Reader (true) or writer (false) side
+  bool m_own;   // m_nested allocated here (reader side)
+
+  std::vector< std::vector<int> > *m_nested;
+  std::vector<int>                *m_values;
+  std::vector<int>                *m_offsets;
+};
+
+#endif
@@ -12,6 +12,7 @@ using namespace std;
 #include "AnalysisSettings.h"
 #include "PixelExtractor.h"
 #include "MCExtractor.h"
+#include "FlatBranch.h"
 
 class L1TrackTrigger_analysis
 {
@@ -26,15 +27,21 @@ class L1TrackTrigger_analysis
 
   void get_digis(PixelExtractor *pix, MCExtractor *mc);
   void get_clusters(PixelExtractor *pix, MCExtractor *mc);
+  void get_module_clusters(PixelExtractor *pix, int first, int last);
   void get_stubs(int layer,MCExtractor *mc);
 
   void initialize();
   void reset();
   void fillTree();
 
-  bool is_neighbour(PixelExtractor *pix, int idx, int lay, int lad, int mod);
   int  getMatchingTP(int i, int j);
 
+  int  getRoot(int k);
+  void mergeDigis(int k, int l);
+
+  void index_clusters();
+  int  getPairIndex(int lay, int lad, int mod);
+
  private:
 
   TTree* m_tree_L1TrackTrigger;
@@ -54,6 +61,7 @@ class L1TrackTrigger_analysis
   float m_thresh;
   float m_pTthresh;
   bool  m_zMatch;
+  bool  m_flat;
  
   /*
     List of the branches contained in the L1TrackTrigger tree
@@ -78,8 +86,12 @@ class L1TrackTrigger_analysis
     tree->Branch("CLUS_nrows",     &m_clus_nrows);
     tree->Branch("CLUS_tp",        &m_clus_tp);
     tree->Branch("CLUS_hits",      &m_clus_hits);
+    tree->Branch("CLUS_pix",       &m_clus_pix);
     tree->Branch("CLUS_process",   &m_clus_pid);
 
+    (with the flatBranches setting, CLUS_tp/hits/pix are stored in the flat 
+    layout: CLUS_tp_values/_offsets..., see FlatBranch.h)
+
     tree->Branch("STUB_ptMC",      &m_stub_ptMC);
     tree->Branch("STUB_clust1",    &m_stub_clust1);
     tree->Branch("STUB_clust2",    &m_stub_clust2);
@@ -109,8 +121,24 @@ class L1TrackTrigger_analysis
     tree->Branch("STUB_Z0",        &m_stub_Z0);
   */
 
-  std::vector<int> clus_row;
-  std::vector<int> clus_col;
+  // Working area of the digi clustering (see get_module_clusters)
+
+  std::vector<int> m_grid;      // Module (row,column) grid, digi number or -1 if empty
+  std::vector<int> m_grid_digi; // Position of the module digis in m_digi_ref
+  std::vector<int> m_grid_link; // Union-find parent of the module digis
+  std::vector<int> m_grid_clus; // Cluster index of the module digis
+
+  // Cluster index used by the stub maker, rebuilt for each event at the end 
+  // of get_clusters. A module pair is identified by (layer,ladder,odd module), 
+  // clusters on the odd module are the bottom candidates, clusters on the 
+  // next module (module+1) are the top candidates. All the lists are sorted 
+  // by increasing cluster index.
+
+  std::vector< std::vector<int> > m_clus_bottom; // Bottom candidates, per layer
+  std::vector< std::vector<int> > m_clus_top;    // Top candidates, per module pair
+  std::vector<int>                m_clus_pair;   // Module pair of bottom candidate i (-1 otherwise)
+  std::map<int,int>               m_pair_index;  // Module pair code -> index in m_clus_top
+  int                             m_n_pairs;     // Number of module pairs in the event
 
   std::vector<int> i_match;
   std::vector<int> j_match;
@@ -148,6 +176,10 @@ class L1TrackTrigger_analysis
   std::vector< std::vector<int> >    *m_clus_pix;  // list of pixels inducing cluster i
   std::vector<int>    *m_clus_pid;    // process id inducing cluster i (see MCExtractor.h)
 
+  FlatBranch m_clus_tp_branch;        // Storage of m_clus_tp (nested or flat)
+  FlatBranch m_clus_hits_branch;      // Storage of m_clus_hits (nested or flat)
+  FlatBranch m_clus_pix_branch;       // Storage of m_clus_pix (nested or flat)
+
 
   int m_stub;
 
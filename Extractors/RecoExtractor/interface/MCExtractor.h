@@ -5,6 +5,11 @@
  *  Extract the MC info
  */
 
+// RECOEXTRACTOR_STANDALONE is defined when the class is compiled outside CMSSW
+// (test/Replay). Only the retrieve part (TFile constructor, getInfo) is then available
+
+#ifndef RECOEXTRACTOR_STANDALONE
+
 // Framework stuff
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/Framework/interface/EventSetup.h"
@@ -51,26 +56,33 @@
 
 //#include "CommonTools/RecoAlgos/interface/TrackingParticleSelector.h"
 
+#endif
+
 //std C++
 #include <iostream>
 #include <vector>
+#include <cmath>
+#include <unordered_map>
 
 // ROOT stuff
 #include "TMath.h"
 #include "TTree.h"
 #include "TFile.h"
+#include "FlatBranch.h"
 
 class MCExtractor
 {
  public:
   /// Constructor
-  MCExtractor(bool doTree);
+  MCExtractor(bool doTree, bool doFlat);
   MCExtractor(TFile *a_file);
   /// Destructor
   virtual ~MCExtractor(){}
 
+#ifndef RECOEXTRACTOR_STANDALONE
   void writeInfo(const edm::Event *event); 
   void init(const edm::EventSetup *setup);
+#endif
 
   void reset();
   void fillTree(); 
@@ -107,8 +119,11 @@ class MCExtractor
 
  private:
  			      
+  void buildTPIndex();
 
+#ifndef RECOEXTRACTOR_STANDALONE
   void getGenInfo(const edm::Event *event); 
+#endif
  
   // Rootuple parameters
 
@@ -116,6 +131,7 @@ class MCExtractor
   TTree* m_tree_retrieved;
   
   bool m_OK;
+  bool m_flat;
   std::vector<int>      *m_part_used;
   std::vector<int>      *m_hits_used;
 
@@ -147,7 +163,8 @@ class MCExtractor
     m_tree_new->Branch("subpart_y",            &m_part_y);
     m_tree_new->Branch("subpart_z",            &m_part_z);
     
-    
+    With flatBranches=True, subpart_stId is stored in the flat layout
+    (subpart_stId_values/_offsets, see FlatBranch.h)
   */
   
   int    		m_gen_n;       // Number of particles generated
@@ -180,11 +197,14 @@ class MCExtractor
   std::vector<int>      *m_st;        // Number of simtracks involved in TP i 
   std::vector<int>      *m_hits;      // Number of SimHits of TP i 
 
+  FlatBranch m_stId_branch;           // Storage of m_part_stId (nested or flat)
+
 
 
 
   // Finally the geometry information
 
+#ifndef RECOEXTRACTOR_STANDALONE
   edm::ESHandle<DTGeometry> dtGeometry;
   edm::ESHandle<CSCGeometry> cscGeometry;
   edm::ESHandle<RPCGeometry> rpcGeometry;
@@ -196,6 +216,7 @@ class MCExtractor
   const CaloSubdetectorGeometry* HBgeom;
   const CaloSubdetectorGeometry* EEgeom;
   const CaloSubdetectorGeometry* EBgeom;
+#endif
 
 
   int n_hit_part;
@@ -232,6 +253,13 @@ class MCExtractor
 
   std::vector<int>      the_ids;
   float x,y,z;
+
+  // (evtID,simtrack ID) -> TP index, rebuilt for each event by buildTPIndex()
+  // If more than one TP contains the simtrack, the last one is kept and 
+  // the number of other TPs is stored in m_TP_ndup 
+
+  std::unordered_map<unsigned long long,int>  m_TP_index;
+  std::unordered_map<unsigned long long,int>  m_TP_ndup;
 };
 
 
@@ -0,0 +1,92 @@
+#ifndef MODULEGEOMETRY_H
+#define MODULEGEOMETRY_H
+
+/**
+ * ModuleGeometry
+ * \brief: Cache of the tracker module geometry, shared by the extractors
+ *
+ * The cache is filled once from the EventSetup (init() is called in beginRun,
+ * and does nothing if the geometry did not change). Each module gets a dense
+ * index, and all the info needed in the extractor loops (module coding, 
+ * number of strips/columns, pitch, PS/2S type, position of the pixels) is 
+ * stored in a plain ModuleInfo struct. The stacks are added by initStacks(), 
+ * for the extractors using the stacked geometry.
+ */
+
+#include "FWCore/Framework/interface/EventSetup.h"
+#include "FWCore/Framework/interface/ESHandle.h"
+
+#include "Geometry/TrackerGeometryBuilder/interface/TrackerGeometry.h"
+#include "Geometry/CommonTopologies/interface/PixelTopology.h"
+#include "Geometry/TrackerGeometryBuilder/interface/PixelGeomDetUnit.h"
+#include "Geometry/Records/interface/TrackerDigiGeometryRecord.h"
+#include "Geometry/Records/interface/StackedTrackerGeometryRecord.h"
+#include "Geometry/TrackerGeometryBuilder/interface/StackedTrackerGeometry.h"
+#include "Geometry/TrackerGeometryBuilder/interface/StackedTrackerDetUnit.h"
+
+#include "DataFormats/SiPixelDetId/interface/PXBDetId.h"
+#include "DataFormats/SiPixelDetId/interface/PXFDetId.h"
+#include "DataFormats/SiPixelDetId/interface/PixelSubdetector.h"
+#include "DataFormats/GeometryVector/interface/GlobalPoint.h"
+
+//Include std C++
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <unordered_map>
+
+
+struct ModuleInfo
+{
+  unsigned int detId;       // Raw DetId of the module
+  int    layer;             // Layer (1 to 10 for the barrel, 11 to 24 for the endcap disks, -1 for the pixel disks)
+  int    ladder;            // Ladder/ring
+  int    module;            // Module
+  int    nrows;             // Number of strips
+  int    ncolumns;          // Number of columns (segments)
+  float  pitchx;            // Strip pitch (in cm)
+  float  pitchy;            // Column pitch (in cm)
+  bool   PS;                // PS module (more than 2 columns) or 2S module
+  bool   linear;            // Constant pitch, the global position is linear in (row,column)
+  double pos0[3];           // Global position of the (0,0) pixel center (in cm)
+  double drow[3];           // Global displacement for one strip (in cm)
+  double dcol[3];           // Global displacement for one column (in cm)
+  const PixelGeomDetUnit *det; // Only used when linear is false
+};
+
+
+class ModuleGeometry
+{
+
+ public:
+
+  ModuleGeometry();
+  ~ModuleGeometry();
+
+  void init(const edm::EventSetup *setup);
+  void initStacks(const edm::EventSetup *setup); // Only needed for the stack info (StubExtractor)
+
+  //Getters
+
+  int  getNModules() {return static_cast<int>(m_modules.size());}
+
+  int  index(unsigned int detId);                       // -1 if not a pixel module
+  int  stackIndex(unsigned int stackId, int member);    // Index of stack member 0 (inner) or 1 (outer)
+
+  const ModuleInfo& module(int idx) {return m_modules.at(idx);}
+
+  GlobalPoint position(int idx, float row, float col);  // Position of the pixel center (row and col can be averages)
+
+ private:
+
+  void fillModule(const PixelGeomDetUnit *det);
+
+  unsigned long long m_geomId;
+  unsigned long long m_stackId;
+
+  std::vector<ModuleInfo>               m_modules;
+  std::unordered_map<unsigned int,int>  m_index;        // DetId -> index
+  std::unordered_map<unsigned int,int>  m_stack_index[2]; // Stack DetId -> index of the stack members
+};
+
+#endif
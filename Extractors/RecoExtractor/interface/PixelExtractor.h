@@ -7,6 +7,11 @@
  */
 
 
+// RECOEXTRACTOR_STANDALONE is defined when the class is compiled outside CMSSW
+// (test/Replay). Only the retrieve part (TFile constructor, getInfo) is then available
+
+#ifndef RECOEXTRACTOR_STANDALONE
+
 //Include RECO inf
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/Framework/interface/EventSetup.h"
@@ -30,28 +35,39 @@
 #include "DataFormats/SiPixelDetId/interface/PixelBarrelName.h"
 #include "DataFormats/SiPixelDetId/interface/PixelEndcapName.h"
 
+#include "ModuleGeometry.h"
+
+#endif
+
 //Include std C++
 #include <iostream>
 #include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
 
 #include "TMath.h"
 #include "TTree.h"
 #include "TFile.h"
 #include "TLorentzVector.h"
 #include "TClonesArray.h"
+#include "FlatBranch.h"
 
 class PixelExtractor
 {
 
  public:
 
-  PixelExtractor(edm::InputTag tag,bool doTree,bool doMatch);
+#ifndef RECOEXTRACTOR_STANDALONE
+  PixelExtractor(edm::InputTag tag,bool doTree,bool doMatch,bool doFlat);
+#endif
   PixelExtractor(TFile *a_file);
   ~PixelExtractor();
 
-
-  void init(const edm::EventSetup *setup);
+#ifndef RECOEXTRACTOR_STANDALONE
+  void init(const edm::EventSetup *setup, ModuleGeometry *geom);
   void writeInfo(const edm::Event *event); 
+#endif
   void getInfo(int ievt); 
 
   void reset();
@@ -70,18 +86,18 @@ class PixelExtractor
   int isSimHit(int i) {return m_pixclus_simhit->at(i);}
   int tpIndex(int i,int j) 
   {
-    // std::cout << j << " //// " << (m_pixclus_simhitID->at(i)).size() << std::endl;
-    //  std::cout << (m_pixclus_simhitID->at(i)).at(j) << std::endl;
+    // std::cout << j << " //// " << m_simhitID_branch.row(i).size() << std::endl;
+    //  std::cout << m_simhitID_branch.row(i).at(j) << std::endl;
  
-    return (m_pixclus_simhitID->at(i)).at(j);
+    return m_simhitID_branch.row(i).at(j);
   }
 
   int evtIndex(int i,int j) 
   {
-    //    std::cout << j << " //// " << (m_pixclus_evtID->at(i)).size() << std::endl;
-    //    std::cout << (m_pixclus_evtID->at(i)).at(j) << std::endl;
+    //    std::cout << j << " //// " << m_evtID_branch.row(i).size() << std::endl;
+    //    std::cout << m_evtID_branch.row(i).at(j) << std::endl;
  
-    return (m_pixclus_evtID->at(i)).at(j);
+    return m_evtID_branch.row(i).at(j);
   }
 
   float e(int i) {return m_pixclus_e->at(i);}
@@ -104,14 +120,20 @@ class PixelExtractor
   
   TTree* m_tree;
 
+#ifndef RECOEXTRACTOR_STANDALONE
   edm::Handle<TrackingParticleCollection>  TPCollection ;
   edm::Handle< edm::DetSetVector<PixelDigiSimLink> > pDigiLinkColl;
-  edm::DetSet<PixelDigiSimLink> pDigiLinks;
+  const edm::DetSet<PixelDigiSimLink> *pDigiLinks; // Links of the current module (0 if none)
 
-  edm::ESHandle<TrackerGeometry> theTrackerGeometry;
+  std::vector< std::pair<int,int> >  m_link_index; // (channel,position) of the current module links, sorted by channel
+
+  ModuleGeometry *m_geom;   // Shared geometry cache (see ModuleGeometry.h)
   edm::InputTag m_tag;
+#endif
+
   bool m_OK;
   bool m_matching;
+  bool m_flat;
   int  m_n_events;
   int  m_nPU;
 
@@ -137,6 +159,9 @@ class PixelExtractor
     m_tree->Branch("PIX_ncolumn",   &m_pixclus_ncolumn);
     m_tree->Branch("PIX_pitchx",    &m_pixclus_pitchx);
     m_tree->Branch("PIX_pitchy",    &m_pixclus_pitchy);
+
+    With flatBranches=True, PIX_simhitID and PIX_evtID are stored in the 
+    flat layout (PIX_simhitID_values/_offsets..., see FlatBranch.h)
   */
 
   // Meaning of the branches
@@ -162,6 +187,9 @@ class PixelExtractor
   std::vector<float>               *m_pixclus_pitchx;   // Strip pitch
   std::vector<float>               *m_pixclus_pitchy;   // Column pitch
 
+  FlatBranch m_simhitID_branch; // Storage of m_pixclus_simhitID (nested or flat)
+  FlatBranch m_evtID_branch;    // Storage of m_pixclus_evtID (nested or flat)
+
 
   std::vector<int>      the_ids;
   std::vector<int>      the_eids;
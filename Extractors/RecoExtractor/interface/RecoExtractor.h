@@ -21,9 +21,17 @@
 #include "../interface/L1TrackTrigger_analysis.h"
 #include "../interface/TkLayout_Translator.h"
 #include "../interface/AnalysisSettings.h"
+#include "../interface/ModuleGeometry.h"
 
 #include "TFile.h"
 #include "TRFIOFile.h"
+#include "TChain.h"
+#include "TSystem.h"
+#include "TThread.h"
+
+#include <thread>
+#include <mutex>
+#include <sstream>
 
 class RecoExtractor : public edm::EDAnalyzer{
  public:
@@ -50,6 +58,10 @@ class RecoExtractor : public edm::EDAnalyzer{
   void initialize();
   void retrieve();
   void doAna();
+
+  void parallelReplay(int first, int last);
+  void replay(int first, int last, int iworker);
+  std::string workerFile(int iworker);
   
 
 
@@ -63,9 +75,12 @@ class RecoExtractor : public edm::EDAnalyzer{
   bool do_TK_;
   bool do_MATCH_;
   bool do_L1tt_;
+  bool do_FLAT_;    // Flat layout for the nested branches (see FlatBranch.h)
 
   int  nevts_;
   int  skip_;
+  int  nthreads_;   // Number of worker threads for the replay (fillTree=False only)
+  int  evt_offset_; // First event number given to the L1TT analysis
 
   edm::InputTag PIX_tag_;  // 
   edm::InputTag MC_tag_;  // 
@@ -84,6 +99,7 @@ class RecoExtractor : public edm::EDAnalyzer{
   TFile* m_outfile;
 
 
+  ModuleGeometry*   m_GEOM;
   PixelExtractor*   m_PIX;
   MCExtractor*      m_MC;
   StubExtractor*    m_STUB;
@@ -91,6 +107,8 @@ class RecoExtractor : public edm::EDAnalyzer{
   AnalysisSettings*  m_ana_settings;
   L1TrackTrigger_analysis* m_L1TT_analysis;
 
+  std::mutex  m_root_lock; // Protects ROOT file/tree creation in the replay workers
+
 };
 
 
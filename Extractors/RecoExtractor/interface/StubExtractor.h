@@ -64,6 +64,7 @@
 #include "TLorentzVector.h"
 #include "TClonesArray.h"
 #include "MCExtractor.h"
+#include "ModuleGeometry.h"
 
 class StubExtractor
 {
@@ -75,7 +76,7 @@ class StubExtractor
   ~StubExtractor();
 
 
-  void init(const edm::EventSetup *setup);
+  void init(const edm::EventSetup *setup, ModuleGeometry *geom);
   void writeInfo(const edm::Event *event, MCExtractor *mc); 
   void getInfo(int ievt); 
 
@@ -91,6 +92,7 @@ class StubExtractor
 
   int getClust1Idx(float x, float y, float z);
   int getClust2Idx(int idx1, float dist);
+  int getClustIdx(const edm::Ref< edmNew::DetSetVector< TTCluster< Ref_PixelDigi_ > >, TTCluster< Ref_PixelDigi_ > > &clusRef);
 
   int getNDigis() {return m_clus;}
 
@@ -127,6 +129,7 @@ class StubExtractor
   double mMagneticFieldStrength ;
 
   /// Geometry handles etc
+  ModuleGeometry                                 *m_geom; // Shared geometry cache (see ModuleGeometry.h)
   edm::ESHandle< TrackerGeometry >                theTrackerGeometry;
   edm::ESHandle< StackedTrackerGeometry >         theStackedTrackerGeometry;
   const StackedTrackerGeometry*                   theStackedGeometry;
@@ -144,6 +147,10 @@ class StubExtractor
 
   std::vector<int>                 *m_clus_used;   
 
+  // Index of the TTClusters in the L1TkCLUS vectors, filled in writeInfo
+  // (m_clus_index[key of the TTCluster ref in the cluster collection])
+  std::vector<int>                  m_clus_index;
+
 
   int m_clus;
 
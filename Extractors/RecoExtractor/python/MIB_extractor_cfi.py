@@ -36,9 +36,12 @@ MIBextraction = cms.EDAnalyzer("RecoExtractor",
                                
   doTranslation    = cms.untracked.bool(False),          # For TkLayout tool (not maintained)
   doL1TT           = cms.untracked.bool(False),          # Extract the cluster/stub information
+  flatBranches     = cms.untracked.bool(False),          # Store the MC/Pixel vector<vector<int>> branches as values+offsets
+                                                         # (for the L1TT ones use the flatBranches analysis setting)
 
   n_events         = cms.untracked.int32(10),            # How many events you want to analyze (only if fillTree=False)
   skip_events      = cms.untracked.int32(0),             # How many events you want to skip (only if fillTree=False)
+  n_threads        = cms.untracked.int32(1),             # Number of threads for the L1TT analysis (only if fillTree=False)
 
   # The analysis settings could be whatever you want
   # 
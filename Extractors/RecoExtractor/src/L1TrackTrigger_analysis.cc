@@ -58,6 +58,11 @@ L1TrackTrigger_analysis::L1TrackTrigger_analysis(AnalysisSettings *settings, int
     ? m_PDG_id = settings->getSetting("pdgSel")
     : m_PDG_id = -1;
 
+  // If you want the CLUS_tp/hits/pix branches in the flat layout (see FlatBranch.h)
+  (settings->getSetting("flatBranches")!=-1)
+    ? m_flat = (static_cast<bool>(settings->getSetting("flatBranches")))
+    : m_flat = false;
+
   // The pt threshold for the barrel stubs 
   (settings->getSetting("thresh")!=-1)
     ? m_pTthresh = settings->getSetting("thresh")
@@ -227,42 +232,118 @@ Method extracting the cluster using the digi info
 
 void L1TrackTrigger_analysis::get_clusters(PixelExtractor *pix, MCExtractor *mc)
 {
-  int   nsat       = 0;
-  int   nstrips    = 0;
-  float bary_strip = 0.;
-  float bary_col   = 0.;
-
-  int ref_lay  = -1;
-  int ref_lad  = -1;
-  int ref_mod  = -1;
-  int ref_seg  = -1;
-  int ref_nseg = -1;
-  int ref_nrow = -1;
- 
-  float bary_sum=0.;
-  float bary_x=0.;
-  float bary_y=0.;
-  float bary_z=0.;
- 
-  int m_clus_prev   = -1;
-  int idx;
+  int ndigis = static_cast<int>(m_digi_ref->size());
+  int first  = 0;
+  int last   = 0;
+  int ref    = 0;
+  int idx    = 0;
+
+  // The pixel extractor stores the digis module per module (one DetSet 
+  // per module), so we just have to cut the digi list in modules and 
+  // to clusterize each of them separately
+
+  while (first<ndigis)
+  {
+    ref  = m_digi_ref->at(first);
+    last = first+1;
+
+    while (last<ndigis)
+    {
+      idx = m_digi_ref->at(last);
+
+      if (pix->layer(idx) !=pix->layer(ref)  ||
+	  pix->ladder(idx)!=pix->ladder(ref) ||
+	  pix->module(idx)!=pix->module(ref)) 
+	break;
+
+      ++last;
+    }
+
+    L1TrackTrigger_analysis::get_module_clusters(pix,first,last);
+
+    first = last;
+  }
+
+  // Finally build the module pair index used by the stub maker
+  L1TrackTrigger_analysis::index_clusters();
+}
+
+
+/*
+
+Connected component clustering of the digis of one module
+
+Digis first to last-1 of m_digi_ref belong to the same module. Two digis are 
+neighbours if they are on adjacent strips of the same segment, or on the same 
+strip of adjacent segments (PS modules only, ie ncolumn>2). 
+
+The digis are put on the module (row,column) grid and merged with a union-find, 
+so the result does not depend on the digi ordering. Clusters are stored in the 
+order of their first digi.
+
+ */
+
+
+void L1TrackTrigger_analysis::get_module_clusters(PixelExtractor *pix, int first, int last)
+{
+  int idx   = m_digi_ref->at(first);
+  int nrow  = pix->nrow(idx);
+  int ncol  = pix->ncolumn(idx);
+  int row   = 0;
+  int col   = 0;
+  int cell  = 0;
+  int ndig  = 0;
+  int root  = 0;
+  int c     = 0;
+  int i     = 0;
+  int clus0 = m_clus;
 
   int is_there=0;
+  float nstrips=0.;
+  float bary_strip=0.;
 
-  std::vector<int> matching_tps_clus;
-  std::vector<int> pix_list;
-  
-  pix_list.clear();
-  matching_tps_clus.clear();  
-  clus_row.clear();  
-  clus_col.clear();  
+  // The grid covers the module, and is extended if some digis are out of it
+  // (they are kept, as they would be merged with their neighbours anyway)
 
-  for (int i=0;i<static_cast<int>(m_digi_ref->size());++i) // Loop over pixel hits
-  { 
-    idx = static_cast<int>(m_digi_ref->at(i));
-  
-    // First we check is this cluster is adjacent to the previous one 
-    // (in both directions)
+  int rmin = 0;
+  int cmin = 0;
+  int rmax = nrow-1;
+  int cmax = ncol-1;
+
+  for (i=first;i<last;++i) 
+  {
+    idx = m_digi_ref->at(i);
+
+    if (pix->e(idx)<=m_thresh) continue;
+
+    row = pix->row(idx);
+    col = pix->column(idx);
+
+    if (row<rmin) rmin = row;
+    if (row>rmax) rmax = row;
+    if (col<cmin) cmin = col;
+    if (col>cmax) cmax = col;
+  }
+
+  if (rmin<0 || cmin<0 || rmax>=nrow || cmax>=ncol)
+    cout << "WARNING: digis out of the module grid (" << nrow << "x" << ncol << ") in module "
+	 << pix->layer(idx) << "/" << pix->ladder(idx) << "/" << pix->module(idx)
+	 << ", rows " << rmin << " to " << rmax << ", columns " << cmin << " to " << cmax << endl;
+
+  int grow = rmax-rmin+1;
+  int gcol = cmax-cmin+1;
+
+  if (static_cast<int>(m_grid.size())<grow*gcol) m_grid.resize(grow*gcol,-1);
+
+  m_grid_digi.clear();
+  m_grid_link.clear();
+  m_grid_clus.clear();
+
+  // First put the digis on the grid
+
+  for (i=first;i<last;++i) 
+  {
+    idx = m_digi_ref->at(i);
 
     if (m_verb)
       cout << idx << " / "   
@@ -274,129 +355,130 @@ void L1TrackTrigger_analysis::get_clusters(PixelExtractor *pix, MCExtractor *mc)
 	   << pix->pitchx(idx) << " / "  
 	   << m_clus << endl;
 
-    if (pix->e(idx)>m_thresh)
-    {
-      if (is_neighbour(pix,idx,ref_lay,ref_lad,ref_mod)) // This is not perfect
-      {                                                  // Could lead to two clusters instead of 1 
+    if (pix->e(idx)<=m_thresh) continue;
 
-	// To see a good implementation, based on detid and map of digis, see:
-	//
-	// https://github.com/cms-sw/cmssw/blob/CMSSW_6_2_0_SLHC5/L1Trigger/TrackTrigger/src/TTClusterAlgorithm_2d2013.cc
-	//
+    row = pix->row(idx)-rmin;
+    col = pix->column(idx)-cmin;
 
-	// If so we add it to the growing cluster
-	
-	if (m_verb) cout << "ACCUMULATE" << endl;
+    m_grid_digi.push_back(i);
+    m_grid_link.push_back(ndig);
+    m_grid_clus.push_back(-1);
 
-	clus_row.push_back(pix->row(idx));
-	clus_col.push_back(pix->column(idx));
-	pix_list.push_back(idx);  
+    cell = row*gcol+col;
 
-	for (int k=0;k<static_cast<int>(m_digi_tp->at(i).size());++k) // Loop over match tps
-	{
-	  is_there=0;
+    if (m_grid.at(cell)!=-1) L1TrackTrigger_analysis::mergeDigis(m_grid.at(cell),ndig); // Same pixel twice
 
-	  for (int l=0;l<static_cast<int>(matching_tps_clus.size());++l) 
-	  {
-	    if (matching_tps_clus.at(l)==(m_digi_tp->at(i)).at(k))
-	    {
-	      is_there=1;
-	      break;
-	    }
-	  }
+    m_grid.at(cell) = ndig;
+    ++ndig;
+  }
 
-	  if (is_there==0) matching_tps_clus.push_back((m_digi_tp->at(i)).at(k));
-	}	
+  // Then merge the neighbours (looking at the previous strip 
+  // and segment is sufficient)
 
-	++bary_sum;
-	bary_x     += pix->x(idx);
-	bary_y     += pix->y(idx);
-	bary_z     += pix->z(idx);
-	bary_strip += pix->row(idx);
-	bary_col   += pix->column(idx);
-      
-	if (pix->e(idx)==255) ++nsat;
-	++nstrips;
-      } else {       // This is the start of a new cluster
-
-	if (m_verb) cout << "NEW CLUSTER" << endl;
-
-	clus_row.clear();  
-	clus_col.clear();  
-	matching_tps_clus.clear();  
-	pix_list.clear();  
-
-	nstrips      = 0;
-	nsat         = 0;
-
-	clus_row.push_back(pix->row(idx));
-	clus_col.push_back(pix->column(idx));
-	pix_list.push_back(idx);  	
-
-	for (int k=0;k<static_cast<int>(m_digi_tp->at(i).size());++k) // Loop over pixel hits
-	  matching_tps_clus.push_back((m_digi_tp->at(i)).at(k));
-
-	ref_lay  = pix->layer(idx);
-	ref_lad  = pix->ladder(idx);
-	ref_mod  = pix->module(idx);
-	ref_seg  = pix->column(idx);
-	ref_nseg = pix->ncolumn(idx);
-	ref_nrow = pix->nrow(idx);
-
-	bary_sum   = 1;
-	bary_x     = pix->x(idx);
-	bary_y     = pix->y(idx);
-	bary_z     = pix->z(idx);
-	bary_strip = pix->row(idx);
-	bary_col   = pix->column(idx);
-
-	if (pix->e(idx)==255) ++nsat;
-	++nstrips;
-	++m_clus;
-      }
-    } // End of cluster test loop
+  for (int k=0;k<ndig;++k) 
+  {
+    idx = m_digi_ref->at(m_grid_digi.at(k));
+    row = pix->row(idx)-rmin;
+    col = pix->column(idx)-cmin;
 
-    // New cluster fill info
+    if (row>0 && m_grid.at((row-1)*gcol+col)!=-1)
+      L1TrackTrigger_analysis::mergeDigis(m_grid.at((row-1)*gcol+col),k);
 
-    if (m_clus==m_clus_prev)
-    {
-      m_clus_pix->at(m_clus-1)     = pix_list;
-      m_clus_tp->at(m_clus-1)      = matching_tps_clus;
-      m_clus_matched->at(m_clus-1) = matching_tps_clus.size();
-      m_clus_x->at(m_clus-1)       = bary_x/bary_sum;
-      m_clus_y->at(m_clus-1)       = bary_y/bary_sum;
-      m_clus_z->at(m_clus-1)       = bary_z/bary_sum;
-      m_clus_sat->at(m_clus-1)     = nsat;
-      m_clus_nstrips->at(m_clus-1) = nstrips;
-      m_clus_layer->at(m_clus-1)   = ref_lay;
-      m_clus_ladder->at(m_clus-1)  = ref_lad;
-      m_clus_module->at(m_clus-1)  = ref_mod;
-      m_clus_seg->at(m_clus-1)     = ref_seg;
-      m_clus_strip->at(m_clus-1)   = bary_strip/bary_sum-fmod(bary_strip/bary_sum,0.5);
-    }
-    else
+    if (ncol>2 && col>0 && m_grid.at(row*gcol+col-1)!=-1)
+      L1TrackTrigger_analysis::mergeDigis(m_grid.at(row*gcol+col-1),k);
+  }
+
+  // And build the clusters (the root of a cluster is its first digi)
+
+  for (int k=0;k<ndig;++k) 
+  {
+    i    = m_grid_digi.at(k);
+    idx  = m_digi_ref->at(i);
+    root = L1TrackTrigger_analysis::getRoot(k);
+
+    if (root==k) // This is the start of a new cluster
     {
-      m_clus_prev=m_clus;
-      m_clus_pix->push_back(pix_list);
-      m_clus_tp->push_back(matching_tps_clus);
-      m_clus_matched->push_back(matching_tps_clus.size());
-      m_clus_x->push_back(bary_x/bary_sum);
-      m_clus_y->push_back(bary_y/bary_sum);
-      m_clus_z->push_back(bary_z/bary_sum);
+      if (m_verb) cout << "NEW CLUSTER" << endl;
+
+      m_grid_clus.at(k) = m_clus;
+
+      m_clus_pix->push_back(std::vector<int>(1,idx));
+      m_clus_tp->push_back(m_digi_tp->at(i));
+      m_clus_matched->push_back(0);
+      m_clus_x->push_back(pix->x(idx));
+      m_clus_y->push_back(pix->y(idx));
+      m_clus_z->push_back(pix->z(idx));
       m_clus_used->push_back(0);
-      m_clus_sat->push_back(nsat);
-      m_clus_nstrips->push_back(nstrips);
-      m_clus_layer->push_back(ref_lay);
-      m_clus_ladder->push_back(ref_lad);
-      m_clus_module->push_back(ref_mod);
-      m_clus_seg->push_back(ref_seg);
-      m_clus_PS->push_back(ref_nseg);
-      m_clus_nrows->push_back(ref_nrow);
-      m_clus_strip->push_back(bary_strip/bary_sum-fmod(bary_strip/bary_sum,0.5));
+      m_clus_sat->push_back(0);
+      m_clus_nstrips->push_back(1);
+      m_clus_layer->push_back(pix->layer(idx));
+      m_clus_ladder->push_back(pix->ladder(idx));
+      m_clus_module->push_back(pix->module(idx));
+      m_clus_seg->push_back(pix->column(idx));
+      m_clus_PS->push_back(pix->ncolumn(idx));
+      m_clus_nrows->push_back(pix->nrow(idx));
+      m_clus_strip->push_back(pix->row(idx)); // Sum of the rows for the moment
+
+      if (pix->e(idx)==255) ++m_clus_sat->at(m_clus);
+
+      ++m_clus;
+    } 
+    else // We add it to the growing cluster
+    {
+      if (m_verb) cout << "ACCUMULATE" << endl;
+
+      c = m_grid_clus.at(root);
+      m_grid_clus.at(k) = c;
+
+      m_clus_pix->at(c).push_back(idx);
+
+      for (int l=0;l<static_cast<int>(m_digi_tp->at(i).size());++l) // Loop over match tps
+      {
+	is_there=0;
+
+	for (int ll=0;ll<static_cast<int>(m_clus_tp->at(c).size());++ll) 
+	{
+	  if (m_clus_tp->at(c).at(ll)==(m_digi_tp->at(i)).at(l))
+	  {
+	    is_there=1;
+	    break;
+	  }
+	}
+
+	if (is_there==0) m_clus_tp->at(c).push_back((m_digi_tp->at(i)).at(l));
+      }	
+
+      m_clus_x->at(c)     += pix->x(idx);
+      m_clus_y->at(c)     += pix->y(idx);
+      m_clus_z->at(c)     += pix->z(idx);
+      m_clus_strip->at(c) += pix->row(idx);
+
+      if (pix->e(idx)==255) ++m_clus_sat->at(c);
+      ++m_clus_nstrips->at(c);
     }
   }
 
+  // Barycenters of the new clusters
 
+  for (c=clus0;c<m_clus;++c) 
+  {
+    nstrips    = m_clus_nstrips->at(c);
+    bary_strip = m_clus_strip->at(c)/nstrips;
+
+    m_clus_matched->at(c) = m_clus_tp->at(c).size();
+    m_clus_x->at(c)       = m_clus_x->at(c)/nstrips;
+    m_clus_y->at(c)       = m_clus_y->at(c)/nstrips;
+    m_clus_z->at(c)       = m_clus_z->at(c)/nstrips;
+    m_clus_strip->at(c)   = bary_strip-fmod(bary_strip,0.5);
+  }
+
+  // Clean the grid for the next module
+
+  for (int k=0;k<ndig;++k) 
+  {
+    idx = m_digi_ref->at(m_grid_digi.at(k));
+    m_grid.at((pix->row(idx)-rmin)*gcol+pix->column(idx)-cmin) = -1;
+  }
 }
 
 
@@ -635,14 +717,24 @@ void L1TrackTrigger_analysis::get_stubs(int layer,MCExtractor *mc)
  
   double PI = 4.*atan(1.);
 
-  for (int i=0;i<m_clus;++i) // Loop over clusters
+  int i = 0;
+  int j = 0;
+
+  // Clusters are taken from the module pair index (see index_clusters)
+  // The loops follow the increasing cluster index order, exactly as a full 
+  // scan over all the clusters would do 
+
+  if (layer<0 || layer>=static_cast<int>(m_clus_bottom.size())) return;
+
+  const std::vector<int> &bottoms = m_clus_bottom.at(layer);
+
+  for (int ib=0;ib<static_cast<int>(bottoms.size());++ib) // Loop over odd module clusters
   {
+    i               = bottoms.at(ib);
     n_candidates    = 0;
 
-    // Selection
-    if (m_clus_layer->at(i)   != layer ||             // Don't use cluster of another layer
-	m_clus_module->at(i)%2!= 1     ||             // Start from an odd module
-	m_clus_used->at(i)    == 1     ||             // Don't use already used clusters 
+    // Selection (layer and module parity are guaranteed by the index)
+    if (m_clus_used->at(i)    == 1     ||             // Don't use already used clusters 
 	m_clus_nstrips->at(i) >  m_max_wclus ||       // Cut on cluster width
 	(m_clus_matched->at(i) == 0 && m_matchStubs)) // Use only matched clusters (for tests)
       continue;    
@@ -668,12 +760,15 @@ void L1TrackTrigger_analysis::get_stubs(int layer,MCExtractor *mc)
     }
 
 
-    for (int j=i+1;j<m_clus;++j) // Loop over other clusters
+    const std::vector<int> &tops = m_clus_top.at(m_clus_pair.at(i));
+
+    for (int it=0;it<static_cast<int>(tops.size());++it) // Loop over clusters of the same module
     {      
-      if (m_clus_layer->at(j) !=layer ||     
+      j = tops.at(it);
+
+      // Same layer/ladder and module+1 are guaranteed by the index
+      if (j<=i ||     
 	  m_clus_used->at(j)  ==1     ||                  
-	  m_clus_ladder->at(i)!=m_clus_ladder->at(j) ||    
-	  (m_clus_module->at(j)-m_clus_module->at(i))!=1 ||
 	  m_clus_nstrips->at(j)>m_max_wclus ||          
 	  (m_clus_matched->at(j)==0 && m_matchStubs))       
 	continue;  
@@ -869,6 +964,10 @@ void L1TrackTrigger_analysis::get_stubs(int layer,MCExtractor *mc)
 
 void L1TrackTrigger_analysis::fillTree()
 {
+  m_clus_tp_branch.flatten();
+  m_clus_hits_branch.flatten();
+  m_clus_pix_branch.flatten();
+
   m_tree_L1TrackTrigger->Fill();
   ++n_tot_evt;
 }
@@ -902,27 +1001,100 @@ int L1TrackTrigger_analysis::getMatchingTP(int i, int j)
 }
 
 
-bool L1TrackTrigger_analysis::is_neighbour(PixelExtractor *pix, int idx, int lay, int lad, int mod)
+/*
+
+Method building the module pair index used by get_stubs
+
+A stub can only be made from a cluster on an odd module (bottom candidate) 
+and a cluster on the following module of the same layer and ladder (top 
+candidate), so we sort the clusters once per event instead of testing all 
+the cluster pairs of the event for each layer.
+
+ */
+
+void L1TrackTrigger_analysis::index_clusters()
 {
-  if (pix->layer(idx) !=lay) return false;
-  if (pix->ladder(idx)!=lad) return false;
-  if (pix->module(idx)!=mod) return false;
-  
-  int drow = 0;
-  int dseg = 0;
-  
-  int nrow = static_cast<int>(clus_row.size());
+  int lay = 0;
+  int mod = 0;
+  int idx = 0;
 
-  for (int j=0;j<nrow;++j) // Loop over already stored digis
-  { 
-    drow = abs(clus_row.at(j)-pix->row(idx));
-    dseg = abs(clus_col.at(j)-pix->column(idx));
+  for (int i=0;i<static_cast<int>(m_clus_bottom.size());++i) m_clus_bottom.at(i).clear();
+
+  m_pair_index.clear();
+  m_clus_pair.assign(m_clus,-1);
+  m_n_pairs = 0;
+
+  for (int i=0;i<m_clus;++i) // Loop over clusters
+  {
+    lay = m_clus_layer->at(i);
+    mod = m_clus_module->at(i);
+
+    if (lay<0 || lay>=static_cast<int>(m_clus_bottom.size())) continue;
+
+    if (mod%2==1) // Bottom candidate of pair (lay,lad,mod) 
+    {
+      m_clus_pair.at(i) = L1TrackTrigger_analysis::getPairIndex(lay,m_clus_ladder->at(i),mod);
+      m_clus_bottom.at(lay).push_back(i);
+    }
 
-    if (drow <= 1 && dseg == 0) return true;
-    if (drow == 0 && dseg <= 1 && pix->ncolumn(idx)>2) return true;
+    if ((mod-1)%2==1) // Top candidate of pair (lay,lad,mod-1)
+    {
+      idx = L1TrackTrigger_analysis::getPairIndex(lay,m_clus_ladder->at(i),mod-1);
+      m_clus_top.at(idx).push_back(i);
+    }
   }
-  
-  return false;
+}
+
+
+int L1TrackTrigger_analysis::getPairIndex(int lay, int lad, int mod)
+{
+  int code = (lay*1000+lad)*1000+mod;
+
+  std::map<int,int>::iterator it = m_pair_index.find(code);
+
+  if (it!=m_pair_index.end()) return it->second;
+
+  // New module pair, we recycle the top lists of the previous events
+
+  if (m_n_pairs==static_cast<int>(m_clus_top.size())) 
+  {
+    m_clus_top.push_back(std::vector<int>());
+  }
+  else
+  {
+    m_clus_top.at(m_n_pairs).clear();
+  }
+
+  m_pair_index.insert(std::make_pair(code,m_n_pairs));
+  ++m_n_pairs;
+
+  return m_n_pairs-1;
+}
+
+
+// Union-find methods used by the digi clustering
+
+int L1TrackTrigger_analysis::getRoot(int k)
+{
+  while (m_grid_link.at(k)!=k)
+  {
+    m_grid_link.at(k) = m_grid_link.at(m_grid_link.at(k)); // Path halving
+    k = m_grid_link.at(k);
+  }
+
+  return k;
+}
+
+
+void L1TrackTrigger_analysis::mergeDigis(int k, int l)
+{
+  int root_k = L1TrackTrigger_analysis::getRoot(k);
+  int root_l = L1TrackTrigger_analysis::getRoot(l);
+
+  // The first digi stays the root of the cluster
+
+  if (root_k<root_l) m_grid_link.at(root_l) = root_k;
+  if (root_l<root_k) m_grid_link.at(root_k) = root_l;
 }
 
 
@@ -986,6 +1158,8 @@ void L1TrackTrigger_analysis::initialize()
   m_stub_pdg     = new  std::vector<int>;  
   m_stub_pid     = new  std::vector<int>;  
 
+  m_clus_bottom.resize(25); // One list per layer (5 to 24 are used)
+
   L1TrackTrigger_analysis::reset();
 
 
@@ -1021,9 +1195,9 @@ void L1TrackTrigger_analysis::initialize()
     m_tree_L1TrackTrigger->Branch("CLUS_match",     &m_clus_matched);
     m_tree_L1TrackTrigger->Branch("CLUS_PS",        &m_clus_PS);
     m_tree_L1TrackTrigger->Branch("CLUS_nrows",     &m_clus_nrows);
-    m_tree_L1TrackTrigger->Branch("CLUS_tp",        &m_clus_tp);
-    m_tree_L1TrackTrigger->Branch("CLUS_hits",      &m_clus_hits);
-    m_tree_L1TrackTrigger->Branch("CLUS_pix" ,      &m_clus_pix);
+    m_clus_tp_branch.branch(m_tree_L1TrackTrigger,"CLUS_tp",m_clus_tp,m_flat);
+    m_clus_hits_branch.branch(m_tree_L1TrackTrigger,"CLUS_hits",m_clus_hits,m_flat);
+    m_clus_pix_branch.branch(m_tree_L1TrackTrigger,"CLUS_pix",m_clus_pix,m_flat);
     m_tree_L1TrackTrigger->Branch("CLUS_process",   &m_clus_pid);
 
     m_tree_L1TrackTrigger->Branch("STUB_clust1",    &m_stub_clust1);
@@ -1118,4 +1292,10 @@ void L1TrackTrigger_analysis::reset()
   m_stub_cor->clear(); 
   m_stub_pdg->clear();
   m_stub_pid->clear();
+
+  for (int i=0;i<static_cast<int>(m_clus_bottom.size());++i) m_clus_bottom.at(i).clear();
+
+  m_clus_pair.clear();
+  m_pair_index.clear();
+  m_n_pairs = 0;
 }
@@ -1,10 +1,11 @@
 #include "../interface/MCExtractor.h"
 
 
-MCExtractor::MCExtractor(bool doTree)
+MCExtractor::MCExtractor(bool doTree, bool doFlat)
 {
   // Set everything to 0
   m_OK = false;
+  m_flat = doFlat;
 
   m_gen_x       = new std::vector<float>;
   m_gen_y       = new std::vector<float>;
@@ -49,6 +50,7 @@ MCExtractor::MCExtractor(TFile *a_file)
 
   // Tree definition
   m_OK = false;
+  m_flat = false;
 
   m_gen_x       = new std::vector<float>;
   m_gen_y       = new std::vector<float>;
@@ -109,11 +111,16 @@ MCExtractor::MCExtractor(TFile *a_file)
   m_tree_retrieved->SetBranchAddress("subpart_x",        &m_part_x);
   m_tree_retrieved->SetBranchAddress("subpart_y",        &m_part_y);
   m_tree_retrieved->SetBranchAddress("subpart_z",        &m_part_z);
-  m_tree_retrieved->SetBranchAddress("subpart_stId",     &m_part_stId);
+
+  m_stId_branch.setAddress(m_tree_retrieved,"subpart_stId",m_part_stId);
+
+  m_flat = m_stId_branch.isFlat();
 }
 
 
 
+#ifndef RECOEXTRACTOR_STANDALONE
+
 void MCExtractor::init(const edm::EventSetup *setup)
 {
   //
@@ -197,6 +204,8 @@ void MCExtractor::writeInfo(const edm::Event *event)
   
   m_part_n    = n_part;
 
+  MCExtractor::buildTPIndex();
+
   //___________________________
   //
   // Fill the tree :
@@ -236,6 +245,8 @@ void MCExtractor::getGenInfo(const edm::Event *event)
 }
 
 
+#endif
+
 //
 // Method getting the info from an input file
 //
@@ -244,6 +255,7 @@ void MCExtractor::getInfo(int ievt)
 {
   reset();
   m_tree_retrieved->GetEntry(ievt); 
+  MCExtractor::buildTPIndex();
 }
 
 // Method initializing everything (to do before each event)
@@ -277,11 +289,15 @@ void MCExtractor::reset()
   m_part_z->clear();       
   m_part_used->clear();    
 
+  m_TP_index.clear();
+  m_TP_ndup.clear();
 }    
 
   
 void MCExtractor::fillTree()
 {
+  m_stId_branch.flatten();
+
   m_tree_new->Fill(); 
 }
  
@@ -316,7 +332,7 @@ void MCExtractor::createTree()
   m_tree_new->Branch("subpart_n",            &m_part_n);
   m_tree_new->Branch("subpart_pdgId",        &m_part_pdgId);
   m_tree_new->Branch("subpart_evtId",        &m_part_evtId);
-  m_tree_new->Branch("subpart_stId",         &m_part_stId);
+  m_stId_branch.branch(m_tree_new,"subpart_stId",m_part_stId,m_flat);
   m_tree_new->Branch("subpart_px",           &m_part_px);
   m_tree_new->Branch("subpart_py",           &m_part_py);
   m_tree_new->Branch("subpart_pz",           &m_part_pz);
@@ -350,29 +366,53 @@ void MCExtractor::findMatchingTP(const int &stID,const int &evtID,
   if (verb)
     std::cout << " Into new matching " << std::endl;
 
-  n_TP       = getNTP();
-
   if (itp!=-1) return;
 
+  unsigned long long key = (static_cast<unsigned long long>(static_cast<unsigned int>(evtID)) << 32) 
+    | static_cast<unsigned int>(stID);
+
+  std::unordered_map<unsigned long long,int>::const_iterator it = m_TP_index.find(key);
+
+  if (it==m_TP_index.end()) return;
+
+  if (m_TP_ndup.find(key)!=m_TP_ndup.end())
+    std::cout << " More than one tracking particle for one simtrack ID: problem!!!! " << std::endl;
+
+  itp = it->second;
+
+  return;
+}
+
+
+// Method building the (evtID,simtrack ID) -> TP index used by findMatchingTP
+// To be called once the TP info of the event is filled (writeInfo or getInfo)
+
+void MCExtractor::buildTPIndex()
+{
+  unsigned long long key;
+
+  m_TP_index.clear();
+  m_TP_ndup.clear();
+
+  n_TP = m_stId_branch.size();
 
   for (int i=0;i<n_TP;++i) // Loop over tracking particles
   {
-    if (m_part_evtId->at(i)!=evtID) continue;
-
-    if (verb)
-      std::cout << " Try to match " << std::endl;
+    IntSpan stIds = m_stId_branch.row(i);
 
-    for (unsigned int j=0;j<m_part_stId->at(i).size();++j) // Loop on simtrack
+    for (int j=0;j<stIds.size();++j) // Loop on simtrack
     {
-      if (m_part_stId->at(i).at(j)!=stID) continue;
+      key = (static_cast<unsigned long long>(static_cast<unsigned int>(m_part_evtId->at(i))) << 32) 
+	| static_cast<unsigned int>(stIds[j]);
+
+      std::pair<std::unordered_map<unsigned long long,int>::iterator,bool> ins = 
+	m_TP_index.insert(std::make_pair(key,i));
 
-      if (itp!=-1 && itp!=i) 
-	std::cout << " More than one tracking particle for one simtrack ID: problem!!!! " << std::endl;
+      if (ins.second || ins.first->second==i) continue;
 
-      itp = i;
+      // The simtrack was already found in another TP, we keep the last one
+      ins.first->second = i;
+      ++m_TP_ndup[key];
     }
   }
-
-  return;
 }
-
@@ -0,0 +1,188 @@
+#include "../interface/ModuleGeometry.h"
+
+
+ModuleGeometry::ModuleGeometry()
+{
+  m_geomId  = 0;
+  m_stackId = 0;
+}
+
+ModuleGeometry::~ModuleGeometry()
+{}
+
+
+//
+// Method filling the module info from the tracker geometry
+//
+
+void ModuleGeometry::init(const edm::EventSetup *setup)
+{
+  unsigned long long geomId = setup->get<TrackerDigiGeometryRecord>().cacheIdentifier();
+
+  if (geomId==m_geomId) return; // Geometry didn't change, nothing to do
+
+  m_geomId  = geomId;
+  m_stackId = 0;
+
+  edm::ESHandle<TrackerGeometry> theTrackerGeometry;
+  setup->get<TrackerDigiGeometryRecord>().get(theTrackerGeometry);
+
+  m_modules.clear();
+  m_index.clear();
+  m_stack_index[0].clear();
+  m_stack_index[1].clear();
+
+  const TrackerGeometry::DetUnitContainer& units = theTrackerGeometry->detUnits();
+
+  for (unsigned int i=0;i<units.size();++i)
+  {
+    const PixelGeomDetUnit* theGeomDet = dynamic_cast<const PixelGeomDetUnit*>(units.at(i));
+
+    if (!theGeomDet) continue;
+
+    ModuleGeometry::fillModule(theGeomDet);
+  }
+
+  std::cout << "ModuleGeometry: " << m_modules.size() << " modules cached" << std::endl;
+}
+
+
+//
+// Method filling the stack info from the stacked geometry
+//
+
+void ModuleGeometry::initStacks(const edm::EventSetup *setup)
+{
+  unsigned long long stackId = setup->get<StackedTrackerGeometryRecord>().cacheIdentifier();
+
+  if (stackId==m_stackId) return;
+
+  m_stackId = stackId;
+
+  m_stack_index[0].clear();
+  m_stack_index[1].clear();
+
+  edm::ESHandle<StackedTrackerGeometry> theStackedTrackerGeometry;
+  setup->get<StackedTrackerGeometryRecord>().get(theStackedTrackerGeometry);
+
+  const StackedTrackerGeometry::StackContainer& stacks = theStackedTrackerGeometry->stacks();
+
+  for (unsigned int i=0;i<stacks.size();++i)
+  {
+    for (int k=0;k<2;++k)
+      m_stack_index[k].insert(std::make_pair(stacks.at(i)->Id().rawId(),
+					     ModuleGeometry::index(stacks.at(i)->stackMember(k).rawId())));
+  }
+}
+
+
+int ModuleGeometry::index(unsigned int detId)
+{
+  std::unordered_map<unsigned int,int>::const_iterator it = m_index.find(detId);
+
+  return (it==m_index.end()) ? -1 : it->second;
+}
+
+
+int ModuleGeometry::stackIndex(unsigned int stackId, int member)
+{
+  if (member<0 || member>1) return -1;
+
+  std::unordered_map<unsigned int,int>::const_iterator it = m_stack_index[member].find(stackId);
+
+  return (it==m_stack_index[member].end()) ? -1 : it->second;
+}
+
+
+GlobalPoint ModuleGeometry::position(int idx, float row, float col)
+{
+  const ModuleInfo &mod = m_modules.at(idx);
+
+  if (!mod.linear)
+    return mod.det->surface().toGlobal(mod.det->specificTopology().localPosition(MeasurementPoint(row+0.5,col+0.5)));
+
+  return GlobalPoint(mod.pos0[0]+row*mod.drow[0]+col*mod.dcol[0],
+		     mod.pos0[1]+row*mod.drow[1]+col*mod.dcol[1],
+		     mod.pos0[2]+row*mod.drow[2]+col*mod.dcol[2]);
+}
+
+
+void ModuleGeometry::fillModule(const PixelGeomDetUnit *det)
+{
+  DetId detIdObject(det->geographicalId());
+
+  bool barrel = (detIdObject.subdetId() == static_cast<int>(PixelSubdetector::PixelBarrel));
+  bool endcap = (detIdObject.subdetId() == static_cast<int>(PixelSubdetector::PixelEndcap));
+
+  if (!barrel && !endcap) return;
+
+  const PixelTopology* topol = &(det->specificTopology());
+
+  ModuleInfo mod;
+
+  mod.detId    = detIdObject.rawId();
+  mod.det      = det;
+  mod.nrows    = topol->nrows();
+  mod.ncolumns = topol->ncolumns();
+  mod.pitchx   = topol->pitch().first;
+  mod.pitchy   = topol->pitch().second;
+  mod.PS       = (mod.ncolumns>2);
+
+  // Same coding as in the PixelExtractor tree 
+
+  if (barrel)
+  {
+    PXBDetId bdetid(detIdObject);
+
+    mod.layer  = static_cast<int>(bdetid.layer()); 
+    mod.ladder = static_cast<int>(bdetid.ladder()); 
+    mod.module = static_cast<int>(bdetid.module()); 
+  }
+
+  if (endcap)
+  {
+    PXFDetId fdetid(detIdObject);
+
+    int disk = (static_cast<int>(fdetid.side())*2-3)*static_cast<int>(fdetid.disk());
+
+    mod.layer = -1;
+    if (disk>=4)  mod.layer = 7+disk; 
+    if (disk<=-4) mod.layer = 14-disk; 
+
+    (static_cast<int>(fdetid.disk())<4)
+      ? mod.ladder = static_cast<int>(fdetid.blade())
+      : mod.ladder = static_cast<int>(fdetid.ring());
+
+    mod.module = static_cast<int>(fdetid.module()); 
+  }
+
+  // Local to global frame, written as a function of (row,column)
+  // This is exact only for constant pitch modules, so we check it
+  // at the far corner and in the middle of the module
+
+  GlobalPoint p0 = det->surface().toGlobal(topol->localPosition(MeasurementPoint(0.5,0.5)));
+  GlobalPoint p1 = det->surface().toGlobal(topol->localPosition(MeasurementPoint(1.5,0.5)));
+  GlobalPoint p2 = det->surface().toGlobal(topol->localPosition(MeasurementPoint(0.5,1.5)));
+
+  mod.pos0[0] = p0.x(); mod.pos0[1] = p0.y(); mod.pos0[2] = p0.z();
+  mod.drow[0] = p1.x()-p0.x(); mod.drow[1] = p1.y()-p0.y(); mod.drow[2] = p1.z()-p0.z();
+  mod.dcol[0] = p2.x()-p0.x(); mod.dcol[1] = p2.y()-p0.y(); mod.dcol[2] = p2.z()-p0.z();
+
+  mod.linear = true;
+
+  int check_row[2] = {mod.nrows-1,mod.nrows/2};
+  int check_col[2] = {mod.ncolumns-1,mod.ncolumns/2};
+
+  for (int k=0;k<2;++k)
+  {
+    GlobalPoint pt = det->surface().toGlobal(topol->localPosition(MeasurementPoint(check_row[k]+0.5,check_col[k]+0.5)));
+
+    if (fabs(pt.x()-(mod.pos0[0]+check_row[k]*mod.drow[0]+check_col[k]*mod.dcol[0]))>1e-4 ||
+	fabs(pt.y()-(mod.pos0[1]+check_row[k]*mod.drow[1]+check_col[k]*mod.dcol[1]))>1e-4 ||
+	fabs(pt.z()-(mod.pos0[2]+check_row[k]*mod.drow[2]+check_col[k]*mod.dcol[2]))>1e-4)
+      mod.linear = false;
+  }
+
+  m_index.insert(std::make_pair(mod.detId,static_cast<int>(m_modules.size())));
+  m_modules.push_back(mod);
+}
@@ -1,11 +1,13 @@
 
 #include "../interface/PixelExtractor.h"
 
+#ifndef RECOEXTRACTOR_STANDALONE
 
-PixelExtractor::PixelExtractor(edm::InputTag tag, bool doTree, bool doMatch)
+PixelExtractor::PixelExtractor(edm::InputTag tag, bool doTree, bool doMatch, bool doFlat)
 {
   m_OK = false;
   m_tag = tag;
+  m_flat = doFlat;
   
 
   m_matching = doMatch;
@@ -50,8 +52,8 @@ PixelExtractor::PixelExtractor(edm::InputTag tag, bool doTree, bool doMatch)
     m_tree->Branch("PIX_row",       &m_pixclus_row);
     m_tree->Branch("PIX_column",    &m_pixclus_column);
     m_tree->Branch("PIX_simhit",    &m_pixclus_simhit);
-    m_tree->Branch("PIX_simhitID",  &m_pixclus_simhitID);
-    m_tree->Branch("PIX_evtID",     &m_pixclus_evtID);
+    m_simhitID_branch.branch(m_tree,"PIX_simhitID",m_pixclus_simhitID,m_flat);
+    m_evtID_branch.branch(m_tree,"PIX_evtID",m_pixclus_evtID,m_flat);
     m_tree->Branch("PIX_layer",     &m_pixclus_layer);
     m_tree->Branch("PIX_module",    &m_pixclus_module);
     m_tree->Branch("PIX_ladder",    &m_pixclus_ladder);
@@ -62,6 +64,8 @@ PixelExtractor::PixelExtractor(edm::InputTag tag, bool doTree, bool doMatch)
   }
 }
 
+#endif
+
 PixelExtractor::PixelExtractor(TFile *a_file)
 {
   std::cout << "PixelExtractor object is retrieved" << std::endl;
@@ -113,8 +117,10 @@ PixelExtractor::PixelExtractor(TFile *a_file)
   m_tree->SetBranchAddress("PIX_row",       &m_pixclus_row);
   m_tree->SetBranchAddress("PIX_column",    &m_pixclus_column);
   m_tree->SetBranchAddress("PIX_simhit",    &m_pixclus_simhit);
-  m_tree->SetBranchAddress("PIX_simhitID",  &m_pixclus_simhitID);
-  m_tree->SetBranchAddress("PIX_evtID",     &m_pixclus_evtID);
+  m_simhitID_branch.setAddress(m_tree,"PIX_simhitID",m_pixclus_simhitID);
+  m_evtID_branch.setAddress(m_tree,"PIX_evtID",m_pixclus_evtID);
+
+  m_flat = m_simhitID_branch.isFlat();
   m_tree->SetBranchAddress("PIX_layer",     &m_pixclus_layer);
   m_tree->SetBranchAddress("PIX_module",    &m_pixclus_module);
   m_tree->SetBranchAddress("PIX_ladder",    &m_pixclus_ladder);
@@ -128,9 +134,12 @@ PixelExtractor::~PixelExtractor()
 {}
 
 
-void PixelExtractor::init(const edm::EventSetup *setup)
+#ifndef RECOEXTRACTOR_STANDALONE
+
+void PixelExtractor::init(const edm::EventSetup *setup, ModuleGeometry *geom)
 {
-  setup->get<TrackerDigiGeometryRecord>().get(theTrackerGeometry);
+  m_geom = geom;
+  m_geom->init(setup);
 }
 
 //
@@ -164,17 +173,8 @@ void PixelExtractor::writeInfo(const edm::Event *event)
     event->getByLabel(m_tag, pDigiLinkColl);
   }
 
-  bool barrel;
-  bool endcap;
-
-  int disk;  
+  int idx;
 
-  int cols;    
-  int rows;    
-  float pitchX;
-  float pitchY;
-
-  LocalPoint  clustlp;
   GlobalPoint pos;    
 
   edm::DetSet<PixelDigi>::const_iterator begin;
@@ -186,34 +186,39 @@ void PixelExtractor::writeInfo(const edm::Event *event)
     begin             = DSViterDigi->data.begin(); 
     end               = DSViterDigi->data.end();
 
-    DetId detIdObject(DSViterDigi->detId());
-    
-    barrel = (detIdObject.subdetId() == static_cast<int>(PixelSubdetector::PixelBarrel));
-    endcap = (detIdObject.subdetId() == static_cast<int>(PixelSubdetector::PixelEndcap));
+    // Module info is taken from the geometry cache
 
+    idx = m_geom->index(DSViterDigi->detId());
 
-    if (!barrel && !endcap) continue;
+    if (idx==-1) continue; // Not a barrel or endcap module
 
-    const PixelGeomDetUnit* theGeomDet = dynamic_cast<const PixelGeomDetUnit*>(theTrackerGeometry->idToDet(detIdObject));      
-    const PixelTopology* topol         = &(theGeomDet->specificTopology());
+    const ModuleInfo &mod = m_geom->module(idx);
 
-    cols     = topol->ncolumns();
-    rows     = topol->nrows();
-    pitchX = topol->pitch().first;
-    pitchY = topol->pitch().second;
+    pDigiLinks = 0;
+    m_link_index.clear();
 
     if (m_matching)
     {
       edm::DetSetVector<PixelDigiSimLink>::const_iterator isearch = pDigiLinkColl->find(DSViterDigi->id);
 
       if(isearch != pDigiLinkColl->end())      //if it is not empty 
-	pDigiLinks = (*pDigiLinkColl)[DSViterDigi->id];	        
+      {
+	pDigiLinks = &(*isearch);
+
+	// Sort the links of the module by channel, once, 
+	// instead of scanning all of them for each digi
+
+	for (unsigned int il=0;il<pDigiLinks->data.size();++il) 
+	  m_link_index.push_back(std::make_pair(static_cast<int>(pDigiLinks->data[il].channel()),
+						static_cast<int>(il)));
+
+	std::sort(m_link_index.begin(),m_link_index.end());
+      }
     }
 
     for (iter = begin; iter != end; ++iter)
     {
-      clustlp = topol->localPosition( MeasurementPoint(float((*iter).row())+0.5,float((*iter).column())+0.5));
-      pos     =  theGeomDet->surface().toGlobal(clustlp);
+      pos = m_geom->position(idx,float((*iter).row()),float((*iter).column()));
 
       the_ids.clear();
       the_eids.clear();
@@ -225,23 +230,22 @@ void PixelExtractor::writeInfo(const edm::Event *event)
       m_pixclus_row->push_back((*iter).row()); 
       m_pixclus_column->push_back((*iter).column());
 
-      if (m_matching)
+      if (m_matching && pDigiLinks)
       {
-	if (pDigiLinks.data.size() != 0)
-	{
-	  edm::DetSet<PixelDigiSimLink>::const_iterator it;
-	  // Loop over DigisSimLink in this det unit
+	// Loop over the DigisSimLink of this channel (in their original order)
+
+	std::vector< std::pair<int,int> >::const_iterator it = 
+	  std::lower_bound(m_link_index.begin(),m_link_index.end(),
+			   std::make_pair(static_cast<int>((*iter).channel()),-1));
 
-	  for(it = pDigiLinks.data.begin();  it != pDigiLinks.data.end(); it++) 
-	  {         
-	    if (static_cast<int>(it->channel())!=static_cast<int>((*iter).channel()))
-	      continue;
+	for( ; it != m_link_index.end() && it->first==static_cast<int>((*iter).channel()); ++it) 
+	{         
+	  const PixelDigiSimLink &link = pDigiLinks->data[it->second];
 
-	    //std::cout << it->SimTrackId() << " ##### " << it->eventId().rawId() << std::endl;
+	  //std::cout << link.SimTrackId() << " ##### " << link.eventId().rawId() << std::endl;
 
-	    the_ids.push_back(it->SimTrackId()); 
-	    the_eids.push_back(it->eventId().rawId()); 
-	  }
+	  the_ids.push_back(link.SimTrackId()); 
+	  the_eids.push_back(link.eventId().rawId()); 
 	}
       }
 
@@ -251,40 +255,14 @@ void PixelExtractor::writeInfo(const edm::Event *event)
       m_pixclus_simhitID->push_back(the_ids);
       m_pixclus_evtID->push_back(the_eids);
 
-      if (barrel)
-      {
-	PXBDetId bdetid(detIdObject);
-	m_pixclus_layer->push_back(static_cast<int>(bdetid.layer())); 
-      	m_pixclus_module->push_back(static_cast<int>(bdetid.module())); 
-      	m_pixclus_ladder->push_back(static_cast<int>(bdetid.ladder())); 
-      }
-
-      if (endcap)
-      {
-	PXFDetId fdetid(detIdObject);
-
-	disk = (static_cast<int>(fdetid.side())*2-3)*static_cast<int>(fdetid.disk());
-
-	if (disk>=4)  m_pixclus_layer->push_back(7+disk); 
-	if (disk<=-4) m_pixclus_layer->push_back(14-disk); 
-	if (disk<4 && disk>-4) m_pixclus_layer->push_back(-1); 
-
-	if (static_cast<int>(fdetid.disk())<4)
-	{
-	  m_pixclus_ladder->push_back(static_cast<int>(fdetid.blade())); 
-	}
-	else
-	{
-	  m_pixclus_ladder->push_back(static_cast<int>(fdetid.ring())); 
-	}
-
-	m_pixclus_module->push_back(static_cast<int>(fdetid.module())); 
-      }
+      m_pixclus_layer->push_back(mod.layer); 
+      m_pixclus_module->push_back(mod.module); 
+      m_pixclus_ladder->push_back(mod.ladder); 
 
-      m_pixclus_nrow->push_back(rows);
-      m_pixclus_ncolumn->push_back(cols);
-      m_pixclus_pitchx->push_back(pitchX);
-      m_pixclus_pitchy->push_back(pitchY);
+      m_pixclus_nrow->push_back(mod.nrows);
+      m_pixclus_ncolumn->push_back(mod.ncolumns);
+      m_pixclus_pitchx->push_back(mod.pitchx);
+      m_pixclus_pitchy->push_back(mod.pitchy);
       
       m_pclus++;
     }
@@ -294,6 +272,8 @@ void PixelExtractor::writeInfo(const edm::Event *event)
 }
 
 
+#endif
+
 //
 // Method getting the info from an input file
 //
@@ -331,6 +311,9 @@ void PixelExtractor::reset()
 
 void PixelExtractor::fillTree()
 {
+  m_simhitID_branch.flatten();
+  m_evtID_branch.flatten();
+
   m_tree->Fill(); 
 }
  
@@ -11,8 +11,10 @@ RecoExtractor::RecoExtractor(const edm::ParameterSet& config) :
   do_TK_         (config.getUntrackedParameter<bool>("doTranslation", false)),
   do_MATCH_      (config.getUntrackedParameter<bool>("doMatch",    false)),
   do_L1tt_       (config.getUntrackedParameter<bool>("doL1TT", false)),
+  do_FLAT_       (config.getUntrackedParameter<bool>("flatBranches", false)),
   nevts_         (config.getUntrackedParameter<int>("n_events", 10000)),
   skip_          (config.getUntrackedParameter<int>("skip_events", 0)),
+  nthreads_      (config.getUntrackedParameter<int>("n_threads", 1)),
 
   PIX_tag_       (config.getParameter<edm::InputTag>("pixel_tag")),
   outFilename_   (config.getParameter<std::string>("extractedRootFile")),
@@ -23,7 +25,7 @@ RecoExtractor::RecoExtractor(const edm::ParameterSet& config) :
   m_ana_settings = new AnalysisSettings(&m_settings_);
   m_ana_settings->parseSettings();
 
- 
+  m_L1TT_analysis = 0; // Only created if needed (see beginJob)
 }
 
 
@@ -41,9 +43,12 @@ void RecoExtractor::beginJob()
     ? RecoExtractor::initialize()
     : RecoExtractor::retrieve();
 
-  if (do_MC_ && do_PIX_ && do_L1tt_) 
+  // In the parallel replay mode each worker has its own analysis
+  if (do_MC_ && do_PIX_ && do_L1tt_ && (do_fill_ || nthreads_<=1)) 
     m_L1TT_analysis = new L1TrackTrigger_analysis(m_ana_settings,skip_);
 
+  evt_offset_ = skip_;
+
   skip_=0; // Temporary hack, process files separately..
 
   nevent_tot = skip_;
@@ -61,9 +66,9 @@ void RecoExtractor::beginRun(Run const& run, EventSetup const& setup)
 
   if (do_fill_) // We are filling the ntuple, first init the geom stuff
   {
-    if (do_PIX_)      m_PIX->init(&setup);
+    if (do_PIX_)      m_PIX->init(&setup,m_GEOM);
     if (do_MC_)       m_MC->init(&setup);
-    if (do_STUB_)     m_STUB->init(&setup);
+    if (do_STUB_)     m_STUB->init(&setup,m_GEOM);
   }
 
   // If we start from existing file we don't have to loop over events
@@ -74,15 +79,23 @@ void RecoExtractor::beginRun(Run const& run, EventSetup const& setup)
     
     nevent = min(skip_+nevts_,m_PIX->n_events()); 
 
-    for (int i=skip_;i<nevent;++i) 
+    if (nthreads_>1 && do_MC_ && do_L1tt_) // Parallel replay of the L1TT analysis
     {
-      if (i%10000 == 0)
-	std::cout << "Processing " << i << "th event" << std::endl;
+      RecoExtractor::parallelReplay(skip_,nevent);
+      nevent_tot += nevent-skip_;
+    }
+    else
+    {
+      for (int i=skip_;i<nevent;++i) 
+      {
+	if (i%10000 == 0)
+	  std::cout << "Processing " << i << "th event" << std::endl;
 
-      RecoExtractor::getInfo(i);// Retrieve the info from an existing ROOTuple      
-      RecoExtractor::doAna();   // Then do the analysis on request  
+	RecoExtractor::getInfo(i);// Retrieve the info from an existing ROOTuple      
+	RecoExtractor::doAna();   // Then do the analysis on request  
 
-      ++nevent_tot; 
+	++nevent_tot; 
+      }
     }
   }
 
@@ -172,9 +185,10 @@ void RecoExtractor::getInfo(int ievent)
 void RecoExtractor::initialize() 
 {
   m_outfile  = new TFile(outFilename_.c_str(),"RECREATE");
-  m_MC       = new MCExtractor(do_MC_);
+  m_GEOM     = new ModuleGeometry();
+  m_MC       = new MCExtractor(do_MC_,do_FLAT_);
   m_STUB     = new StubExtractor(do_STUB_);
-  m_PIX      = new PixelExtractor(PIX_tag_,do_PIX_,do_MATCH_);
+  m_PIX      = new PixelExtractor(PIX_tag_,do_PIX_,do_MATCH_,do_FLAT_);
 }  
 
 // Here are the initializations when starting from already extracted stuff
@@ -208,7 +222,10 @@ void RecoExtractor::retrieve()
 void RecoExtractor::doAna() 
 {
   
-  if (do_MC_ && do_PIX_ && do_L1tt_) 
+  // In the parallel replay mode the workers have their own analysis,
+  // there is nothing to do here
+
+  if (do_MC_ && do_PIX_ && do_L1tt_ && m_L1TT_analysis) 
   {  
     m_L1TT_analysis->do_stubs(m_PIX,m_MC);
     m_L1TT_analysis->fillTree();
@@ -220,3 +237,112 @@ void RecoExtractor::doAna()
     m_TK->fillTree();
   }
 }
+
+
+//
+// Parallel replay of the L1TrackTrigger analysis (fillTree=False, n_threads>1)
+//
+// The event range is cut in nthreads_ contiguous blocks. Each worker reads 
+// its block with its own MC/Pixel extractors and analysis, and writes the 
+// L1TrackTrigger tree in a temporary file. The trees are then merged in the 
+// block order, so the output is the same as the serial one.
+//
+
+void RecoExtractor::parallelReplay(int first, int last)
+{
+  int nevts  = last-first;
+  int nwork  = min(nthreads_,max(nevts,1));
+  int start  = first;
+  int stop   = first;
+
+  std::cout << "Parallel replay of events " << first << " to " << last-1 
+	    << " with " << nwork << " threads" << std::endl;
+
+  TThread::Initialize(); // Makes ROOT aware of the threads
+
+  std::vector<std::thread> workers;
+
+  for (int k=0;k<nwork;++k) 
+  {
+    start = stop;
+    stop  = first+(nevts*(k+1))/nwork;
+
+    workers.push_back(std::thread(&RecoExtractor::replay,this,start,stop,k));
+  }
+
+  for (int k=0;k<nwork;++k) workers.at(k).join();
+
+  // Ordered merging of the worker trees
+
+  TChain *chain = new TChain("L1TrackTrigger");
+
+  for (int k=0;k<nwork;++k) chain->Add(RecoExtractor::workerFile(k).c_str());
+
+  m_outfile->cd();
+  chain->CloneTree(-1,"fast");
+
+  delete chain;
+
+  for (int k=0;k<nwork;++k) gSystem->Unlink(RecoExtractor::workerFile(k).c_str());
+}
+
+
+// Worker method, processing events first to last-1 
+
+void RecoExtractor::replay(int first, int last, int iworker)
+{
+  TFile                   *infile;
+  TFile                   *outfile;
+  MCExtractor             *mc;
+  PixelExtractor          *pix;
+  L1TrackTrigger_analysis *ana;
+
+  {
+    std::lock_guard<std::mutex> lock(m_root_lock);
+
+    infile  = TFile::Open(inFilename_.c_str());
+    outfile = new TFile(RecoExtractor::workerFile(iworker).c_str(),"RECREATE");
+
+    mc      = new MCExtractor(infile);
+    pix     = new PixelExtractor(infile);
+
+    outfile->cd(); // The L1TrackTrigger tree goes in the worker file
+    ana     = new L1TrackTrigger_analysis(m_ana_settings,evt_offset_+first);
+  }
+
+  for (int i=first;i<last;++i) 
+  {
+    if (i%10000 == 0)
+      std::cout << "Worker " << iworker << ": processing " << i << "th event" << std::endl;
+
+    mc->getInfo(i);
+    pix->getInfo(i);
+
+    ana->do_stubs(pix,mc);
+    ana->fillTree();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_root_lock);
+
+    outfile->Write();
+    outfile->Close();
+    infile->Close();
+
+    delete ana;
+    delete pix;
+    delete mc;
+
+    delete outfile;
+    delete infile;
+  }
+}
+
+
+std::string RecoExtractor::workerFile(int iworker)
+{
+  std::ostringstream name;
+  name << outFilename_ << ".worker" << iworker;
+
+  return name.str();
+}
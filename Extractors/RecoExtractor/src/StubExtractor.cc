@@ -253,8 +253,12 @@ StubExtractor::~StubExtractor()
 {}
 
 
-void StubExtractor::init(const edm::EventSetup *setup)
+void StubExtractor::init(const edm::EventSetup *setup, ModuleGeometry *geom)
 {
+  m_geom = geom;
+  m_geom->init(setup);
+  m_geom->initStacks(setup);
+
   setup->get<TrackerDigiGeometryRecord>().get(theTrackerGeometry);
   setup->get<StackedTrackerGeometryRecord>().get(theStackedTrackerGeometry);
   theStackedGeometry = theStackedTrackerGeometry.product(); 
@@ -298,6 +302,15 @@ void StubExtractor::writeInfo(const edm::Event *event, MCExtractor *mc)
   int module = 0;
   int segs   = 0;
   int rows   = 0;
+  int imod   = 0;
+
+  float avg_row = 0.;
+  float avg_col = 0.;
+
+  GlobalPoint posClu;
+  GlobalPoint posStub;
+
+  m_clus_index.clear();
   
   /// Go on only if there are L1TkCluster from PixelDigis
   if ( PixelDigiL1TkClusterHandle->size() > 0 )
@@ -326,10 +339,37 @@ void StubExtractor::writeInfo(const edm::Event *event, MCExtractor *mc)
 	//	bool combinClu = MCTruthTTClusterHandle->isCombinatoric( tempCluRef );
 
 	StackedTrackerDetId detIdClu( tempCluRef->getDetId() );
-	GlobalPoint posClu      = theStackedGeometry->findAverageGlobalPosition( &(*tempCluRef) );
 	MeasurementPoint coords = tempCluRef->findAverageLocalCoordinates();
 	int    stack            = tempCluRef->getStackMember();
 
+	// Cluster position is the average of its pixel positions, taken 
+	// from the geometry cache when the module has a constant pitch
+
+	imod = m_geom->stackIndex(detIdClu.rawId(),stack);
+
+	if (imod!=-1 && m_geom->module(imod).linear)
+	{
+	  const std::vector< Ref_PixelDigi_ > &hits = tempCluRef->getHits();
+
+	  avg_row = 0.;
+	  avg_col = 0.;
+
+	  for (unsigned int ih=0;ih<hits.size();++ih)
+	  {
+	    avg_row += hits.at(ih)->row();
+	    avg_col += hits.at(ih)->column();
+	  }
+
+	  posClu = m_geom->position(imod,avg_row/hits.size(),avg_col/hits.size());
+	}
+	else
+	{
+	  posClu = theStackedGeometry->findAverageGlobalPosition( &(*tempCluRef) );
+	}
+
+
+	if (tempCluRef.key()>=m_clus_index.size()) m_clus_index.resize(tempCluRef.key()+1,-1);
+	m_clus_index.at(tempCluRef.key()) = m_clus;
 
 	++m_clus;
 	
@@ -410,14 +450,6 @@ void StubExtractor::writeInfo(const edm::Event *event, MCExtractor *mc)
 
 	StackedTrackerDetId detIdStub( tempStubPtr->getDetId() );
       
-	// The stub position is the inner cluster position
-	//
-	// See: http://cmssw.cvs.cern.ch/cgi-bin/cmssw.cgi/CMSSW/Geometry/TrackerGeometryBuilder/interface/StackedTrackerGeometry.h?view=markup
-	//
-	GlobalPoint posStub = theStackedGeometry->findGlobalPosition( &(*tempStubPtr) );
-
-
-
 	++m_stub;
 
 	double displStub    = tempStubPtr->getTriggerDisplacement();
@@ -425,17 +457,43 @@ void StubExtractor::writeInfo(const edm::Event *event, MCExtractor *mc)
 	
 	bool genuineStub    = MCTruthTTStubHandle->isGenuine( tempStubPtr );
     
-	const GeomDetUnit* det0 = theStackedGeometry->idToDetUnit( detIdStub, 0 );
+	/// Find pixel pitch and topology related information (inner module)
+	imod = m_geom->stackIndex(detIdStub.rawId(),0);
 
-	/// Find pixel pitch and topology related information
-	const PixelGeomDetUnit* pix0 = dynamic_cast< const PixelGeomDetUnit* >( det0 );
-	const PixelTopology* top0    = dynamic_cast< const PixelTopology* >( &(pix0->specificTopology()) );
-	
-	segs = top0->ncolumns();
-	rows = top0->nrows();
+	if (imod!=-1)
+	{
+	  segs = m_geom->module(imod).ncolumns;
+	  rows = m_geom->module(imod).nrows;
+	}
+	else
+	{
+	  const GeomDetUnit* det0      = theStackedGeometry->idToDetUnit( detIdStub, 0 );
+	  const PixelGeomDetUnit* pix0 = dynamic_cast< const PixelGeomDetUnit* >( det0 );
+	  const PixelTopology* top0    = dynamic_cast< const PixelTopology* >( &(pix0->specificTopology()) );
 	
-	clust1 = StubExtractor::getClust1Idx(posStub.x(),posStub.y(),posStub.z());
-	clust2 = StubExtractor::getClust2Idx(clust1,displStub);
+	  segs = top0->ncolumns();
+	  rows = top0->nrows();
+	}
+
+	// The stub clusters are retrieved from their refs (0 is the inner one)
+	clust1 = StubExtractor::getClustIdx(tempStubPtr->getClusterRef(0));
+	clust2 = StubExtractor::getClustIdx(tempStubPtr->getClusterRef(1));
+
+	// The stub position is the inner cluster position
+	//
+	// See: http://cmssw.cvs.cern.ch/cgi-bin/cmssw.cgi/CMSSW/Geometry/TrackerGeometryBuilder/interface/StackedTrackerGeometry.h?view=markup
+	//
+	if (clust1!=-1)
+	{
+	  posStub = GlobalPoint(m_clus_x->at(clust1),m_clus_y->at(clust1),m_clus_z->at(clust1));
+	}
+	else // Not in the stored collection, use the position matching
+	{
+	  posStub = theStackedGeometry->findGlobalPosition( &(*tempStubPtr) );
+	  clust1  = StubExtractor::getClust1Idx(posStub.x(),posStub.y(),posStub.z());
+	}
+
+	if (clust2==-1) clust2 = StubExtractor::getClust2Idx(clust1,displStub);
 	
 	m_stub_x->push_back(posStub.x());
 	m_stub_y->push_back(posStub.y());
@@ -629,3 +687,12 @@ int  StubExtractor::getClust2Idx(int idx1, float dist)
 
   return idx2;
 }
+
+int  StubExtractor::getClustIdx(const edm::Ref< edmNew::DetSetVector< TTCluster< Ref_PixelDigi_ > >, TTCluster< Ref_PixelDigi_ > > &clusRef)
+{
+  if (clusRef.isNull()) return -1;
+  if (clusRef.id()!=PixelDigiL1TkClusterHandle.id()) return -1; // Not in the stored collection
+  if (clusRef.key()>=m_clus_index.size()) return -1;
+
+  return m_clus_index.at(clusRef.key());
+}
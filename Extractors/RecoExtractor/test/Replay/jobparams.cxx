@@ -0,0 +1,53 @@
+#include "jobparams.h"
+
+//tclap
+#include <tclap/CmdLine.h>
+using namespace TCLAP;
+
+jobparams::jobparams(int argc, char** argv){
+  
+
+
+   try {
+     // command line parser
+     CmdLine cmd("Command option", ' ', "0.9");
+
+     MultiArg<std::string> settings("a","analysisSettings","analysis setting, format is \"STRING VALUE\" (can be repeated)",
+				    false, "string");
+     cmd.add(settings);
+
+     ValueArg<std::string> inputfile("i","input","path and name of the extracted input file",
+				false, "extracted.root", "string");
+     cmd.add(inputfile);
+
+     ValueArg<bool> doL1TT("l","doL1TT","do the cluster/stub analysis (L1TrackTrigger tree)",
+			false, 1, "bool");
+     cmd.add(doL1TT);
+
+     ValueArg<int> nevt("n","n_events","how many events you want to analyze",
+			false, 10, "int");
+     cmd.add(nevt);
+
+     ValueArg<std::string> outfile("o","output","name of the output file",
+				false, "extracted_replay.root", "string");
+     cmd.add(outfile);
+
+     ValueArg<int> skip("s","skip_events","number of the first event (as for skip_events in cmsRun, the file is read from its first entry)",
+			false, 0, "int");
+     cmd.add(skip);
+
+     // parse
+     cmd.parse(argc, argv);
+     
+     m_inputfile    = inputfile.getValue();
+     m_outfile      = outfile.getValue();
+     m_nevt         = nevt.getValue();
+     m_skip         = skip.getValue();
+     m_doL1TT       = doL1TT.getValue();
+     m_settings     = settings.getValue();
+   }
+   catch (ArgException &e){ // catch exception from parse
+     std::cerr << "ERROR: " << e.error() << " for arg " << e.argId()  << std::endl;
+     abort();
+   }
+}
@@ -0,0 +1,70 @@
+#ifndef jobparams_H
+#define jobparams_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <tclap/CmdLine.h>
+using namespace TCLAP;
+
+class jobparams{
+
+ public:
+
+  /** constructer reading from standard arg */
+  jobparams(int argc, char** argv);
+
+  /** default constructer */
+  jobparams(){}
+
+  /** copy constructer */
+  jobparams(const jobparams& tparams); 
+
+  /** destructer */
+  ~jobparams(){}
+
+  /** return value */
+
+  bool        doL1TT() const;
+  std::string inputfile() const;
+  std::string outfile() const;
+  int         nevt() const;
+  int         skip() const;
+  std::vector<std::string> settings() const;
+
+ private:
+
+  bool         m_doL1TT;   
+  std::string  m_inputfile; 
+  std::string  m_outfile;
+  int          m_nevt;
+  int          m_skip;
+  std::vector<std::string> m_settings;
+
+};
+
+inline bool jobparams::doL1TT() const{
+  return m_doL1TT;
+}
+
+inline std::string jobparams::inputfile() const{
+  return m_inputfile;
+}
+
+inline std::string jobparams::outfile() const{
+  return m_outfile;
+}
+
+inline int jobparams::nevt() const{
+  return m_nevt;
+}
+
+inline int jobparams::skip() const{
+  return m_skip;
+}
+
+inline std::vector<std::string> jobparams::settings() const{
+  return m_settings;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+// Internal includes
+
+#include "replay.h"
+#include "jobparams.h"
+#include "TROOT.h"
+
+using namespace std;
+
+///////////////////////////////////
+//
+//
+// Standalone replay of the RecoExtractor analysis (fillTree=False), without CMSSW
+//
+// Usage example:
+//
+// ./L1TT_replay -i extracted.root -o output.root -n 1000 -s 0 -a "matchedStubs 1"
+//
+// Options are the same as in the RecoExtractor cfi:
+//
+// -i : inputRootFile
+// -o : extractedRootFile
+// -n : n_events
+// -s : skip_events
+// -l : doL1TT
+// -a : one of the analysisSettings lines (can be repeated)
+//
+///////////////////////////////////
+
+int main(int argc, char** argv) {
+
+  // Necessary lines to make branches containing vectors
+  gROOT->ProcessLine(".L Loader.C+");
+
+  // read jobParams
+  jobparams params(argc,argv);
+
+  replay* my_replay = new replay(params.inputfile(),params.outfile(),params.settings(),
+				 params.nevt(),params.skip(),params.doL1TT());
+  delete my_replay;
+
+  return 0;
+}
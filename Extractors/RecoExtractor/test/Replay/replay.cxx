@@ -0,0 +1,138 @@
+#include "replay.h"
+
+replay::replay(std::string filename, std::string outfile, std::vector<std::string> settings, 
+	       int nevt, int skip, bool doL1TT):
+  do_PIX_(false),do_MC_(false),do_TK_(false),do_L1tt_(doL1TT),
+  nevts_(nevt),skip_(skip),nevent_tot(0),
+  m_settings_(settings),
+  m_L1TT_analysis(0)
+{
+  // We parse the analysis settings
+  m_ana_settings = new AnalysisSettings(&m_settings_);
+  m_ana_settings->parseSettings();
+
+  replay::retrieve(filename,outfile);
+
+  if (!m_infile) return;
+
+  if (do_MC_ && do_PIX_ && do_L1tt_) 
+    m_L1TT_analysis = new L1TrackTrigger_analysis(m_ana_settings,skip_);
+
+  skip_=0; // Same as in RecoExtractor: skip_events only shifts the event numbering
+
+  replay::do_replay();
+}
+
+
+replay::~replay()
+{
+  std::cout << "Total # of events for this job   = "<< nevent_tot << std::endl;
+
+  if (!m_infile) return;
+
+  m_infile->Close();
+  m_outfile->Write();
+  m_outfile->Close();
+}
+
+
+//////////////////////////////////////////////
+//
+// Opening of the extracted file, and retrieval of the trees
+//
+//////////////////////////////////////////////
+
+void replay::retrieve(std::string filename, std::string outfile)
+{
+  m_infile = TFile::Open(filename.c_str());
+
+  if (!m_infile || m_infile->IsZombie())
+  {
+    std::cout << "Can't open file " << filename << ", nothing to do..." << std::endl;
+    m_infile = 0;
+    return;
+  }
+
+  m_outfile    = new TFile(outfile.c_str(),"RECREATE");
+
+  // RECO content
+
+  m_MC         = new MCExtractor(m_infile);
+  m_PIX        = new PixelExtractor(m_infile);
+  m_TK         = new TkLayout_Translator(m_infile);
+
+  // We set some variables wrt the info retrieved 
+  // (if the tree is not there, don't go further...)  
+
+  do_PIX_      = m_PIX->isOK();
+  do_MC_       = m_MC->isOK();
+  do_TK_       = m_TK->isOK();
+}
+
+
+//////////////////////////////////////////////
+//
+// The event loop (same as RecoExtractor::beginRun)
+//
+//////////////////////////////////////////////
+
+void replay::do_replay()
+{
+  int nevent = 0;
+
+  if (do_PIX_ && m_PIX->n_events()) 
+  {    
+    nevent = std::min(skip_+nevts_,m_PIX->n_events()); 
+
+    for (int i=skip_;i<nevent;++i) 
+    {
+      if (i%10000 == 0)
+	std::cout << "Processing " << i << "th event" << std::endl;
+
+      replay::getInfo(i);// Retrieve the info from the extracted ROOTuple      
+      replay::doAna();   // Then do the analysis on request  
+
+      ++nevent_tot; 
+    }
+  }
+
+  if (do_TK_ && m_TK->n_events()) 
+  {    
+    nevent = std::min(skip_+nevts_,m_TK->n_events()); 
+
+    for (int i=skip_;i<nevent;++i) 
+    {
+      if (i%100000 == 0)
+	std::cout << "Processing " << i << "th event" << std::endl;
+
+      replay::getInfo(i);
+      replay::doAna();  
+
+      ++nevent_tot; 
+    }
+  }
+}
+
+
+void replay::getInfo(int ievent) 
+{
+  if (do_MC_)       m_MC->getInfo(ievent);
+  if (do_PIX_)      m_PIX->getInfo(ievent);
+  if (do_TK_)       m_TK->getInfo(ievent);
+}
+
+
+void replay::doAna() 
+{
+  if (do_MC_ && do_PIX_ && do_L1tt_) 
+  {  
+    m_L1TT_analysis->do_stubs(m_PIX,m_MC);
+    m_L1TT_analysis->fillTree();
+  }
+
+  if (do_TK_) 
+  {  
+    m_TK->do_translation();
+    m_TK->fillTree();
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "AnalysisSettings.h"
+#include "MCExtractor.h"
+#include "PixelExtractor.h"
+#include "TkLayout_Translator.h"
+#include "L1TrackTrigger_analysis.h"
+
+using namespace std;
+
+///////////////////////////////////
+//
+//
+// Standalone replay of an extracted ROOTuple (RecoExtractor with fillTree=False)
+//
+// This class does outside CMSSW what the RecoExtractor does when starting from an 
+// already extracted file: it retrieves the MC/Pixel/TkLayout trees, runs the 
+// L1TrackTrigger analysis and the TkLayout translation, and writes the output trees.
+//
+// Input infos are :
+//
+// filename : the name and directory of the extracted ROOT file
+// outfile  : the name of the output ROOT file
+// settings : the analysis settings ("STRING VALUE", same as analysisSettings in the cfi)
+// nevt     : the number of events to process (n_events)
+// skip     : the number of events to skip (skip_events)
+// doL1TT   : run the L1TrackTrigger analysis (doL1TT)
+//
+// The event loop is the same as in RecoExtractor::beginRun, so the output is 
+// identical to the one obtained with cmsRun.
+//
+///////////////////////////////////
+
+
+
+class replay
+{
+ public:
+
+  replay(std::string filename, std::string outfile, std::vector<std::string> settings, 
+	 int nevt, int skip, bool doL1TT);
+
+  ~replay();
+
+  void  retrieve(std::string filename, std::string outfile);
+  void  do_replay();  // The main method  
+  void  getInfo(int ievent);
+  void  doAna();
+
+ private:
+
+  bool do_PIX_;
+  bool do_MC_;
+  bool do_TK_;
+  bool do_L1tt_;
+
+  int  nevts_;
+  int  skip_;
+  int  nevent_tot;
+
+  std::vector<std::string> m_settings_;
+
+  TFile *m_infile;  
+  TFile *m_outfile; 
+
+  AnalysisSettings        *m_ana_settings;
+  MCExtractor             *m_MC;
+  PixelExtractor          *m_PIX;
+  TkLayout_Translator     *m_TK;
+  L1TrackTrigger_analysis *m_L1TT_analysis;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef CBCWORD_H
+#define CBCWORD_H
+
+#include <stdint.h>
+
+///////////////////////////////////
+//
+//
+// Packed CBC words, for the concentrator pattern generation and decoding
+//
+// The data sent by a CBC are kept as they are on the link, bit j of the
+// stream being bit j%64 of word j/64:
+//
+// Trigger word (40 bits, one uint64) : up to 3 stubs of 13 bits, starting at bit 13*i
+//
+//    stub : position (8 bits) | offset (5 bits)
+//
+// Raw word (266 bits, 5 uint64) : header (12 bits) then one bit per strip (254)
+//
+// Sparsified raw data (per chip) : header (12 bits) | number of clusters (5 bits) |
+//                                  clusters (11 bits each: position (8) | width (3))
+//
+// The fields are described by constexpr descriptors (first bit in the stream,
+// number of bits). In the stream the first bit of a field is its MSB, as in
+// the text files (std::bitset output).
+//
+///////////////////////////////////
+
+struct cbc_field
+{
+  int first; // First bit (MSB) in the stream
+  int nbits; // Size (at most 64)
+};
+
+
+namespace cbc
+{
+  constexpr int NCHIPS     = 8;   // Chips per concentrator
+
+  constexpr int TRIG_BITS  = 40;
+  constexpr int NSTUBS     = 3;   // Max number of stubs in a trigger word
+  constexpr int STUB_BITS  = 13;
+
+  constexpr int RAW_BITS   = 266;
+  constexpr int RAW_NW     = (RAW_BITS+63)/64;
+  constexpr int NSTRIPS    = 254;
+
+  constexpr int CLUS_BITS  = 11;
+
+  // Field layouts
+
+  constexpr cbc_field STUB_POS    = {0,8};  // In a stub
+  constexpr cbc_field STUB_OFF    = {8,5};
+
+  constexpr cbc_field RAW_HEADER  = {0,12}; // In a raw word
+  constexpr int       RAW_STRIP0  = 12;     // Bit of strip 0 (one bit per strip, not a field)
+
+  constexpr cbc_field SPARS_HEADER = {0,12}; // In a sparsified chip block
+  constexpr cbc_field SPARS_NCLUS  = {12,5};
+  constexpr int       SPARS_CLUS   = 17;     // First cluster
+
+  constexpr cbc_field CLUS_POS    = {0,8};  // In a cluster
+  constexpr cbc_field CLUS_WIDTH  = {8,3};
+
+  static_assert(RAW_STRIP0+NSTRIPS==RAW_BITS, "CBC raw word layout");
+
+  // Field f of the block starting at bit start
+
+  constexpr cbc_field at(int start, cbc_field f) {return cbc_field{start+f.first,f.nbits};}
+
+  constexpr cbc_field stub_pos(int i) {return at(STUB_BITS*i,STUB_POS);}
+  constexpr cbc_field stub_off(int i) {return at(STUB_BITS*i,STUB_OFF);}
+
+  constexpr uint64_t mask(int nbits) {return (nbits>=64) ? ~uint64_t(0) : (uint64_t(1)<<nbits)-1;}
+
+
+  // Bit access in a packed stream
+
+  inline int  bit(const uint64_t *w, int i) {return static_cast<int>((w[i>>6]>>(i&63))&1);}
+  inline void set_bit(uint64_t *w, int i)   {w[i>>6] |= uint64_t(1)<<(i&63);}
+
+  inline uint64_t reverse(uint64_t v, int nbits) // The nbits lowest bits, in reverse order
+  {
+    v = ((v>>1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL)<<1);
+    v = ((v>>2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL)<<2);
+    v = ((v>>4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL)<<4);
+    v = ((v>>8) & 0x00FF00FF00FF00FFULL) | ((v & 0x00FF00FF00FF00FFULL)<<8);
+    v = ((v>>16) & 0x0000FFFF0000FFFFULL) | ((v & 0x0000FFFF0000FFFFULL)<<16);
+    v = (v>>32) | (v<<32);
+
+    return (nbits>0) ? v>>(64-nbits) : 0;
+  }
+
+  inline uint64_t get(const uint64_t *w, cbc_field f) // Value of field f
+  {
+    int      i = f.first>>6;
+    int      s = f.first&63;
+    uint64_t v = w[i]>>s;
+
+    if (s+f.nbits>64) v |= w[i+1]<<(64-s);
+
+    return reverse(v & mask(f.nbits),f.nbits);
+  }
+
+  inline void set(uint64_t *w, cbc_field f, uint64_t val) // Field f is set to val (truncated)
+  {
+    int      i = f.first>>6;
+    int      s = f.first&63;
+    uint64_t v = reverse(val & mask(f.nbits),f.nbits);
+
+    w[i] = (w[i] & ~(mask(f.nbits)<<s)) | (v<<s);
+
+    if (s+f.nbits>64)
+      w[i+1] = (w[i+1] & ~mask(s+f.nbits-64)) | (v>>(64-s));
+  }
+
+  // Conversion from/to the int per bit arrays (ROOT trees) and '0'/'1' strings (text files)
+
+  inline void to_bits(const uint64_t *w, int nbits, int *bits)
+  {
+    for (int i=0;i<nbits;++i) bits[i] = bit(w,i);
+  }
+
+  inline void from_bits(const int *bits, int nbits, uint64_t *w) // Nonzero is 1
+  {
+    for (int i=0;i<(nbits+63)/64;++i) w[i] = 0;
+    for (int i=0;i<nbits;++i) if (bits[i]) set_bit(w,i);
+  }
+
+  inline void from_chars(const char *c, int nbits, uint64_t *w) // Stops at the first non '0'/'1' char
+  {
+    for (int i=0;i<(nbits+63)/64;++i) w[i] = 0;
+
+    for (int i=0;i<nbits;++i)
+    {
+      if (c[i]!='0' && c[i]!='1') break;
+      if (c[i]=='1') set_bit(w,i);
+    }
+  }
+}
+
+
+// CBC trigger word
+
+class CBCTrigWord
+{
+ public:
+
+  CBCTrigWord(): m_w(0) {}
+  explicit CBCTrigWord(uint64_t w): m_w(w) {}
+
+  void clear() {m_w = 0;}
+
+  void set_stub(int i, int pos, int off)
+  {
+    cbc::set(&m_w,cbc::stub_pos(i),static_cast<uint64_t>(pos));
+    cbc::set(&m_w,cbc::stub_off(i),static_cast<uint64_t>(off));
+  }
+
+  int  stub_pos(int i) const {return static_cast<int>(cbc::get(&m_w,cbc::stub_pos(i)));}
+  int  stub_off(int i) const {return static_cast<int>(cbc::get(&m_w,cbc::stub_off(i)));}
+  int  bit(int i) const      {return cbc::bit(&m_w,i);}
+
+  uint64_t word() const {return m_w;}
+
+  void to_bits(int *bits) const      {cbc::to_bits(&m_w,cbc::TRIG_BITS,bits);}
+  void from_chars(const char *c)     {cbc::from_chars(c,cbc::TRIG_BITS,&m_w);}
+
+ private:
+
+  uint64_t m_w;
+};
+
+
+// CBC raw (unsparsified) word
+
+class CBCRawWord
+{
+ public:
+
+  CBCRawWord() {CBCRawWord::clear();}
+  explicit CBCRawWord(const uint64_t *w) {for (int i=0;i<cbc::RAW_NW;++i) m_w[i] = w[i];}
+
+  void clear() {for (int i=0;i<cbc::RAW_NW;++i) m_w[i] = 0;}
+
+  void set_header(int val) {cbc::set(m_w,cbc::RAW_HEADER,static_cast<uint64_t>(val));}
+  int  header() const      {return static_cast<int>(cbc::get(m_w,cbc::RAW_HEADER));}
+
+  void set_strip(int s) // Strips out of range are ignored
+  {
+    if (s>=0 && s<cbc::NSTRIPS) cbc::set_bit(m_w,cbc::RAW_STRIP0+s);
+  }
+
+  int  strip(int s) const {return cbc::bit(m_w,cbc::RAW_STRIP0+s);}
+  int  bit(int i) const   {return cbc::bit(m_w,i);}
+
+  const uint64_t *words() const {return m_w;}
+
+  void to_bits(int *bits) const {cbc::to_bits(m_w,cbc::RAW_BITS,bits);}
+
+ private:
+
+  uint64_t m_w[cbc::RAW_NW];
+};
+
+#endif
@@ -0,0 +1,89 @@
+// Class for the input trees tuning
+// For more info, look at the header file
+
+#include "ChainReader.h"
+
+#include "TChainElement.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include "TList.h"
+#include "TEnv.h"
+
+
+int ChainReader::optimize(TTree *tree, Long64_t cachesize)
+{
+  if (!tree) return 0;
+
+  std::vector<std::string> names;
+
+  ChainReader::bound_branches(tree,names);
+
+  // Nothing bound: the tree is used in another way, all the branches are kept
+
+  if (names.size()!=0)
+  {
+    tree->SetBranchStatus("*",0);
+
+    for (unsigned int i=0;i<names.size();++i)
+      tree->SetBranchStatus(names.at(i).c_str(),1);
+  }
+
+  if (cachesize>0)
+  {
+    tree->SetCacheSize(cachesize);
+    tree->SetCacheLearnEntries(LEARN_ENTRIES);
+  }
+
+  return static_cast<int>(names.size());
+}
+
+
+void ChainReader::enablePrefetch()
+{
+  gEnv->SetValue("TFile.AsyncPrefetching",1);
+
+  std::cout << "Asynchronous prefetching of the input files enabled" << std::endl;
+}
+
+
+// The chain keeps one element per branch given to SetBranchAddress/SetBranchStatus
+// (applied to each file when it is loaded), a tree has the addresses in its branches
+
+void ChainReader::bound_branches(TTree *tree, std::vector<std::string> &names)
+{
+  names.clear();
+
+  TChain *chain = dynamic_cast<TChain*>(tree);
+
+  if (chain)
+  {
+    TList *status = chain->GetStatus();
+
+    if (!status) return;
+
+    TIter next(status);
+    TChainElement *el;
+
+    while ((el=static_cast<TChainElement*>(next())))
+    {
+      if (std::string(el->GetName())=="*") continue;
+      if (el->GetBaddress()==0 && el->GetStatus()!=1) continue;
+
+      names.push_back(el->GetName());
+    }
+
+    return;
+  }
+
+  TObjArray *branches = tree->GetListOfBranches();
+
+  if (!branches) return;
+
+  TBranch *br;
+
+  for (int i=0;i<branches->GetEntriesFast();++i)
+  {
+    br = static_cast<TBranch*>(branches->At(i));
+    if (br && br->GetAddress()) names.push_back(br->GetName());
+  }
+}
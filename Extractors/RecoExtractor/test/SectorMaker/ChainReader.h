@@ -0,0 +1,48 @@
+#ifndef CHAINREADER_H
+#define CHAINREADER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "TTree.h"
+#include "TChain.h"
+
+///////////////////////////////////
+//
+//
+// Input tuning for the trees/chains read by the SectorMaker tools
+//
+// optimize(tree) has to be called once all the branch addresses are set
+// (SetBranchAddress or FlatBranch::setAddress). It:
+//
+// -> disables all the branches except the ones with an address (or explicitly
+//    enabled), so that GetEntry only reads and unzips what is used
+// -> enables a TTreeCache of cachesize bytes (0 for none). The cache learns
+//    the branches actually read during the first LEARN_ENTRIES entries, then
+//    reads their baskets in a few large requests
+//
+// For a TChain, the status and addresses are kept by the chain, and given
+// to each file when it is opened.
+//
+// enablePrefetch() switches on the asynchronous prefetching of the cached
+// baskets (option --prefetch). It has to be called before any input file is opened.
+//
+///////////////////////////////////
+
+class ChainReader
+{
+ public:
+
+  static const Long64_t CACHE_SIZE    = 30000000; // 30MB
+  static const int      LEARN_ENTRIES = 100;
+
+  static int  optimize(TTree *tree, Long64_t cachesize=CACHE_SIZE); // Number of branches kept
+  static void enablePrefetch();
+
+ private:
+
+  static void bound_branches(TTree *tree, std::vector<std::string> &names);
+};
+
+#endif
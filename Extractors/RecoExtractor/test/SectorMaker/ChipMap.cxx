@@ -0,0 +1,73 @@
+// Chip ID -> list of values map
+// For more info, look at the header file
+
+#include "ChipMap.h"
+
+ChipMap::ChipMap()
+{
+  m_size = 0;
+  m_table.assign(64,-1);
+  m_chips.clear();
+  m_lists.clear();
+}
+
+int ChipMap::slot(int chip) const
+{
+  unsigned int mask = m_table.size()-1;
+  unsigned int s    = (static_cast<unsigned int>(chip)*2654435761u) & mask;
+
+  while (m_table[s]>=0 && m_chips[m_table[s]]!=chip) s = (s+1) & mask;
+
+  return static_cast<int>(s);
+}
+
+std::vector<int> &ChipMap::add(int chip)
+{
+  int s = ChipMap::slot(chip);
+
+  if (m_table[s]>=0) return m_lists[m_table[s]];
+
+  // New chip (the table is kept at most half full)
+
+  if (2*(m_size+1)>static_cast<int>(m_table.size())) 
+  {
+    ChipMap::rehash(2*m_table.size());
+    s = ChipMap::slot(chip);
+  }
+
+  m_table[s] = m_size;
+
+  if (m_size<static_cast<int>(m_chips.size()))
+  {
+    m_chips[m_size] = chip;
+  }
+  else
+  {
+    m_chips.push_back(chip);
+    m_lists.push_back(std::vector<int>());
+  }
+
+  return m_lists[m_size++];
+}
+
+const std::vector<int> *ChipMap::find(int chip) const
+{
+  int s = ChipMap::slot(chip);
+
+  return (m_table[s]>=0) ? &m_lists[m_table[s]] : 0;
+}
+
+void ChipMap::rehash(int nslots)
+{
+  m_table.assign(nslots,-1);
+
+  for (int i=0;i<m_size;++i) m_table[ChipMap::slot(m_chips[i])] = i;
+}
+
+void ChipMap::clear()
+{
+  for (int i=0;i<m_size;++i) m_lists[i].clear();
+
+  m_table.assign(m_table.size(),-1);
+  m_size = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef CHIPMAP_H
+#define CHIPMAP_H
+
+#include <vector>
+
+///////////////////////////////////
+//
+//
+// Chip ID -> list of values (digi strips, stub strip/bend pairs,...), for one event
+//
+// The chips are kept in an open addressing hash table (linear probing), and
+// each chip has its own list, so adding a value to a chip is just a push_back.
+// The chips are numbered in the order they are first seen, which is also the 
+// iteration order (chip(i)/list(i), i=0 to size()-1): the result doesn't
+// depend on the hash.
+//
+// clear() keeps the lists memory, so the same map can be refilled for each
+// event without new allocations.
+//
+///////////////////////////////////
+
+class ChipMap
+{
+ public:
+
+  ChipMap();
+
+  std::vector<int>       &add(int chip);         // List of chip, created if needed
+  const std::vector<int> *find(int chip) const;  // List of chip (0 if not there)
+
+  int  size() const {return m_size;}
+  int  chip(int i) const {return m_chips.at(i);}
+  const std::vector<int> &list(int i) const {return m_lists.at(i);}
+
+  void clear();
+
+ private:
+
+  int  slot(int chip) const; // Slot of chip in the table, or the empty slot where it would go
+  void rehash(int nslots);
+
+  std::vector<int>               m_table; // Slot -> chip number (-1 if empty), size is a power of 2
+  std::vector<int>               m_chips; // Chip number -> chip ID
+  std::vector<std::vector<int> > m_lists; // Chip number -> list (only the first m_size are used)
+
+  int m_size;
+};
+
+#endif
@@ -0,0 +1,221 @@
+// Binary CBC stream writer and reader
+// For more info, look at the header file
+
+#include "ConcStream.h"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char CONC_MAGIC[8] = {'C','O','N','C','B','I','N','1'};
+
+
+ConcWriter::ConcWriter()
+{
+  m_out = 0;
+  m_pos = 0;
+  m_ok  = true;
+}
+
+ConcWriter::~ConcWriter()
+{
+  ConcWriter::close();
+}
+
+bool ConcWriter::open(std::string filename)
+{
+  ConcWriter::close();
+
+  m_out = fopen(filename.c_str(),"wb");
+
+  if (!m_out)
+  {
+    std::cout << "Can't open the binary stream file " << filename << std::endl;
+    return false;
+  }
+
+  m_name = filename;
+  m_index.clear();
+
+  // The header is written again at the end, with the number of frames
+
+  conc_file_header h;
+
+  memset(&h,0,sizeof(h));
+  m_ok  = (fwrite(&h,sizeof(h),1,m_out)==1);
+  m_pos = sizeof(h);
+
+  return true;
+}
+
+void ConcWriter::write_frame(const conc_frame_header &h, const uint64_t *trig, const uint64_t *raw)
+{
+  if (!m_out) return;
+
+  conc_frame_header fh = h;
+
+  (raw) ? fh.flags |= RAW_WORDS : fh.flags &= ~RAW_WORDS;
+
+  m_index.push_back(m_pos);
+
+  m_ok = m_ok && (fwrite(&fh,sizeof(fh),1,m_out)==1);
+  m_ok = m_ok && (fwrite(trig,sizeof(uint64_t),NCHIPS,m_out)==static_cast<size_t>(NCHIPS));
+  m_pos += sizeof(fh)+NCHIPS*sizeof(uint64_t);
+
+  if (!raw) return;
+
+  m_ok = m_ok && (fwrite(raw,sizeof(uint64_t),NCHIPS*RAW_NW,m_out)==static_cast<size_t>(NCHIPS*RAW_NW));
+  m_pos += NCHIPS*RAW_NW*sizeof(uint64_t);
+}
+
+void ConcWriter::close()
+{
+  if (!m_out) return;
+
+  conc_file_header h;
+
+  memset(&h,0,sizeof(h));
+  memcpy(h.magic,CONC_MAGIC,8);
+  h.version   = VERSION;
+  h.nchips    = NCHIPS;
+  h.trig_bits = TRIG_BITS;
+  h.raw_bits  = RAW_BITS;
+  h.nframes   = m_index.size();
+  h.index_pos = m_pos;
+
+  bool ok = m_ok; // The frames were all written?
+
+  for (unsigned int i=0;i<m_index.size();++i)
+  {
+    uint64_t pos = m_index.at(i);
+    ok = ok && (fwrite(&pos,sizeof(pos),1,m_out)==1);
+  }
+
+  ok = ok && (fseek(m_out,0,SEEK_SET)==0);
+  ok = ok && (fwrite(&h,sizeof(h),1,m_out)==1);
+  ok = (fclose(m_out)==0) && ok;
+
+  if (!ok) std::cout << "Problem while writing the binary stream file " << m_name << std::endl;
+
+  m_out = 0;
+  m_index.clear();
+}
+
+
+ConcReader::ConcReader()
+{
+  m_map     = 0;
+  m_maplen  = 0;
+  m_nframes = 0;
+  m_index   = 0;
+}
+
+ConcReader::~ConcReader()
+{
+  ConcReader::close();
+}
+
+bool ConcReader::open(std::string filename)
+{
+  ConcReader::close();
+
+  int fd = ::open(filename.c_str(),O_RDONLY);
+
+  if (fd<0)
+  {
+    std::cout << "Can't open the binary stream file " << filename << std::endl;
+    return false;
+  }
+
+  struct stat st;
+
+  if (fstat(fd,&st)!=0 || st.st_size<static_cast<off_t>(sizeof(conc_file_header)))
+  {
+    ::close(fd);
+    std::cout << filename << " is not a binary stream file" << std::endl;
+    return false;
+  }
+
+  void *map = mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  ::close(fd);
+
+  if (map==MAP_FAILED) return false;
+
+  m_map    = static_cast<const char*>(map);
+  m_maplen = st.st_size;
+
+  const conc_file_header *h = reinterpret_cast<const conc_file_header*>(m_map);
+
+  long long size = st.st_size;
+
+  bool ok = (memcmp(h->magic,CONC_MAGIC,8)==0);
+
+  ok = ok && h->version==ConcWriter::VERSION && h->nchips==ConcWriter::NCHIPS;
+  ok = ok && h->trig_bits==ConcWriter::TRIG_BITS && h->raw_bits==ConcWriter::RAW_BITS;
+  ok = ok && h->nframes>=0 && h->index_pos%8==0;
+  ok = ok && h->index_pos+8*h->nframes==size;
+
+  if (!ok)
+  {
+    std::cout << filename << " is not a valid binary stream file (version " 
+	      << ConcWriter::VERSION << ")" << std::endl;
+    ConcReader::close();
+    return false;
+  }
+
+  m_nframes = h->nframes;
+  m_index   = reinterpret_cast<const uint64_t*>(m_map+h->index_pos);
+
+  // Check that all the frames are in the file
+
+  long long len;
+
+  for (long long i=0;i<m_nframes;++i)
+  {
+    len = sizeof(conc_frame_header)+ConcWriter::NCHIPS*sizeof(uint64_t);
+
+    if (static_cast<long long>(m_index[i])+len<=h->index_pos && 
+	(ConcReader::header(i)->flags & ConcWriter::RAW_WORDS))
+      len += ConcWriter::NCHIPS*ConcWriter::RAW_NW*sizeof(uint64_t);
+
+    if (m_index[i]%8!=0 || static_cast<long long>(m_index[i])+len>h->index_pos)
+    {
+      std::cout << "Frame " << i << " of " << filename << " is corrupted" << std::endl;
+      ConcReader::close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void ConcReader::close()
+{
+  if (m_map) munmap(const_cast<char*>(m_map),m_maplen);
+
+  m_map     = 0;
+  m_maplen  = 0;
+  m_nframes = 0;
+  m_index   = 0;
+}
+
+const conc_frame_header *ConcReader::header(long long i) const
+{
+  return reinterpret_cast<const conc_frame_header*>(m_map+m_index[i]);
+}
+
+const uint64_t *ConcReader::trig(long long i) const
+{
+  return reinterpret_cast<const uint64_t*>(m_map+m_index[i]+sizeof(conc_frame_header));
+}
+
+const uint64_t *ConcReader::raw(long long i) const
+{
+  if (!(ConcReader::header(i)->flags & ConcWriter::RAW_WORDS)) return 0;
+
+  return ConcReader::trig(i)+ConcWriter::NCHIPS;
+}
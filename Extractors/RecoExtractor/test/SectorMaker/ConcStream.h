@@ -0,0 +1,113 @@
+#ifndef CONCSTREAM_H
+#define CONCSTREAM_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "CBCWord.h"
+
+///////////////////////////////////
+//
+//
+// Binary format for the CBC data sent to the concentrator (one frame per BX)
+//
+// This is the same content as the text file written by patterngen, one bit
+// per bit instead of one character per bit:
+//
+// File header (conc_file_header), then the frames, then the index table
+// (nframes uint64, the position of each frame in the file).
+//
+// Frame : conc_frame_header
+//         trigger words (NCHIPS uint64, CBCTrigWord)
+//         raw words     (only if the frame is an L1A (flag RAW_WORDS), NCHIPS*RAW_NW 
+//                        uint64, CBCRawWord)
+//
+// The raw fragments sent at each BX (8 bits per chip) are not stored, they are
+// the bits 8*raw_rank to 8*raw_rank+7 of the raw words of the last L1A.
+//
+// ConcWriter writes a file, ConcReader maps it in memory (mmap) and gives a direct
+// access to any frame, without copy.
+//
+///////////////////////////////////
+
+struct conc_file_header
+{
+  char      magic[8];     // CONCBIN1
+  int       version;
+  int       nchips;
+  int       trig_bits;
+  int       raw_bits;
+  long long nframes;
+  long long index_pos;    // Position of the index table
+};
+
+struct conc_frame_header
+{
+  int      bx;        // BX number
+  int      train;     // 8 BX train number
+  int      trg_evt;   // Entry used for the trigger data
+  int      raw_evt;   // Entry used for the raw data being sent
+  int      raw_bx;    // BX of the L1A being sent
+  int      raw_rank;  // Raw fragment sent at this BX (BX-raw_bx)
+  uint32_t trig_mask; // Chips with trigger data
+  uint32_t flags;     
+};
+
+
+class ConcWriter
+{
+ public:
+
+  ConcWriter();
+  ~ConcWriter();
+
+  static const int VERSION   = 1;
+  static const int NCHIPS    = cbc::NCHIPS;
+  static const int TRIG_BITS = cbc::TRIG_BITS;
+  static const int RAW_BITS  = cbc::RAW_BITS;
+  static const int RAW_NW    = cbc::RAW_NW; // uint64 per chip raw word
+
+  static const uint32_t RAW_WORDS = 1; // Frame flag: the raw words are stored
+
+  bool open(std::string filename);
+  void write_frame(const conc_frame_header &h, const uint64_t *trig, const uint64_t *raw);
+  void close();
+
+ private:
+
+  FILE                    *m_out;
+  std::string              m_name;
+  std::vector<long long>   m_index;
+  long long                m_pos;
+  bool                     m_ok;    // False after a failed write (reported by close())
+};
+
+
+class ConcReader
+{
+ public:
+
+  ConcReader();
+  ~ConcReader();
+
+  bool open(std::string filename); // False if the file is not in the right format
+  void close();
+
+  long long nframes() const {return m_nframes;}
+
+  const conc_frame_header *header(long long i) const;
+  const uint64_t          *trig(long long i) const; // NCHIPS words
+  const uint64_t          *raw(long long i) const;  // NCHIPS*RAW_NW words, 0 if no L1A
+
+ private:
+
+  const char      *m_map;
+  size_t           m_maplen;
+  long long        m_nframes;
+  const uint64_t  *m_index;
+};
+
+#endif
@@ -0,0 +1,58 @@
+// Grouping of objects by key
+// For more info, look at the header file
+
+#include "KeyIndex.h"
+
+KeyIndex::KeyIndex()
+{
+  m_dense.clear();
+  m_hash.clear();
+  m_keys.clear();
+}
+
+int KeyIndex::add(int key)
+{
+  int idx = static_cast<int>(m_keys.size());
+
+  if (key>=0 && key<MAX_DENSE)
+  {
+    if (key>=static_cast<int>(m_dense.size())) 
+      m_dense.resize(std::min(2*key+1,static_cast<int>(MAX_DENSE)),-1);
+
+    if (m_dense[key]<0)
+    {
+      m_dense[key] = idx;
+      m_keys.push_back(key);
+    }
+
+    return m_dense[key];
+  }
+
+  std::pair<std::unordered_map<int,int>::iterator,bool> ins = m_hash.insert(std::make_pair(key,idx));
+
+  if (ins.second) m_keys.push_back(key);
+
+  return ins.first->second;
+}
+
+int KeyIndex::index(int key) const
+{
+  if (key>=0 && key<MAX_DENSE)
+    return (key<static_cast<int>(m_dense.size())) ? m_dense[key] : -1;
+
+  std::unordered_map<int,int>::const_iterator it = m_hash.find(key);
+
+  return (it==m_hash.end()) ? -1 : it->second;
+}
+
+void KeyIndex::clear()
+{
+  for (unsigned int i=0;i<m_keys.size();++i) 
+  {
+    if (m_keys.at(i)>=0 && m_keys.at(i)<MAX_DENSE) m_dense[m_keys.at(i)] = -1;
+  }
+
+  if (!m_hash.empty()) m_hash.clear();
+
+  m_keys.clear();
+}
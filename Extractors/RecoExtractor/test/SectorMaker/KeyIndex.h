@@ -0,0 +1,44 @@
+#ifndef KEYINDEX_H
+#define KEYINDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+///////////////////////////////////
+//
+//
+// Grouping of objects by an integer key (TP index, event ID, module ID,...)
+//
+// Each key is given a dense index (0 to size()-1), in the order the keys are
+// added, so that the objects of a group can be stored in plain vectors indexed
+// by the group index. The lookup is a direct table access for the keys in 
+// [0,MAX_DENSE[ (the table grows with the largest key seen), and a hash map for
+// the other ones. clear() only resets the keys used, so the same index can be 
+// reused for each event at no cost.
+//
+///////////////////////////////////
+
+class KeyIndex
+{
+ public:
+
+  KeyIndex();
+
+  static const int MAX_DENSE = 1000000;
+
+  int  add(int key);          // Index of key, created if needed
+  int  index(int key) const;  // Index of key (-1 if unknown)
+  int  key(int idx) const {return m_keys.at(idx);}
+  int  size() const {return static_cast<int>(m_keys.size());}
+
+  void clear();
+
+ private:
+
+  std::vector<int>             m_dense; // key -> index (-1 if not there), for 0<=key<MAX_DENSE
+  std::unordered_map<int,int>  m_hash;  // key -> index, for the other keys
+  std::vector<int>             m_keys;  // index -> key
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Eta/phi index of the module areas
+// For more info, look at the header file
+
+#include "ModuleGrid.h"
+
+ModuleGrid::ModuleGrid(const std::vector<float> &etamin, const std::vector<float> &etamax,
+		       const std::vector<float> &phimin, const std::vector<float> &phimax,
+		       int neta, int nphi)
+{
+  int nmod = static_cast<int>(etamin.size());
+
+  m_neta = (neta>0) ? neta : 1;
+  m_nphi = (nphi>0) ? nphi : 1;
+
+  // The grid covers the module eta range, and [-PI,PI] in phi. Values outside
+  // are put in the edge cells (for the modules and the sectors)
+
+  float low  = 0.;
+  float high = 0.;
+  bool  first= true;
+
+  for (int i=0;i<nmod;++i)
+  {
+    if (!std::isfinite(etamin[i]) || !std::isfinite(etamax[i])) continue;
+    if (etamax[i]<etamin[i]) continue;
+
+    if (first || etamin[i]<low)  low  = etamin[i];
+    if (first || etamax[i]>high) high = etamax[i];
+    first = false;
+  }
+
+  m_eta_low  = low;
+  m_eta_step = (high>low) ? (high-low)/m_neta : 1.;
+  m_phi_low  = -4.*atan(1.);
+  m_phi_step = 8.*atan(1.)/m_nphi;
+
+  m_cells.resize(m_neta*m_nphi);
+  m_always.clear();
+
+  for (int i=0;i<nmod;++i)
+  {
+    if (!std::isfinite(etamin[i]) || !std::isfinite(etamax[i]) ||
+	!std::isfinite(phimin[i]) || !std::isfinite(phimax[i]) ||
+	etamax[i]<etamin[i] || phimax[i]<phimin[i])
+    {
+      m_always.push_back(i);
+      continue;
+    }
+
+    for (int ie=ModuleGrid::eta_bin(etamin[i]);ie<=ModuleGrid::eta_bin(etamax[i]);++ie)
+    {
+      for (int ip=ModuleGrid::phi_bin(phimin[i]);ip<=ModuleGrid::phi_bin(phimax[i]);++ip)
+	m_cells[ie*m_nphi+ip].push_back(i);
+    }
+  }
+}
+
+
+void ModuleGrid::candidates(float eta_min, float eta_max, float phi_min, float phi_max,
+			    std::vector<int> &list) const
+{
+  list = m_always;
+
+  if (!(eta_min<=eta_max)) return;
+
+  int ie_min = ModuleGrid::eta_bin(eta_min);
+  int ie_max = ModuleGrid::eta_bin(eta_max);
+
+  if (phi_min<=phi_max)
+  {
+    ModuleGrid::add_cells(ie_min,ie_max,ModuleGrid::phi_bin(phi_min),ModuleGrid::phi_bin(phi_max),list);
+  }
+  else // The sector is at the PI/-PI transition
+  {
+    ModuleGrid::add_cells(ie_min,ie_max,ModuleGrid::phi_bin(phi_min),m_nphi-1,list);
+    ModuleGrid::add_cells(ie_min,ie_max,0,ModuleGrid::phi_bin(phi_max),list);
+  }
+
+  std::sort(list.begin(),list.end());
+  list.erase(std::unique(list.begin(),list.end()),list.end());
+}
+
+
+void ModuleGrid::add_cells(int ieta_min, int ieta_max, int iphi_min, int iphi_max, 
+			   std::vector<int> &list) const
+{
+  for (int ie=ieta_min;ie<=ieta_max;++ie)
+  {
+    for (int ip=iphi_min;ip<=iphi_max;++ip)
+    {
+      const std::vector<int> &cell = m_cells[ie*m_nphi+ip];
+      list.insert(list.end(),cell.begin(),cell.end());
+    }
+  }
+}
+
+
+int ModuleGrid::eta_bin(float eta) const
+{
+  if (!(eta>m_eta_low)) return 0; 
+
+  float bin = (eta-m_eta_low)/m_eta_step;
+
+  return (bin<m_neta) ? static_cast<int>(bin) : m_neta-1;
+}
+
+
+int ModuleGrid::phi_bin(float phi) const
+{
+  if (!(phi>m_phi_low)) return 0; 
+
+  float bin = (phi-m_phi_low)/m_phi_step;
+
+  return (bin<m_nphi) ? static_cast<int>(bin) : m_nphi-1;
+}
@@ -0,0 +1,59 @@
+#ifndef MODULEGRID_H
+#define MODULEGRID_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+///////////////////////////////////
+//
+//
+// Eta/phi index of the module areas, used to find quickly the modules which 
+// may be in a sector
+//
+// The (eta,phi) plane is cut in cells, and each module is registered in all 
+// the cells its [etamin,etamax]x[phimin,phimax] area touches. candidates() 
+// returns the modules registered in the cells touched by the sector, which 
+// includes all the modules overlapping the sector. The exact test (sector 
+// coverage) is then only done on those.
+//
+// Sectors at the PI/-PI transition (phimin>phimax) are cut in two phi ranges.
+// Modules at the PI/-PI transition, or with odd eta/phi bounds, are always 
+// returned as candidates.
+//
+// The module numbers are the dense indices given to the constructor (see ModuleIndex.h)
+//
+///////////////////////////////////
+
+class ModuleGrid
+{
+ public:
+
+  ModuleGrid(const std::vector<float> &etamin, const std::vector<float> &etamax,
+	     const std::vector<float> &phimin, const std::vector<float> &phimax,
+	     int neta=50, int nphi=64);
+
+  // The modules which may overlap the sector, sorted by index
+
+  void candidates(float eta_min, float eta_max, float phi_min, float phi_max,
+		  std::vector<int> &list) const;
+
+ private:
+
+  int  eta_bin(float eta) const;
+  int  phi_bin(float phi) const;
+  void add_cells(int ieta_min, int ieta_max, int iphi_min, int iphi_max, 
+		 std::vector<int> &list) const;
+
+  int   m_neta;
+  int   m_nphi;
+  float m_eta_low;
+  float m_eta_step;
+  float m_phi_low;
+  float m_phi_step;
+
+  std::vector< std::vector<int> > m_cells;  // Cell ieta*m_nphi+iphi -> modules
+  std::vector<int>                m_always; // Modules which are always candidates
+};
+
+#endif
@@ -0,0 +1,54 @@
+// Dictionary of the tracker modules
+// For more info, look at the header file
+
+#include "ModuleIndex.h"
+
+ModuleIndex::ModuleIndex()
+{
+  m_index.assign(MAX_CODE,-1);
+  m_codes.clear();
+}
+
+int ModuleIndex::add(int code)
+{
+  if (code<0 || code>=MAX_CODE) return -1;
+
+  if (m_index[code]<0)
+  {
+    m_index[code] = static_cast<int>(m_codes.size());
+    m_codes.push_back(code);
+  }
+
+  return m_index[code];
+}
+
+int ModuleIndex::index(int code) const
+{
+  if (code<0 || code>=MAX_CODE) return -1;
+
+  return m_index[code];
+}
+
+void ModuleIndex::sort(std::vector<int> &perm)
+{
+  std::vector<int> codes = m_codes;
+
+  std::sort(codes.begin(),codes.end());
+
+  perm.clear();
+
+  for (unsigned int i=0;i<codes.size();++i)
+  {
+    perm.push_back(m_index[codes.at(i)]);
+    m_index[codes.at(i)] = i;
+  }
+
+  m_codes = codes;
+}
+
+void ModuleIndex::clear()
+{
+  for (unsigned int i=0;i<m_codes.size();++i) m_index[m_codes.at(i)] = -1;
+
+  m_codes.clear();
+}
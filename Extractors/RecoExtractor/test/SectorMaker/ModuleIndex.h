@@ -0,0 +1,51 @@
+#ifndef MODULEINDEX_H
+#define MODULEINDEX_H
+
+#include <vector>
+#include <algorithm>
+
+///////////////////////////////////
+//
+//
+// Dictionary of the tracker modules seen in the data
+//
+// The modules are identified by their global code:
+//
+// code = layer*10000 + ladder*100 + module (layers 5 to 10 for the barrel, 11 to 24 for the disks)
+//
+// which is also B_id+50000 (barrel) or E_id+110000 (endcap) with the conventions 
+// used in the other classes. Each code is given a dense index (0 to size()-1), in 
+// the order the modules are added, so that the per-module tables only contain 
+// the modules really present, instead of the 58000/142000 slots of the ID space.
+//
+// sort() renumbers the modules by increasing code (barrel first, then endcap)
+//
+///////////////////////////////////
+
+class ModuleIndex
+{
+ public:
+
+  ModuleIndex();
+
+  static const int MAX_CODE = 250000;
+
+  static int barrelCode(int B_id) {return B_id+50000;}
+  static int endcapCode(int E_id) {return E_id+110000;}
+  static bool isBarrel(int code)  {return code<110000;}
+
+  int  add(int code);          // Index of code, created if needed (-1 if it's not a valid code)
+  int  index(int code) const;  // Index of code (-1 if unknown)
+  int  code(int idx) const {return m_codes.at(idx);}
+  int  size() const {return static_cast<int>(m_codes.size());}
+
+  void sort(std::vector<int> &perm); // perm[new index] = old index
+  void clear();
+
+ private:
+
+  std::vector<int> m_index; // code -> index (-1 if not there)
+  std::vector<int> m_codes; // index -> code
+};
+
+#endif
@@ -0,0 +1,352 @@
+// Class for the module to sectors map
+// For more info, look at the header file
+
+#include "SectorMap.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// Header of the cache file, followed by the offsets (NMOD+1 ints) and the values (nval ints)
+
+struct secmap_header
+{
+  char      magic[8];
+  long long csv_size;
+  long long csv_mtime; // In ns
+  int       nmod;
+  int       nsec;
+  long long nval;
+};
+
+static const char SECMAP_MAGIC[8] = {'S','E','C','M','A','P','0','3'};
+
+
+SectorMap::SectorMap()
+{
+  m_nsec    = 0;
+  m_offsets = 0;
+  m_values  = 0;
+  m_map     = 0;
+  m_maplen  = 0;
+}
+
+SectorMap::~SectorMap()
+{
+  SectorMap::unmap();
+}
+
+
+IntSpan SectorMap::sectors(int code) const
+{
+  if (!m_offsets || code<0 || code>=NMOD) return IntSpan();
+
+  return IntSpan(m_values+m_offsets[code],m_values+m_offsets[code+1]);
+}
+
+
+bool SectorMap::read(std::string csvfile)
+{
+  struct stat st;
+
+  SectorMap::unmap();
+
+  if (stat(csvfile.c_str(),&st)!=0)
+  {
+    std::cout << "Please provide a valid csv sector filename" << std::endl;
+    return false;
+  }
+
+  std::string cachefile = csvfile+".secmap";
+
+  // Modification time with the ns, so that a file rewritten in the same second is seen
+
+  long long mtime = 1000000000LL*st.st_mtim.tv_sec+st.st_mtim.tv_nsec;
+
+  if (SectorMap::load(cachefile,st.st_size,mtime))
+  {
+    std::cout << "Sector map read from " << cachefile << std::endl;
+    return true;
+  }
+
+  if (!SectorMap::parse(csvfile)) return false;
+
+  SectorMap::save(cachefile,st.st_size,mtime);
+
+  return true;
+}
+
+
+void SectorMap::build(const std::vector< std::vector<int> > &sectors)
+{
+  SectorMap::unmap();
+
+  m_nsec = static_cast<int>(sectors.size());
+
+  // Counting sort by module code (the sectors of a module stay in increasing order)
+
+  m_offsets_v.assign(NMOD+1,0);
+
+  int code;
+
+  for (int k=0;k<m_nsec;++k)
+  {
+    for (unsigned int i=0;i<sectors.at(k).size();++i)
+    {
+      code = sectors.at(k).at(i);
+
+      if (code<0 || code>=NMOD)
+      {
+	std::cout << "Module " << code << " in sector " << k
+		  << " is out of range, skipped" << std::endl;
+	continue;
+      }
+
+      ++m_offsets_v[code+1];
+    }
+  }
+
+  for (int i=0;i<NMOD;++i) m_offsets_v[i+1] += m_offsets_v[i];
+
+  m_values_v.assign(m_offsets_v[NMOD],0);
+
+  std::vector<int> pos(m_offsets_v.begin(),m_offsets_v.end()-1);
+
+  for (int k=0;k<m_nsec;++k)
+  {
+    for (unsigned int i=0;i<sectors.at(k).size();++i)
+    {
+      code = sectors.at(k).at(i);
+      if (code>=0 && code<NMOD) m_values_v[pos[code]++] = k;
+    }
+  }
+
+  m_offsets = &m_offsets_v[0];
+  m_values  = (m_values_v.empty()) ? m_offsets : &m_values_v[0];
+}
+
+
+// CSV parsing. The line and field splitting follow what getline was doing in
+// sector_test::convert: an empty line has no field, and a final ',' doesn't
+// make an empty field. The line after the last '\n' is also counted.
+
+static int field_int(const char *p, const char *end) // atoi on [p,end[
+{
+  int  val = 0;
+  bool neg = false;
+
+  while (p<end && (*p==' ' || *p=='\t' || *p=='\r' || *p=='\v' || *p=='\f')) ++p;
+
+  if (p<end && (*p=='-' || *p=='+'))
+  {
+    neg = (*p=='-');
+    ++p;
+  }
+
+  while (p<end && *p>='0' && *p<='9')
+  {
+    val = 10*val+(*p-'0');
+    ++p;
+  }
+
+  return (neg) ? -val : val;
+}
+
+bool SectorMap::parse(std::string csvfile)
+{
+  std::ifstream in(csvfile.c_str(),std::ios::binary);
+  if (!in)
+  {
+    std::cout << "Please provide a valid csv sector filename" << std::endl;
+    return false;
+  }
+
+  std::ostringstream buf;
+  buf << in.rdbuf();
+  in.close();
+
+  const std::string data = buf.str();
+  const char *p   = data.c_str();
+  const char *end = p+data.size();
+
+  std::vector<int> codes; // (code,sector) pairs, in the file order
+  std::vector<int> secs;
+
+  const char *eol;
+  const char *eof;
+  int  nlines = 0;
+  int  npar;
+  int  code;
+
+  while (true)
+  {
+    eol = static_cast<const char*>(memchr(p,'\n',end-p));
+    if (!eol) eol = end;
+
+    ++nlines;
+    npar = 0;
+
+    while (p<eol)
+    {
+      eof = static_cast<const char*>(memchr(p,',',eol-p));
+      if (!eof) eof = eol;
+
+      ++npar;
+
+      if (npar>2)
+      {
+	code = field_int(p,eof);
+
+	if (code<0 || code>=NMOD)
+	{
+	  std::cout << "Module " << code << " in sector " << nlines-2
+		    << " is out of range, skipped" << std::endl;
+	}
+	else
+	{
+	  codes.push_back(code);
+	  secs.push_back(nlines-2);
+	}
+      }
+
+      p = (eof<eol) ? eof+1 : eol;
+    }
+
+    if (eol==end) break;
+    p = eol+1;
+  }
+
+  m_nsec = nlines-3;
+
+  // Counting sort by module code (stable, so the sectors stay in the file order)
+
+  m_offsets_v.assign(NMOD+1,0);
+  m_values_v.assign(codes.size(),0);
+
+  for (unsigned int i=0;i<codes.size();++i) ++m_offsets_v[codes[i]+1];
+  for (int i=0;i<NMOD;++i) m_offsets_v[i+1] += m_offsets_v[i];
+
+  std::vector<int> pos(m_offsets_v.begin(),m_offsets_v.end()-1);
+
+  for (unsigned int i=0;i<codes.size();++i) m_values_v[pos[codes[i]]++] = secs[i];
+
+  m_offsets = &m_offsets_v[0];
+  m_values  = (m_values_v.empty()) ? m_offsets : &m_values_v[0];
+
+  return true;
+}
+
+
+// Use the cache file if it was made from the same CSV file
+
+bool SectorMap::load(std::string cachefile, long long size, long long mtime)
+{
+  int fd = open(cachefile.c_str(),O_RDONLY);
+  if (fd<0) return false;
+
+  struct stat st;
+  if (fstat(fd,&st)!=0 || st.st_size<static_cast<off_t>(sizeof(secmap_header)))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(0,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+
+  if (map==MAP_FAILED) return false;
+
+  const secmap_header *h = static_cast<const secmap_header*>(map);
+
+  long long len = sizeof(secmap_header)+4LL*(NMOD+1+h->nval);
+
+  if (memcmp(h->magic,SECMAP_MAGIC,8)!=0 || h->csv_size!=size || h->csv_mtime!=mtime ||
+      h->nmod!=NMOD || h->nval<0 || len!=static_cast<long long>(st.st_size))
+  {
+    munmap(map,st.st_size);
+    return false;
+  }
+
+  // The offsets have to be valid, otherwise sectors() would read out of the map
+
+  const int *offsets = reinterpret_cast<const int*>(h+1);
+  bool ok = (offsets[0]==0 && offsets[NMOD]==h->nval);
+
+  for (int i=0;ok && i<NMOD;++i) ok = (offsets[i]<=offsets[i+1]);
+
+  if (!ok)
+  {
+    std::cout << "Sector map cache " << cachefile << " is damaged, not used" << std::endl;
+    munmap(map,st.st_size);
+    return false;
+  }
+
+  m_map     = map;
+  m_maplen  = st.st_size;
+  m_nsec    = h->nsec;
+  m_offsets = offsets;
+  m_values  = m_offsets+NMOD+1;
+
+  return true;
+}
+
+
+// The cache is written in a temporary file, then renamed, so that jobs
+// running at the same time never see a partial file
+
+void SectorMap::save(std::string cachefile, long long size, long long mtime) const
+{
+  secmap_header h;
+
+  memcpy(h.magic,SECMAP_MAGIC,8);
+  h.csv_size  = size;
+  h.csv_mtime = mtime;
+  h.nmod      = NMOD;
+  h.nsec      = m_nsec;
+  h.nval      = m_offsets[NMOD];
+
+  std::ostringstream tmp;
+  tmp << cachefile << ".tmp" << getpid();
+
+  FILE *out = fopen(tmp.str().c_str(),"wb");
+
+  if (!out)
+  {
+    std::cout << "Can't write the sector map cache " << cachefile << std::endl;
+    return;
+  }
+
+  bool ok = (fwrite(&h,sizeof(h),1,out)==1);
+  ok = ok && (fwrite(m_offsets,4,NMOD+1,out)==static_cast<size_t>(NMOD+1));
+  ok = ok && (h.nval==0 || fwrite(m_values,4,h.nval,out)==static_cast<size_t>(h.nval));
+  ok = (fclose(out)==0) && ok;
+
+  if (!ok || rename(tmp.str().c_str(),cachefile.c_str())!=0)
+  {
+    std::cout << "Can't write the sector map cache " << cachefile << std::endl;
+    remove(tmp.str().c_str());
+  }
+}
+
+
+void SectorMap::unmap()
+{
+  if (m_map) munmap(m_map,m_maplen);
+
+  m_map     = 0;
+  m_maplen  = 0;
+  m_nsec    = 0;
+  m_offsets = 0;
+  m_values  = 0;
+
+  m_offsets_v.clear();
+  m_values_v.clear();
+}
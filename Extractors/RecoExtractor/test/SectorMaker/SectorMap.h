@@ -0,0 +1,70 @@
+#ifndef SECTORMAP_H
+#define SECTORMAP_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "FlatBranch.h"  // For IntSpan
+#include "ModuleIndex.h" // For MAX_CODE
+
+///////////////////////////////////
+//
+//
+// Module to sectors map, made from the TkLayout CSV sector file
+//
+// The CSV file contains one line per sector, with the codes of the modules
+// in the sector (from the third field). This class makes the opposite: the
+// list of sectors containing each module code (0 to NMOD-1, see ModuleIndex.h
+// for the coding), in CSR form:
+//
+// sectors of module code : values[offsets[code]] to values[offsets[code+1]-1]
+//
+// The lines are numbered as in sector_test::convert, the first one being
+// sector -1 (header), and the sectors of a module are in the file order.
+//
+// Reading the CSV is slow, so the map is also saved in a binary cache file
+// (CSVNAME.secmap), which is used directly (mmap) by the next jobs, as long as the
+// CSV file size and modification time (in ns) are the same. If the cache can't be
+// written (read-only directory,...) the map is just kept in memory.
+//
+// The map can also be built from sector lists made in the same job (see
+// sector::layout()), sector i being the i-th list.
+//
+///////////////////////////////////
+
+class SectorMap
+{
+ public:
+
+  SectorMap();
+  ~SectorMap();
+
+  static const int NMOD = ModuleIndex::MAX_CODE;
+
+  bool read(std::string csvfile); // False if the CSV file can't be read
+  void build(const std::vector< std::vector<int> > &sectors); // From the module codes of each sector
+
+  int     nsec() const {return m_nsec;}
+  IntSpan sectors(int code) const; // Empty if code is out of range
+
+ private:
+
+  bool parse(std::string csvfile);
+  bool load(std::string cachefile, long long size, long long mtime);
+  void save(std::string cachefile, long long size, long long mtime) const;
+  void unmap();
+
+  int   m_nsec;     // As sector_test::m_sec_mult
+
+  const int *m_offsets; // NMOD+1 values
+  const int *m_values;
+
+  std::vector<int> m_offsets_v; // Storage when the map is not mmapped
+  std::vector<int> m_values_v;
+
+  void  *m_map;     // mmapped cache
+  size_t m_maplen;
+};
+
+#endif
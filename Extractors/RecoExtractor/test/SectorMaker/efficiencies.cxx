@@ -2,6 +2,7 @@
 // For more info, look at the header file
 
 #include "efficiencies.h"
+#include <algorithm>
 
 // Main constructor
 
@@ -40,10 +41,12 @@ void efficiencies::get_efficiencies()
   float i_eta;
 
   int evtID;
-  std::vector<int> stID;
+  IntSpan stID;
 
-  std::vector<int> pix_evtID;
-  std::vector<int> pix_stID;
+  IntSpan pix_evtID;
+
+  int l,g;
+  std::vector<int> tp_digis;
 
   int hit_on_lay[20];
   int stub_on_lay_pri[20];
@@ -77,10 +80,17 @@ void efficiencies::get_efficiencies()
     // 
     // Efficiencies are then simply N_object/N_digis
 
-    MC->GetEntry(j,1); // Get the MC info
-    Pix->GetEntry(j,1);
-    L1TT_O->GetEntry(j,1);
-    L1TT_P->GetEntry(j,1);
+    MC->GetEntry(j); // Get the MC info (only the enabled branches, see initTuple)
+    Pix->GetEntry(j);
+    L1TT_O->GetEntry(j);
+    L1TT_P->GetEntry(j);
+
+    // The event indexes, so that each TP only looks at its own digis, and
+    // each digi only at the clusters close to it
+
+    efficiencies::index_digis();
+    efficiencies::index_clusters(false);
+    efficiencies::index_clusters(true);
 
     // This code is for cluster/stub efficiency calculation
     //
@@ -104,7 +114,7 @@ void efficiencies::get_efficiencies()
 
 
       evtID = m_part_evtId->at(k);
-      stID  = m_part_stId->at(k);
+      stID  = m_part_stId_branch.row(k);
 
       for (int i=0;i<20;++i)
       {
@@ -125,47 +135,48 @@ void efficiencies::get_efficiencies()
 
       i_eta = m_part_eta->at(k);
 
-      for (int l=0;l<m_pclus;++l) // Loop over TP digis
-      {	
-	if (m_pixclus_layer->at(l)<5) continue; // Don't care about pixel hits
+      // The digis containing one of the TP sim hits (in the digi order)
 
-	pix_evtID = m_pixclus_evtID->at(l);
+      tp_digis.clear();
 
-	inTP=false;
+      for (int ll=0;ll<stID.size();++ll) 
+      {	
+	g = m_digi_keys.index(stID[ll]);
+	if (g<0) continue;
 
-	for (unsigned int ll=0;ll<pix_evtID.size();++ll) 
+	for (int m=m_digi_off[g];m<m_digi_off[g+1];++m)
 	{
-	  if (inTP) break;
+	  if (m_digi_stamp[m_digi_list[m]]==k) continue; // Already there
+	  m_digi_stamp[m_digi_list[m]]=k;
 
-	  if (m_dbg)
-	    cout << l << "/" << evtID << "/" << pix_evtID.at(ll) << endl; 
-
-	  if (pix_evtID.at(ll) == evtID) inTP=true;
+	  tp_digis.push_back(m_digi_list[m]);
 	}
+      }
 
-	if (!inTP) continue;
+      std::sort(tp_digis.begin(),tp_digis.end());
 
-	if (m_dbg) cout << "In the same evt ID" << endl;
-	
-	inTP=false;
-	pix_stID = m_pixclus_simhitID->at(l);
+      for (unsigned int m=0;m<tp_digis.size();++m) // Loop over TP digis
+      {	
+	l = tp_digis[m];
 
-	//	cout << pix_stID.size() << "/" << stID.size() << endl;
+	pix_evtID = m_pixclus_evtID_branch.row(l);
+
+	inTP=false;
 
-	for (unsigned int ll=0;ll<pix_stID.size();++ll) 
+	for (int ll=0;ll<pix_evtID.size();++ll) 
 	{
 	  if (inTP) break;
 
-	  for (unsigned int lll=0;lll<stID.size();++lll) 
-	  {
-	    //	    cout << pix_stID.at(ll) << "/" << stID.at(lll) << endl; 
+	  if (m_dbg)
+	    cout << l << "/" << evtID << "/" << pix_evtID.at(ll) << endl; 
 
-	    if (pix_stID.at(ll) == stID.at(lll)) inTP=true;
-	  }
+	  if (pix_evtID.at(ll) == evtID) inTP=true;
 	}
 
 	if (!inTP) continue;
 
+	if (m_dbg) cout << "In the same evt ID" << endl;
+
 	// This pixel digi comes from the TP 
 	
 	i_lay = m_pixclus_layer->at(l);
@@ -196,23 +207,12 @@ void efficiencies::get_efficiencies()
 	
 	// We have the digis, now look at the clusters
 
-	// Private tool first
-	for (int i=0;i<m_clus;++i)
-	{
-	  if (clus_i!=-1) break;
-	  if (m_clus_nstrips->at(i)>4) continue;
-	  if (m_clus_layer->at(i)!=i_lay) continue;
-	  if (m_clus_module->at(i)!=i_mod+1) continue;	
-	  if (m_clus_seg->at(i)!=i_seg) continue;
-	  if (m_clus_ladder->at(i)!=m_pixclus_ladder->at(l)) continue;
-	  if (fabs(m_clus_strip->at(i)-m_pixclus_row->at(pix_i))>m_clus_nstrips->at(i)) continue;
-
-	  if (m_dbg)
-	  {
-	    cout << "   Cand CLUS " << i << " / " << m_clus_strip->at(i) << " / " << m_pixclus_row->at(pix_i)  << " / " << m_clus_nstrips->at(i) << endl;	
-	  }
+	// Private tool first (first matching cluster)
+	clus_i = efficiencies::match_cluster(false,l,false);
 
-	  clus_i = i;
+	if (clus_i!=-1 && m_dbg)
+	{
+	  cout << "   Cand CLUS " << clus_i << " / " << m_clus_strip->at(clus_i) << " / " << m_pixclus_row->at(pix_i)  << " / " << m_clus_nstrips->at(clus_i) << endl;	
 	}
 
 	if (clus_i!=-1) 
@@ -226,14 +226,7 @@ void efficiencies::get_efficiencies()
 	  if (fabs(i_eta)<2.5 && PTGEN>10) clus_pri_eta[i_lay-5][static_cast<int>(25+10*i_eta)]+=1;  
 	  
 	  // We have the clusters, now look at the stubs
-	  for (int i=0;i<m_stub;++i)
-	  {
-	    if (stub_i!=-1) break;
-	    //if (m_stub_tp->at(i)!=k) continue;
-	    if (m_stub_layer->at(i)!=i_lay) continue;
-	    if (m_stub_clust1->at(i)==clus_i) stub_i = i;
-	    if (m_stub_clust2->at(i)==clus_i) stub_i = i; 
-	  }
+	  stub_i = efficiencies::match_stub(false,clus_i,i_lay);
 	  
 	  if (stub_i!=-1) 
 	  {
@@ -253,18 +246,8 @@ void efficiencies::get_efficiencies()
 	clus_i = -1; //
 	stub_i = -1; //
 	
-	// Then the official one
-	for (int i=0;i<m_tkclus;++i)
-	{
-
-	  if (m_tkclus_nstrips->at(i)>4) continue;
-	  if (m_tkclus_layer->at(i)!=i_lay) continue;
-	  if (m_tkclus_module->at(i)!=i_mod+1) continue;	
-	  if (m_tkclus_seg->at(i)!=i_seg) continue;
-	  if (m_tkclus_ladder->at(i)!=m_pixclus_ladder->at(l)) continue;
-	  if (fabs(m_tkclus_strip->at(i)-m_pixclus_row->at(pix_i))>m_tkclus_nstrips->at(i)) continue;
-	  clus_i = i;
-	}
+	// Then the official one (last matching cluster)
+	clus_i = efficiencies::match_cluster(true,l,true);
 
 	if (clus_i!=-1) 
 	{
@@ -272,14 +255,7 @@ void efficiencies::get_efficiencies()
 	  if (fabs(i_eta)<2.5 && PTGEN>10) clus_off_eta[i_lay-5][static_cast<int>(25+10*i_eta)]+=1;  
 
 	  // We have the clusters, now look at the stubs
-	  for (int i=0;i<m_tkstub;++i)
-	  {
-	    if (stub_i!=-1) break;
-	    //	    if (m_tkstub_tp->at(i)!=k) continue;
-	    if (m_tkstub_layer->at(i)!=i_lay) continue;
-	    if (m_tkstub_clust1->at(i)==clus_i) stub_i = i;
-	    if (m_tkstub_clust2->at(i)==clus_i) stub_i = i;
-	  }
+	  stub_i = efficiencies::match_stub(true,clus_i,i_lay);
 
 	  if (stub_i!=-1) 
 	  {
@@ -367,6 +343,175 @@ void efficiencies::get_efficiencies()
 }
 
 
+// Index of the digis (layers 5 and above) per sim hit ID 
+
+void efficiencies::index_digis()
+{
+  IntSpan pix_stID;
+
+  int g;
+
+  m_digi_keys.clear();
+  m_digi_pairs.clear();
+  m_digi_stamp.assign(m_pclus,-1);
+
+  for (int l=0;l<m_pclus;++l)
+  {
+    if (m_pixclus_layer->at(l)<5) continue; // Don't care about pixel hits
+
+    pix_stID = m_pixclus_simhitID_branch.row(l);
+
+    for (int ll=0;ll<pix_stID.size();++ll) 
+    {
+      m_digi_pairs.push_back(m_digi_keys.add(pix_stID[ll]));
+      m_digi_pairs.push_back(l);
+    }
+  }
+
+  m_digi_off.assign(m_digi_keys.size()+1,0);
+  m_digi_list.resize(m_digi_pairs.size()/2);
+
+  for (unsigned int i=0;i<m_digi_pairs.size();i+=2) ++m_digi_off[m_digi_pairs[i]+1];
+  for (int i=0;i<m_digi_keys.size();++i) m_digi_off[i+1] += m_digi_off[i];
+
+  std::vector<int> pos(m_digi_off.begin(),m_digi_off.end()-1);
+
+  for (unsigned int i=0;i<m_digi_pairs.size();i+=2) 
+  {
+    g = m_digi_pairs[i];
+    m_digi_list[pos[g]++] = m_digi_pairs[i+1];
+  }
+}
+
+
+// Index of the clusters of one producer (only the ones with at most 4 strips
+// can be matched), and of the stubs using each cluster
+
+void efficiencies::index_clusters(bool off)
+{
+  eff_index &idx = (off) ? m_off_idx : m_pri_idx;
+
+  int nclus = (off) ? m_tkclus : m_clus;
+  int nstub = (off) ? m_tkstub : m_stub;
+
+  const std::vector<int>   &c_nstrips = (off) ? *m_tkclus_nstrips : *m_clus_nstrips;
+  const std::vector<int>   &c_layer   = (off) ? *m_tkclus_layer   : *m_clus_layer;
+  const std::vector<int>   &c_ladder  = (off) ? *m_tkclus_ladder  : *m_clus_ladder;
+  const std::vector<int>   &c_module  = (off) ? *m_tkclus_module  : *m_clus_module;
+  const std::vector<int>   &c_seg     = (off) ? *m_tkclus_seg     : *m_clus_seg;
+  const std::vector<float> &c_strip   = (off) ? *m_tkclus_strip   : *m_clus_strip;
+
+  const std::vector<int>   &s_clust1  = (off) ? *m_tkstub_clust1  : *m_stub_clust1;
+  const std::vector<int>   &s_clust2  = (off) ? *m_tkstub_clust2  : *m_stub_clust2;
+
+  idx.clus.clear();
+
+  for (int i=0;i<nclus;++i)
+  {
+    if (c_nstrips.at(i)>4) continue;
+    idx.clus.push_back(i);
+  }
+
+  std::sort(idx.clus.begin(),idx.clus.end(),[&](int a,int b)
+  {
+    if (c_layer[a]!=c_layer[b])   return c_layer[a]<c_layer[b];
+    if (c_ladder[a]!=c_ladder[b]) return c_ladder[a]<c_ladder[b];
+    if (c_module[a]!=c_module[b]) return c_module[a]<c_module[b];
+    if (c_seg[a]!=c_seg[b])       return c_seg[a]<c_seg[b];
+    if (c_strip[a]!=c_strip[b])   return c_strip[a]<c_strip[b];
+    return a<b;
+  });
+
+  // Reverse links (a stub using twice the same cluster is there twice)
+
+  idx.stub_off.assign(nclus+1,0);
+
+  for (int i=0;i<nstub;++i)
+  {
+    if (s_clust1.at(i)>=0 && s_clust1.at(i)<nclus) ++idx.stub_off[s_clust1.at(i)+1];
+    if (s_clust2.at(i)>=0 && s_clust2.at(i)<nclus) ++idx.stub_off[s_clust2.at(i)+1];
+  }
+
+  for (int i=0;i<nclus;++i) idx.stub_off[i+1] += idx.stub_off[i];
+
+  idx.stubs.resize(idx.stub_off[nclus]);
+
+  std::vector<int> pos(idx.stub_off.begin(),idx.stub_off.end()-1);
+
+  for (int i=0;i<nstub;++i)
+  {
+    if (s_clust1.at(i)>=0 && s_clust1.at(i)<nclus) idx.stubs[pos[s_clust1.at(i)]++] = i;
+    if (s_clust2.at(i)>=0 && s_clust2.at(i)<nclus) idx.stubs[pos[s_clust2.at(i)]++] = i;
+  }
+}
+
+
+// The cluster matched to digi l is in the same module/segment, and its strip is 
+// at most nstrips (<=4) away from the digi row. The private tool takes the first 
+// cluster in the list (last=false), the official one the last one (last=true)
+
+int efficiencies::match_cluster(bool off,int l,bool last)
+{
+  const eff_index &idx = (off) ? m_off_idx : m_pri_idx;
+
+  const std::vector<int>   &c_nstrips = (off) ? *m_tkclus_nstrips : *m_clus_nstrips;
+  const std::vector<int>   &c_layer   = (off) ? *m_tkclus_layer   : *m_clus_layer;
+  const std::vector<int>   &c_ladder  = (off) ? *m_tkclus_ladder  : *m_clus_ladder;
+  const std::vector<int>   &c_module  = (off) ? *m_tkclus_module  : *m_clus_module;
+  const std::vector<int>   &c_seg     = (off) ? *m_tkclus_seg     : *m_clus_seg;
+  const std::vector<float> &c_strip   = (off) ? *m_tkclus_strip   : *m_clus_strip;
+
+  int lay = m_pixclus_layer->at(l);
+  int lad = m_pixclus_ladder->at(l);
+  int mod = m_pixclus_module->at(l);
+  int seg = m_pixclus_column->at(l);
+  int row = m_pixclus_row->at(l);
+
+  // First cluster of the module/segment with strip>=row-5
+
+  std::vector<int>::const_iterator it = std::lower_bound(idx.clus.begin(),idx.clus.end(),0,[&](int a,int)
+  {
+    if (c_layer[a]!=lay)  return c_layer[a]<lay;
+    if (c_ladder[a]!=lad) return c_ladder[a]<lad;
+    if (c_module[a]!=mod) return c_module[a]<mod;
+    if (c_seg[a]!=seg)    return c_seg[a]<seg;
+    return c_strip[a]<row-5;
+  });
+
+  int clus_i = -1;
+  int i;
+
+  for (;it!=idx.clus.end();++it)
+  {
+    i = *it;
+
+    if (c_layer[i]!=lay || c_ladder[i]!=lad || c_module[i]!=mod || c_seg[i]!=seg) break;
+    if (c_strip[i]>row+5) break;
+
+    if (fabs(c_strip[i]-row)>c_nstrips[i]) continue;
+
+    if (clus_i==-1 || (last && i>clus_i) || (!last && i<clus_i)) clus_i = i;
+  }
+
+  return clus_i;
+}
+
+
+int efficiencies::match_stub(bool off,int clus,int lay)
+{
+  const eff_index &idx = (off) ? m_off_idx : m_pri_idx;
+
+  const std::vector<int> &s_layer = (off) ? *m_tkstub_layer : *m_stub_layer;
+
+  for (int i=idx.stub_off[clus];i<idx.stub_off[clus+1];++i)
+  {
+    if (s_layer.at(idx.stubs[i])==lay) return idx.stubs[i];
+  }
+
+  return -1;
+}
+
+
 void efficiencies::initVars()
 {
 
@@ -516,63 +661,6 @@ void efficiencies::initTuple(std::string in,std::string out)
   m_tkstub_tp      = new  std::vector<int>; 
 
 
-  Pix->SetBranchStatus("*",0);
-  MC->SetBranchStatus("*",0);
-  L1TT_O->SetBranchStatus("*",0);
-  L1TT_P->SetBranchStatus("*",0);
-
-  Pix->SetBranchStatus("PIX_n",1);
-  Pix->SetBranchStatus("PIX_layer",1);   
-  Pix->SetBranchStatus("PIX_module",1);  
-  Pix->SetBranchStatus("PIX_ladder",1);  
-  Pix->SetBranchStatus("PIX_x",1);       
-  Pix->SetBranchStatus("PIX_y",1);       
-  Pix->SetBranchStatus("PIX_row",1);     
-  Pix->SetBranchStatus("PIX_column",1);  
-  Pix->SetBranchStatus("PIX_simhitID",1);     
-  Pix->SetBranchStatus("PIX_evtID",1); 
-
-  //  MC->SetBranchStatus("subpart_nhit",1); 
-  MC->SetBranchStatus("subpart_n",1);    
-  MC->SetBranchStatus("subpart_x",1);    
-  MC->SetBranchStatus("subpart_y",1);    
-  MC->SetBranchStatus("subpart_px",1);   
-  MC->SetBranchStatus("subpart_py",1);   
-  MC->SetBranchStatus("subpart_eta",1);
-  MC->SetBranchStatus("subpart_pdgId",1);  
-  MC->SetBranchStatus("subpart_evtId",1); 
-  MC->SetBranchStatus("subpart_stId",1); 
-
-  L1TT_P->SetBranchStatus("CLUS_n",1);         
-  L1TT_P->SetBranchStatus("CLUS_layer",1);     
-  L1TT_P->SetBranchStatus("CLUS_module",1);    
-  L1TT_P->SetBranchStatus("CLUS_ladder",1);    
-  L1TT_P->SetBranchStatus("CLUS_seg",1);       
-  L1TT_P->SetBranchStatus("CLUS_strip",1);     
-  L1TT_P->SetBranchStatus("CLUS_nstrip",1);    
-
-  L1TT_P->SetBranchStatus("STUB_n",1);         
-  L1TT_P->SetBranchStatus("STUB_layer",1);     
-  L1TT_P->SetBranchStatus("STUB_ladder",1);    
-  L1TT_P->SetBranchStatus("STUB_tp",1);        
-  L1TT_P->SetBranchStatus("STUB_clust1",1);     
-  L1TT_P->SetBranchStatus("STUB_clust2",1);     
- 
-  L1TT_O->SetBranchStatus("L1TkSTUB_n",1);      
-  L1TT_O->SetBranchStatus("L1TkSTUB_layer",1);  
-  L1TT_O->SetBranchStatus("L1TkSTUB_ladder",1); 
-  L1TT_O->SetBranchStatus("L1TkSTUB_tp",1);     
-  L1TT_O->SetBranchStatus("L1TkSTUB_clust1",1); 
-  L1TT_O->SetBranchStatus("L1TkSTUB_clust2",1); 
-
-  L1TT_O->SetBranchStatus("L1TkCLUS_n",1);      
-  L1TT_O->SetBranchStatus("L1TkCLUS_layer",1);  
-  L1TT_O->SetBranchStatus("L1TkCLUS_module",1); 
-  L1TT_O->SetBranchStatus("L1TkCLUS_ladder",1); 
-  L1TT_O->SetBranchStatus("L1TkCLUS_seg",1);    
-  L1TT_O->SetBranchStatus("L1TkCLUS_strip",1);  
-  L1TT_O->SetBranchStatus("L1TkCLUS_nstrip",1); 
-  
   Pix->SetBranchAddress("PIX_n",         &m_pclus);
   Pix->SetBranchAddress("PIX_layer",     &m_pixclus_layer);
   Pix->SetBranchAddress("PIX_module",    &m_pixclus_module);
@@ -581,8 +669,8 @@ void efficiencies::initTuple(std::string in,std::string out)
   Pix->SetBranchAddress("PIX_y",         &m_pixclus_y);
   Pix->SetBranchAddress("PIX_row",       &m_pixclus_row);
   Pix->SetBranchAddress("PIX_column",    &m_pixclus_column);  
-  Pix->SetBranchAddress("PIX_simhitID",  &m_pixclus_simhitID);
-  Pix->SetBranchAddress("PIX_evtID",     &m_pixclus_evtID);
+  m_pixclus_simhitID_branch.setAddress(Pix,"PIX_simhitID",m_pixclus_simhitID); // Also sets the branch status
+  m_pixclus_evtID_branch.setAddress(Pix,"PIX_evtID",m_pixclus_evtID);
 
   MC->SetBranchAddress("subpart_n",        &m_part_n);    
   MC->SetBranchAddress("subpart_x",        &m_part_x);    
@@ -591,7 +679,7 @@ void efficiencies::initTuple(std::string in,std::string out)
   MC->SetBranchAddress("subpart_py",       &m_part_py);   
   MC->SetBranchAddress("subpart_eta",      &m_part_eta);  
   MC->SetBranchAddress("subpart_pdgId",    &m_part_pdg);  
-  MC->SetBranchAddress("subpart_stId",    &m_part_stId);
+  m_part_stId_branch.setAddress(MC,"subpart_stId",m_part_stId);
   MC->SetBranchAddress("subpart_evtId",    &m_part_evtId);
 
   L1TT_P->SetBranchAddress("CLUS_n",             &m_clus);
@@ -623,7 +711,13 @@ void efficiencies::initTuple(std::string in,std::string out)
   L1TT_O->SetBranchAddress("L1TkCLUS_seg",       &m_tkclus_seg);
   L1TT_O->SetBranchAddress("L1TkCLUS_strip",     &m_tkclus_strip);
   L1TT_O->SetBranchAddress("L1TkCLUS_nstrip",    &m_tkclus_nstrips);
-  
+
+  // Only the branches above are read
+
+  ChainReader::optimize(Pix);
+  ChainReader::optimize(MC);
+  ChainReader::optimize(L1TT_P);
+  ChainReader::optimize(L1TT_O);
 
   m_outfile  = new TFile(out.c_str(),"recreate");
   m_tree     = new TTree("Efficiencies","Efficiencies info");
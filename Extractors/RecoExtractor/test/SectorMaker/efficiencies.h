@@ -14,6 +14,9 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TChain.h"
+#include "FlatBranch.h"
+#include "KeyIndex.h"
+#include "ChainReader.h"
 
 #include <fstream>
 #include <string>
@@ -49,6 +52,16 @@ using namespace std;
 
 
 
+// Per event index of the clusters and stubs of one producer (private or official)
+
+struct eff_index
+{
+  std::vector<int> clus;     // Clusters with at most 4 strips, sorted by (layer,ladder,module,seg,strip)
+  std::vector<int> stub_off; // Cluster -> stubs using it (CSR, stubs in increasing order)
+  std::vector<int> stubs;
+};
+
+
 class efficiencies
 {
  public:
@@ -60,6 +73,11 @@ class efficiencies
   void  reset();
   void  initTuple(std::string in,std::string out);
 
+  void  index_digis();                        // Digis per sim hit ID
+  void  index_clusters(bool off);             // Clusters and stubs (private or official)
+  int   match_cluster(bool off,int l,bool last); // Cluster of digi l (first or last match), -1 if none
+  int   match_stub(bool off,int clus,int lay);   // First stub using cluster clus in layer lay, -1 if none
+
  private:
 
   TChain *L1TT_O;      // The trees 
@@ -124,6 +142,9 @@ class efficiencies
   std::vector< std::vector<int> > *m_pixclus_simhitID; 
   std::vector< std::vector<int> > *m_pixclus_evtID; 
 
+  FlatBranch m_pixclus_simhitID_branch; // PIX_simhitID, nested or flat layout
+  FlatBranch m_pixclus_evtID_branch;    // PIX_evtID, nested or flat layout
+
   std::vector<int>    *m_part_hits;
   std::vector<int>    *m_part_pdg;
   std::vector<float>  *m_part_px;
@@ -134,6 +155,19 @@ class efficiencies
   std::vector<int>    *m_part_evtId;//
   std::vector< std::vector<int> > *m_part_stId;// 
 
+  FlatBranch m_part_stId_branch;        // subpart_stId, nested or flat layout
+
+  // Per event indexes
+
+  KeyIndex         m_digi_keys;  // Sim hit ID -> group
+  std::vector<int> m_digi_off;   // Group -> digis (CSR, digis in increasing order)
+  std::vector<int> m_digi_list;
+  std::vector<int> m_digi_pairs; // (group,digi) pairs, in the digi order
+  std::vector<int> m_digi_stamp; // Last TP for which the digi was taken
+
+  eff_index        m_pri_idx;    // Private clusters/stubs
+  eff_index        m_off_idx;    // Official clusters/stubs
+
   std::vector<int>    *m_clus_nstrips;
   std::vector<int>    *m_clus_layer; 
   std::vector<int>    *m_clus_module;								       
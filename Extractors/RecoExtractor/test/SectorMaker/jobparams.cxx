@@ -20,7 +20,7 @@ jobparams::jobparams(int argc, char** argv){
 			  false, 0, "int");
      cmd.add(ophi);
 
-     ValueArg<std::string> option("c","case","type of analysis (rates/sectors/rate_n_sec/sec_n_test/stub_eff/PR_eff)",
+     ValueArg<std::string> option("c","case","type of analysis (rates/sectors/rate_n_sec/sec_n_test/stub_eff/PR_eff/optimize/pipeline)",
 				false, "rates", "string");
      cmd.add(option);
 
@@ -44,6 +44,14 @@ jobparams::jobparams(int argc, char** argv){
 				false, "/scratch/viret/data.root", "string");
      cmd.add(inputfile);
 
+     ValueArg<int> nthreads("j","threads","number of threads for the rates event loop, the sector scan and the pattern reordering",
+			false, 1, "int");
+     cmd.add(nthreads);
+
+     ValueArg<std::string> keep("k","keep","prefix of the intermediate files written by rate_n_sec/pipeline (none if empty)",
+				false, "", "string");
+     cmd.add(keep);
+
      ValueArg<int> nevt("n","nevt","number of events for the eff test?",
 			false, 0, "int");
      cmd.add(nevt);
@@ -67,6 +75,10 @@ jobparams::jobparams(int argc, char** argv){
 			  false, 13, "int");
      cmd.add(type);
 
+     ValueArg<bool> prefetch("w","prefetch","asynchronous prefetching of the input ROOT files or not",
+			     false, 0, "bool");
+     cmd.add(prefetch);
+
      // parse
      cmd.parse(argc, argv);
      
@@ -74,6 +86,7 @@ jobparams::jobparams(int argc, char** argv){
      m_outfile      = outfile.getValue();
      m_testfile     = testfile.getValue();
      m_pattfile     = pattfile.getValue();
+     m_keep         = keep.getValue();
      m_opt          = option.getValue();
      m_eta          = eta.getValue();
      m_phi          = phi.getValue();
@@ -81,8 +94,10 @@ jobparams::jobparams(int argc, char** argv){
      m_ophi         = ophi.getValue();
      m_nevt         = nevt.getValue();
      m_dbg          = dbg.getValue();
+     m_prefetch     = prefetch.getValue();
      m_rate         = rate.getValue();
      m_type         = type.getValue();
+     m_nthreads     = nthreads.getValue();
    }
    catch (ArgException &e){ // catch exception from parse
      std::cerr << "ERROR: " << e.error() << " for arg " << e.argId()  << std::endl;
@@ -25,11 +25,13 @@ class jobparams{
   /** return value */
 
   bool        dbg() const;
+  bool        prefetch() const;
   std::string option() const;
   std::string inputfile() const;
   std::string testfile() const;
   std::string outfile() const;
   std::string pattfile() const;
+  std::string keep() const;
   int         eta() const;
   int         phi() const;
   int         oeta() const;
@@ -37,15 +39,18 @@ class jobparams{
   int         nevt() const;
   int         rate() const;
   int         type() const;
+  int         nthreads() const;
 
  private:
 
   bool         m_dbg;   
+  bool         m_prefetch;
   std::string  m_opt;  
   std::string  m_inputfile; 
   std::string  m_outfile;
   std::string  m_testfile; 
   std::string  m_pattfile;  
+  std::string  m_keep;  
   int          m_eta;
   int          m_phi;
   int          m_oeta;
@@ -53,6 +58,7 @@ class jobparams{
   int          m_nevt;
   int          m_rate;
   int          m_type;
+  int          m_nthreads;
 
 };
 
@@ -76,10 +82,18 @@ inline std::string jobparams::pattfile() const{
   return m_pattfile;
 }
 
+inline std::string jobparams::keep() const{
+  return m_keep;
+}
+
 inline bool jobparams::dbg() const{
   return m_dbg;
 }
 
+inline bool jobparams::prefetch() const{
+  return m_prefetch;
+}
+
 inline int jobparams::eta() const{
   return m_eta;
 }
@@ -108,4 +122,8 @@ inline int jobparams::type() const{
   return m_type;
 }
 
+inline int jobparams::nthreads() const{
+  return m_nthreads;
+}
+
 #endif
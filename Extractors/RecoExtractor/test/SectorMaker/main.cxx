@@ -7,9 +7,11 @@
 #include "rates.h"
 #include "patterngen.h"
 #include "sector.h"
+#include "sector_optimizer.h"
 #include "sector_test.h"
 #include "efficiencies.h"
 #include "jobparams.h"
+#include "ChainReader.h"
 #include "TROOT.h"
 
 using namespace std;
@@ -36,13 +38,16 @@ int main(int argc, char** argv) {
   // read jobParams
   jobparams params(argc,argv);
 
+  // Must be done before opening any input file
+  if (params.prefetch()) ChainReader::enablePrefetch();
+
   // Depending on the option chosen, process the information
 
 
   // Option 1: just do the rate calculation
   if (params.option()=="rates")
   {
-    rates* my_rates = new rates(params.inputfile(),params.outfile());
+    rates* my_rates = new rates(params.inputfile(),params.outfile(),params.nthreads());
     delete my_rates;    
   }
   
@@ -57,17 +62,20 @@ int main(int argc, char** argv) {
     delete my_sectors;
   }
 
-  // Option 3: do both steps
+  // Option 3: do both steps (the rates are given directly to the sector 
+  // determination, they are written in KEEP_rates.root only if -k KEEP is given)
 
   if (params.option()=="rate_n_sec")
   {
-    rates* my_rates = new rates(params.inputfile(),"my_rates_temp.root");
-    delete my_rates;
+    rates* my_rates = new rates(params.inputfile(),
+				(params.keep()!="") ? params.keep()+"_rates.root" : "",
+				params.nthreads());
 
-    sector* my_sectors = new sector("my_rates_temp.root",params.outfile(),
+    sector* my_sectors = new sector(my_rates,params.outfile(),
 				    params.eta(),params.phi(),
 				    params.oeta(),params.ophi());
     delete my_sectors;
+    delete my_rates;
   }
 
   // Option 4: do sectors and test
@@ -76,7 +84,8 @@ int main(int argc, char** argv) {
   {
     sector_test* my_test = new sector_test(params.testfile(),params.inputfile(),
 					   "",params.outfile(),
-					   params.nevt(),params.dbg());
+					   params.nevt(),params.dbg(),
+					   params.nthreads());
 
     delete my_test;
   }
@@ -95,7 +104,8 @@ int main(int argc, char** argv) {
   {
     sector_test* my_test = new sector_test(params.testfile(),params.inputfile(),
 					   params.pattfile(),params.outfile(),
-					   params.nevt(),params.dbg());
+					   params.nevt(),params.dbg(),
+					   params.nthreads());
 
     delete my_test;
   }
@@ -114,5 +124,41 @@ int main(int argc, char** argv) {
     delete my_pgen;
   }
 
+  // Option 9: scan of the sector configurations, up to eta/phi sectors and 
+  // oeta/ophi overlaps (for debugging only, as option 2)
+  if (params.option()=="optimize")
+  {
+    sector_optimizer* my_opt = new sector_optimizer(params.inputfile(),params.outfile(),
+						    params.eta(),params.phi(),
+						    params.oeta(),params.ophi(),
+						    params.nthreads());
+    delete my_opt;
+  }
+
+  // Option 10: rates, sectors and sector test in one go, without intermediate
+  // files (unless -k KEEP is given: rates in KEEP_rates.root, sectors in
+  // KEEP_sectors.root). The pattern file is used if given, as in PR_eff
+  if (params.option()=="pipeline")
+  {
+    std::string keep = params.keep();
+
+    rates* my_rates = new rates(params.inputfile(),
+				(keep!="") ? keep+"_rates.root" : "",
+				params.nthreads());
+
+    sector* my_sectors = new sector(my_rates,
+				    (keep!="") ? keep+"_sectors.root" : "",
+				    params.eta(),params.phi(),
+				    params.oeta(),params.ophi());
+    delete my_rates;
+
+    sector_test* my_test = new sector_test(params.testfile(),my_sectors->layout(),
+					   params.pattfile(),params.outfile(),
+					   params.nevt(),params.dbg(),
+					   params.nthreads());
+    delete my_test;
+    delete my_sectors;
+  }
+
   return 0;
 }
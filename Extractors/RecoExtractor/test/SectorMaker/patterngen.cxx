@@ -72,8 +72,6 @@ void patterngen::get_MPA_input(int nevt)
   int itp=-1;
 
   int modid;
-  std::vector<int> m_digi_list;
-  std::vector<int> m_mod_list;
 
   float ptGEN;
   float d0GEN;
@@ -86,7 +84,6 @@ void patterngen::get_MPA_input(int nevt)
     MC->GetEntry(j); 
 
     m_pix_idx.clear();
-    m_mod_list.clear();
 
     std::cout << std::endl;
     std::cout << "##################################################" << std::endl;
@@ -106,44 +103,25 @@ void patterngen::get_MPA_input(int nevt)
 
       modid = ladder*100 + module;
 
-      m_iter = m_pix_idx.find(modid);
-
-      m_digi_list.clear();
-
-      if (m_iter == m_pix_idx.end()) // New mod, add it
-      {
-	m_digi_list.push_back(i);
-	m_pix_idx.insert(std::make_pair(modid,m_digi_list));
-	m_mod_list.push_back(modid);
-      }
-      else
-      {
-	m_digi_list = m_iter->second;
-	m_digi_list.push_back(i);
-	m_pix_idx.erase(m_iter->first);
-	m_pix_idx.insert(std::make_pair(modid,m_digi_list));
-      }
+      m_pix_idx.add(modid).push_back(i);
     }
 
     // We now have a list of the modules containing pixels, along 
     // with the pixels contained into them
     //
     // m_pix_idx contains, for each touched module in the layer
-    // a pair composed of the module ID number and a vector of int (pix indices)
-    //
-    // m_mod_list is just the list of modules
+    // the module ID number and a vector of int (pix indices). The
+    // modules are in the order they were first touched
 
-    if (m_mod_list.size()==0) continue;
+    if (m_pix_idx.size()==0) continue;
     
-    for (unsigned int i=0;i<m_mod_list.size();++i) // Loop over the list of touched module
+    for (int i=0;i<m_pix_idx.size();++i) // Loop over the list of touched module
     {
 
       // We first got the entry in m_pix_idx
 
-      m_iter = m_pix_idx.find(m_mod_list.at(i));
-
-      m_digi_list = m_iter->second; // The pixel digi list
-      modid       = m_iter->first;  // The module ID
+      const std::vector<int> &m_digi_list = m_pix_idx.list(i); // The pixel digi list
+      modid       = m_pix_idx.chip(i);  // The module ID
 
       ladder      = modid/100;
       module      = 2*(modid-100*ladder)+1; 
@@ -244,7 +222,8 @@ void patterngen::ana_pix(int lay,int lad,int mod)
   int c1 = -1;
   int c2 = -1;
 
-  std::vector<int> list_pix;
+  IntSpan list_pix;
+  IntSpan list_tp;
 
   for (int i=0;i<m_clus;++i)
   {      
@@ -255,17 +234,17 @@ void patterngen::ana_pix(int lay,int lad,int mod)
 
     // First of all we compute the ID of the stub's module
 
-    list_pix.clear();
-    list_pix = m_clus_pix[i];
+    list_pix = m_clus_pix_branch.row(i);
+    list_tp  = m_clus_tp_branch.row(i);
 
-    for (unsigned int j=0;j<list_pix.size();++j)
+    for (int j=0;j<list_pix.size();++j)
     {
       m_evt_pix.push_back(list_pix.at(j));
       m_evt_clu.push_back(i);
       m_evt_stu.push_back(-1);
 
-      (m_clus_tp[i].size()!=0)
-	? m_evt_tp.push_back(m_clus_tp[i].at(0))
+      (list_tp.size()!=0)
+	? m_evt_tp.push_back(list_tp.at(0))
 	: m_evt_tp.push_back(-1);
 
     }
@@ -309,124 +288,184 @@ void patterngen::do_stub(int lay,int lad,int mod)
 // 
 //////////////////////////////////////////////
 
-void patterngen::get_all_patterns(int npatt)
+// The trigger and raw data of the chips, for one event (m_trig_evt and
+// m_raw_evt), read from the chain. Used by draw_block
+
+void patterngen::load_raw(int evt)
 {
-  // Initialize some params
- 
-  int B_id; // The detector module IDs (defined in the header)
+  if (evt==m_raw_evt) return; // Already there
 
+  int B_id;
   int layer,ladder,module,strip,chip;
+  int seg;
+
+  m_chip_raw.clear();
+  m_raw_evt = evt;
+
+  PIX->GetEntry(evt); 
+
+  for (int i=0;i<m_pix;++i)
+  {
+    layer = m_pix_layer[i]; 
+
+    if (layer<8 || layer>10) continue;
+
+    ladder= m_pix_ladder[i]-1;
+    module= static_cast<int>((m_pix_module[i]-1)/2); 
+    seg   = m_pix_col[i]; 
+    strip = m_pix_row[i]; 
+    chip  = static_cast<int>(strip/127)+seg*8;
+
+    strip = strip%128+((m_pix_module[i]-1)%2)*128;
+
+    B_id = (layer-5)*10000 + ladder*100 + module;
+    B_id = 100*B_id+chip;
 
+    m_chip_raw.add(B_id).push_back(strip);
+  }
+}
+
+void patterngen::load_trig(int evt)
+{
+  if (evt==m_trig_evt) return; // Already there
+
+  int B_id;
+  int layer,ladder,module,strip,chip;
   int seg;
+  int pt;
 
-  int n_entries = L1TT->GetEntries();
+  m_chip_trig.clear();
+  m_trig_evt = evt;
 
-  // Then loop over events
+  L1TT->GetEntry(evt); 
 
-  std::vector<int> m_stub_list;
-  std::vector<int> m_digi_list;
+  for (int i=0;i<m_stub;++i)
+  {  
+    // First of all we compute the ID of the stub's module
 
-  std::vector<std::vector <int> > evt_mix;
+    layer = m_stub_layer[i]; 
+    if (layer<8 || layer>10) continue;
 
-  std::vector<int> evt_signature;
-  std::vector<int> evt_tmp;
+    ladder= m_stub_ladder[i]; 
+    module= m_stub_module[i];
+    seg   = m_stub_seg[i]; 
+    chip  = m_stub_chip[i]+seg*8;; 
+    strip = m_stub_strip[i]; 
+    pt    = static_cast<int>(2*m_stub_deltas[i]);
+         
+    B_id = (layer-5)*10000 + ladder*100 + module;
+    B_id = 100*B_id+chip;
 
-  evt_mix.clear();
-  m_data_trig.clear();
-  m_data_raw.clear();
+    std::vector<int> &stubs = m_chip_trig.add(B_id);
 
-  int n_seq    = npatt;
+    stubs.push_back(strip);
+    stubs.push_back(pt);
+  }  
+}
 
-  int pt = 0;
 
-  for (int j=0;j<n_entries;++j)
-  {    
-    if (j%100==0)
-      cout << j << endl;
+// The events of the BXs [first_bx,first_bx+nbx[ are drawn in advance, with
+// the same rand() sequence as if they were drawn BX per BX (trigger event,
+// then raw event if there is an L1A). The different events are then read
+// in entry order, so that the chains go through their files only once per
+// block, and only the data of the 8 chips used (idx to idx+7) is kept
 
-    m_chip_trig.clear();
-    m_chip_raw.clear();
+void patterngen::draw_block(int first_bx, int nbx, int delta, int n_data, int idx)
+{
+  const std::vector<int> *list;
 
-    L1TT->GetEntry(j); 
-    PIX->GetEntry(j); 
+  m_blk_trg.resize(nbx);
+  m_blk_raw.assign(nbx,-1);
 
-    for (int i=0;i<m_pix;++i)
-    {
-      layer = m_pix_layer[i]; 
+  for (int b=0;b<nbx;++b)
+  {
+    m_blk_trg[b] = rand()%n_data;
+    if ((first_bx+b)%delta==0) m_blk_raw[b] = rand()%n_data;
+  }
 
-      if (layer<8 || layer>10) continue;
+  m_blk_trg_evt = m_blk_trg;
+  std::sort(m_blk_trg_evt.begin(),m_blk_trg_evt.end());
+  m_blk_trg_evt.erase(std::unique(m_blk_trg_evt.begin(),m_blk_trg_evt.end()),m_blk_trg_evt.end());
 
-      ladder= m_pix_ladder[i]-1;
-      module= static_cast<int>((m_pix_module[i]-1)/2); 
-      seg   = m_pix_col[i]; 
-      strip = m_pix_row[i]; 
-      chip  = static_cast<int>(strip/127)+seg*8;
+  m_blk_raw_evt.clear();
+
+  for (int b=0;b<nbx;++b)
+    if (m_blk_raw[b]>=0) m_blk_raw_evt.push_back(m_blk_raw[b]);
 
-      strip = strip%128+((m_pix_module[i]-1)%2)*128;
+  std::sort(m_blk_raw_evt.begin(),m_blk_raw_evt.end());
+  m_blk_raw_evt.erase(std::unique(m_blk_raw_evt.begin(),m_blk_raw_evt.end()),m_blk_raw_evt.end());
 
-      B_id = (layer-5)*10000 + ladder*100 + module;
-      B_id = 100*B_id+chip;
+  m_blk_trg_data.resize(m_blk_trg_evt.size()*cbc::NCHIPS);
+  m_blk_raw_data.resize(m_blk_raw_evt.size()*cbc::NCHIPS);
 
-      m_iter = m_chip_raw.find(B_id);
+  for (unsigned int e=0;e<m_blk_trg_evt.size();++e)
+  {
+    patterngen::load_trig(m_blk_trg_evt[e]);
 
-      m_digi_list.clear();
+    for (int k=0;k<cbc::NCHIPS;++k)
+    {
+      list = m_chip_trig.find(idx+k);
 
-      if (m_iter == m_chip_raw.end()) // New chip, add it
-      {
-	m_digi_list.push_back(strip);
-	m_chip_raw.insert(std::make_pair(B_id,m_digi_list));
-      }
-      else
-      {
-	m_digi_list = m_iter->second;
-	m_digi_list.push_back(strip);
-	m_chip_raw.erase(m_iter->first);
-	m_chip_raw.insert(std::make_pair(B_id,m_digi_list));
-      }
+      if (list) m_blk_trg_data[e*cbc::NCHIPS+k] = *list;
+      else      m_blk_trg_data[e*cbc::NCHIPS+k].clear();
     }
+  }
 
-    for (int i=0;i<m_stub;++i)
-    {  
-      // First of all we compute the ID of the stub's module
+  for (unsigned int e=0;e<m_blk_raw_evt.size();++e)
+  {
+    patterngen::load_raw(m_blk_raw_evt[e]);
 
-      layer = m_stub_layer[i]; 
-      if (layer<8 || layer>10) continue;
+    for (int k=0;k<cbc::NCHIPS;++k)
+    {
+      list = m_chip_raw.find(idx+k);
 
-      ladder= m_stub_ladder[i]; 
-      module= m_stub_module[i];
-      seg   = m_stub_seg[i]; 
-      chip  = m_stub_chip[i]+seg*8;; 
-      strip = m_stub_strip[i]; 
-      pt    = static_cast<int>(2*m_stub_deltas[i]);
-         
-      B_id = (layer-5)*10000 + ladder*100 + module;
-      B_id = 100*B_id+chip;
+      if (list) m_blk_raw_data[e*cbc::NCHIPS+k] = *list;
+      else      m_blk_raw_data[e*cbc::NCHIPS+k].clear();
+    }
+  }
+}
 
-      m_iter = m_chip_trig.find(B_id);
+const std::vector<int> *patterngen::block_trig(int evt, int k) const
+{
+  std::vector<int>::const_iterator it = std::lower_bound(m_blk_trg_evt.begin(),m_blk_trg_evt.end(),evt);
 
-      m_stub_list.clear();
+  if (it==m_blk_trg_evt.end() || *it!=evt) return 0;
 
-      if (m_iter == m_chip_trig.end()) // New chip, add it
-      {
-	m_stub_list.push_back(strip);
-	m_stub_list.push_back(pt);
-	m_chip_trig.insert(std::make_pair(B_id,m_stub_list));
-      }
-      else
-      {
-	m_stub_list = m_iter->second;
-	m_stub_list.push_back(strip);
-	m_stub_list.push_back(pt);
-	m_chip_trig.erase(m_iter->first);
-	m_chip_trig.insert(std::make_pair(B_id,m_stub_list));
-      }
-    }  
+  const std::vector<int> &list = m_blk_trg_data[(it-m_blk_trg_evt.begin())*cbc::NCHIPS+k];
 
-    m_data_trig.push_back(m_chip_trig);
-    m_data_raw.push_back(m_chip_raw);
-  }
+  return (list.empty()) ? 0 : &list;
+}
+
+const std::vector<int> *patterngen::block_raw(int evt, int k) const
+{
+  std::vector<int>::const_iterator it = std::lower_bound(m_blk_raw_evt.begin(),m_blk_raw_evt.end(),evt);
+
+  if (it==m_blk_raw_evt.end() || *it!=evt) return 0;
+
+  const std::vector<int> &list = m_blk_raw_data[(it-m_blk_raw_evt.begin())*cbc::NCHIPS+k];
+
+  return (list.empty()) ? 0 : &list;
+}
 
-  // Now we have two collections one containing the raw data, and one the trigger data for all event.
+
+void patterngen::get_all_patterns(int npatt)
+{
+  // Initialize some params
+ 
+  int n_entries = L1TT->GetEntries();
+
+  const std::vector<int> *m_stub_list;
+  const std::vector<int> *m_digi_list;
+
+  int n_seq    = npatt;
+
+  m_trig_evt = -1;
+  m_raw_evt  = -1;
+
+  // Each BX takes a random event for the trigger data, and every n BX (see below)
+  // another one for the raw data. The events are drawn and read by blocks of
+  // BLOCK_TRAINS trains (draw_block), so the memory doesn't depend on the number
+  // of events, and the chains are read in entry order.
 
   // We now create a set of 8 BX trains
 
@@ -445,7 +484,7 @@ void patterngen::get_all_patterns(int npatt)
 
   int delta = static_cast<int>(40000/m_rate);
 
-  int n_data = m_data_trig.size();
+  int n_data = n_entries;
 
   std::cout << "We will trig an L1 A every " << delta << " BXs" << std::endl;
 
@@ -459,33 +498,40 @@ void patterngen::get_all_patterns(int npatt)
   int raw_rank;
 
 
-  int raw_data[8][266];
+  CBCTrigWord trig_data[cbc::NCHIPS]; // The words sent by the chips (see CBCWord.h)
+  CBCRawWord  raw_data[cbc::NCHIPS];
 
-  for (int i=0;i<12;++i)
-  { 
-    for (int j=0;j<8;++j) raw_data[j][i]=1;
-  }
+  conc_frame_header frame;
 
-  for (int i=12;i<266;++i)
-  { 
-    for (int j=0;j<8;++j) raw_data[j][i]=0;
-  }
+  uint64_t trig_words[cbc::NCHIPS];
+  uint64_t raw_words[cbc::NCHIPS*cbc::RAW_NW];
 
-  std::multimap< int, std::vector<int> > trg_evt;
-  std::multimap< int, std::vector<int> > raw_evt;
+  bool new_raw;
+
+  int blk_first = 0; // First BX of the current block
+  int ntrains;
 
   // Create the sequence
 
   for (int i=0;i<n_seq;++i)
   { 
+    if (i%BLOCK_TRAINS==0)
+    {
+      blk_first = BX_ID;
+      ntrains   = (n_seq-i<BLOCK_TRAINS) ? n_seq-i : BLOCK_TRAINS;
+
+      patterngen::draw_block(blk_first,8*ntrains,delta,n_data,idx);
+    }
+
     m_outbinary << "//Event_train " << Block_ID << "\n";
 
     for (int j=0;j<8;++j)
     { 
 
 
-      trg_evnum = rand()%n_data;
-      trg_evt   = m_data_trig.at(trg_evnum);
+      trg_evnum = m_blk_trg[BX_ID-blk_first];
+
+      new_raw = false;
 
       if (BX_ID%delta==0)
       {
@@ -493,39 +539,31 @@ void patterngen::get_all_patterns(int npatt)
 
 	m_raw_bx=BX_ID;
 
-	for (int k=0;k<12;++k)
-	{ 
-	  for (int kk=0;kk<8;++kk) m_raw_chp[kk][k]=1;
-	}
-
-	for (int k=12;k<266;++k)
-	{ 
-	  for (int kk=0;kk<8;++kk) raw_data[kk][k]=0;
-	}
-
-	raw_evnum= rand()%n_data;
+	raw_evnum= m_blk_raw[BX_ID-blk_first];
 	raw_rank=0;
-	raw_evt = m_data_raw.at(raw_evnum);
 
-	for (int k=0;k<8;++k)
+	for (int k=0;k<cbc::NCHIPS;++k)
 	{ 
-	  m_digi_list.clear();
+	  raw_data[k].clear();
+	  raw_data[k].set_header(0xFFF);
 
-	  m_iter = raw_evt.find(idx+k);
+	  m_digi_list = patterngen::block_raw(raw_evnum,k);
 
-	  if (m_iter != raw_evt.end())  
+	  if (m_digi_list)  
 	  {
-	    m_digi_list = m_iter->second;
-
-	    for (unsigned int kk=0;kk<m_digi_list.size();++kk)
-	    {
-	      m_raw_chp[k][12+m_digi_list[kk]]=1;
-	      raw_data[k][12+m_digi_list[kk]]=1;
-	    }
+	    for (unsigned int kk=0;kk<m_digi_list->size();++kk)
+	      raw_data[k].set_strip(m_digi_list->at(kk));
 	  }
+
+	  raw_data[k].to_bits(m_raw_chp[k]);
+
+	  for (int kk=0;kk<cbc::RAW_NW;++kk) 
+	    raw_words[k*cbc::RAW_NW+kk] = raw_data[k].words()[kk];
 	}
 
 	m_raw_tree->Fill();
+
+	new_raw = true;
       }
 
       m_outbinary << "--CBC_TRIG_content_for_event " << std::bitset<3>(j) << " "  << BX_ID << " " << trg_evnum << " " << "\n";
@@ -534,53 +572,63 @@ void patterngen::get_all_patterns(int npatt)
 
       m_tri_bx=BX_ID;
 
-      for (int k=0;k<8;++k)
+      frame.trig_mask = 0;
+
+      for (int k=0;k<cbc::NCHIPS;++k)
       {
+	trig_data[k].clear();
 
-	m_iter = trg_evt.find(idx+k);
+	m_stub_list = patterngen::block_trig(trg_evnum,k);
 	
-	if (m_iter != trg_evt.end())  
+	if (m_stub_list)  
 	{
-	  m_stub_list.clear();
-	  m_outbinary << "Chip " << std::bitset<3>(k) << "  " ;
+	  frame.trig_mask |= (1<<k);
 
-	  m_stub_list = m_iter->second;
+	  m_outbinary << "Chip " << std::bitset<3>(k) << "  " ;
 
-	  for (unsigned int kk=0;kk<m_stub_list.size()/2;++kk)
+	  for (unsigned int kk=0;kk<m_stub_list->size()/2;++kk)
 	  {
-	    if (kk>=3) continue; // No sorting for the moment
+	    if (kk>=static_cast<unsigned int>(cbc::NSTUBS)) continue; // No sorting for the moment
 	    
-	    std::bitset<8> pos = m_stub_list.at(2*kk)+1;
-	    std::bitset<5> off = abs(2*m_stub_list.at(2*kk+1));
+	    trig_data[k].set_stub(kk,m_stub_list->at(2*kk)+1,abs(2*m_stub_list->at(2*kk+1)));
 
-	    //m_outbinary << std::bitset<8>(m_stub_list.at(2*kk)+1) << std::bitset<5>(abs(2*m_stub_list.at(2*kk+1))) << " " ;
-	    m_outbinary << pos << off << " " ;
+	    for (int ik=cbc::STUB_BITS*static_cast<int>(kk);ik<cbc::STUB_BITS*static_cast<int>(kk+1);++ik) 
+	      m_outbinary << trig_data[k].bit(ik);
 
-	    for (unsigned int ik=13*kk;ik<13*(kk+1);++ik)
-	    {
-	      if (ik%13<8)  m_tri_chp[k][ik] = pos[13-ik%13]; // !! To check
-	      if (ik%13>=8) m_tri_chp[k][ik] = off[16-ik%13]; // !! To check
-	    }
+	    m_outbinary << " " ;
 	  }
 
 	  m_outbinary << "\n";      
 	}
+
+	trig_data[k].to_bits(m_tri_chp[k]);
+	trig_words[k] = trig_data[k].word();
       } // End of trigger data loop on chip
 
       m_tri_tree->Fill();
 
+      frame.bx       = BX_ID;
+      frame.train    = Block_ID;
+      frame.trg_evt  = trg_evnum;
+      frame.raw_evt  = raw_evnum;
+      frame.raw_bx   = BX_ID-raw_rank;
+      frame.raw_rank = raw_rank;
+      frame.flags    = 0;
+
+      m_outstream.write_frame(frame,trig_words,(new_raw) ? raw_words : 0);
+
 
       m_outbinary << "**CBC_RAW_content_for_event_sent_at_BX " << BX_ID-raw_rank << " " << raw_rank << " " << raw_evnum << "\n";
 
       if (raw_rank<=33)
       {
-	for (int k=0;k<8;++k)
+	for (int k=0;k<cbc::NCHIPS;++k)
 	{
 	  m_outbinary << "RawChip " << std::bitset<3>(k) << "  " ;
 	  
 	  for (int kk=8*raw_rank;kk<8*(raw_rank+1);++kk)
 	  {
-	    if (kk<266) m_outbinary << raw_data[k][kk] ;
+	    if (kk<cbc::RAW_BITS) m_outbinary << raw_data[k].bit(kk) ;
 	  }
 	  
 	  m_outbinary << "\n";      
@@ -600,6 +648,7 @@ void patterngen::get_all_patterns(int npatt)
 
 
   m_outbinary.close();
+  m_outstream.close();
 
   m_outfile->Write();
   
@@ -739,7 +788,6 @@ void patterngen::initTuple(std::string in,std::string out,int type)
   pm_stub_strip=&m_stub_strip;
   pm_stub_seg=&m_stub_seg;
   pm_clus_nseg=&m_clus_nseg;
-  pm_clus_pix=&m_clus_pix;
   pm_stub_chip=&m_stub_chip;
   pm_stub_clust1=&m_stub_clust1;
   pm_stub_clust2=&m_stub_clust2;
@@ -753,8 +801,6 @@ void patterngen::initTuple(std::string in,std::string out,int type)
   pm_clus_layer=&m_clus_layer;
   pm_clus_ladder=&m_clus_ladder;
   pm_clus_module=&m_clus_module;
-  pm_clus_tp=&m_clus_tp;
-  pm_clus_pix=&m_clus_pix;
 
 
   L1TT->SetBranchAddress("STUB_n",         &m_stub);
@@ -774,8 +820,8 @@ void patterngen::initTuple(std::string in,std::string out,int type)
   if (type == 2)
   {
     L1TT->SetBranchAddress("CLUS_n",         &m_clus);
-    L1TT->SetBranchAddress("CLUS_pix",       &pm_clus_pix);
-    L1TT->SetBranchAddress("CLUS_tp",        &pm_clus_tp);
+    m_clus_pix_branch.setAddress(L1TT,"CLUS_pix",&m_clus_pix);
+    m_clus_tp_branch.setAddress(L1TT,"CLUS_tp",&m_clus_tp);
     L1TT->SetBranchAddress("CLUS_layer",     &pm_clus_layer);
     L1TT->SetBranchAddress("CLUS_ladder",    &pm_clus_ladder);
     L1TT->SetBranchAddress("CLUS_module",    &pm_clus_module);
@@ -788,8 +834,25 @@ void patterngen::initTuple(std::string in,std::string out,int type)
   L1TT->SetBranchAddress("STUB_Y0",        &pm_stub_Y0);
   L1TT->SetBranchAddress("STUB_Z0",        &pm_stub_Z0);
 
+  // Only the branches above are read
+
+  if (type == 2) // get_MPA_input, sequential reading
+  {
+    ChainReader::optimize(L1TT);
+    ChainReader::optimize(PIX);
+    ChainReader::optimize(MC);
+  }
+  else // get_all_patterns (draw_block) reads the entries of a block in increasing order, but only a few
+       // thousands of them spread over the whole chain, a cache would mostly load baskets of unused entries
+  {
+    ChainReader::optimize(L1TT,0);
+    ChainReader::optimize(PIX,0);
+  }
+
   m_outbinary.open("concentrator_input.txt");
-  
+
+  if (type == 1) m_outstream.open("concentrator_input.bin"); // Only written by get_all_patterns
+
 }
 
 
@@ -801,6 +864,12 @@ void patterngen::readConcOutput(std::string in)
 {
   // Input data file
 
+  if (in.size()>4 && in.substr(in.size()-4)==".bin") // Binary stream
+  {
+    patterngen::readConcBinary(in);
+    return;
+  }
+
   std::string STRING,L1BX,L1FRAG;
 
   std::ifstream in2(in.c_str());
@@ -831,11 +900,10 @@ void patterngen::readConcOutput(std::string in)
   int ntr=0;
   int bx = 0;
   char *evt_num  = new char[3];
-  char *cbc_word = new char[43];
+  CBCTrigWord trig_word;
   char *cbc_raw  = new char[11];
 
   int chip_num = 0;
-  int chip_prev = 0;
   int n_clus = 0;
   int BX_prev  = -1;
   int BX_L1    = 0;
@@ -847,6 +915,8 @@ void patterngen::readConcOutput(std::string in)
   int new_trg = 0;
 
   std::vector<int> spars_raw_tmp;
+  std::vector<uint64_t> spars_words;
+  int clus_start;
 
   while (!in2.eof())
   {
@@ -901,19 +971,14 @@ void patterngen::readConcOutput(std::string in)
     found = STRING.find("Chip");
     if (found!=std::string::npos && new_trg==1) 
     {
-      for (int j=0;j<43;++j)  cbc_word[j] = '0';
       STRING = STRING.substr(found+4);
       STRING.erase(std::remove(STRING.begin(), STRING.end(), ' '), STRING.end());
-      std::strcpy(cbc_word, STRING.c_str());
+      STRING.resize(3+cbc::TRIG_BITS,'0');
 
-      chip_num = 4*int(cbc_word[0]-'0')+2*int(cbc_word[1]-'0')+int(cbc_word[2]-'0');
+      chip_num = 4*int(STRING[0]-'0')+2*int(STRING[1]-'0')+int(STRING[2]-'0');
 
-      for (int j=0;j<40;++j)
-      {
-	(int(cbc_word[j+3]-'0')<0) 
-	  ? m_tri_chp[chip_num][j] = 0 
-	  : m_tri_chp[chip_num][j] = int(cbc_word[j+3]-'0');
-      }
+      trig_word.from_chars(STRING.c_str()+3);
+      trig_word.to_bits(m_tri_chp[chip_num]);
       
       if (chip_num==8)
       {
@@ -1035,53 +1100,53 @@ void patterngen::readConcOutput(std::string in)
 	cout << bit_count << " / " << spars_raw_tmp.size() << " bits were collected " << endl;
 	cout << " now analyzing them " << endl;
 
-	chip_prev = -1;
-	
 	for (int i=0;i<bit_count;++i)
 	{
 	  cout << spars_raw_tmp.at(2*i+1) << "/";
 	}
 	cout << endl;
 
-	for (int i=0;i<bit_count;++i)
-	{
-	  chip_num = spars_raw_tmp.at(2*i);
+	// The collected bits, packed (plus one word, so that the last field can be read in one go)
 
-	  if (chip_num!=chip_prev) // New chip
-	  {
-	    n_clus   = 0;
-	    for (int j=i;j<i+12;++j) // Read header
-	    { 
-	      m_raw_chp[chip_num][j-i] = spars_raw_tmp.at(2*j+1);
+	spars_words.assign((bit_count+63)/64+1,0);
 
-	      cout << spars_raw_tmp.at(2*j+1) << " & " << j-i << endl;
+	for (int i=0;i<bit_count;++i)
+	{
+	  if (spars_raw_tmp.at(2*i+1)) cbc::set_bit(&spars_words[0],i);
+	}
 
-	    }
+	// One block per chip (see CBCWord.h for the layout)
 
-	    for (int j=i+12;j<i+16;++j) // Number of clusters
-	    { 
-	      cout << spars_raw_tmp.at(2*j+1) << " / " << i+17-j << endl;
+	for (int i=0;i+cbc::SPARS_CLUS<=bit_count;)
+	{
+	  chip_num = spars_raw_tmp.at(2*i);
 
-	      n_clus += pow(2*spars_raw_tmp.at(2*j+1),i+16-j);
-	      //	      m_raw_chp[chip_num][j-i] = spars_raw_tmp.at(2*j+1);
-	    }
+	  for (int j=0;j<cbc::SPARS_HEADER.nbits;++j) // Read header
+	    m_raw_chp[chip_num][j] = cbc::bit(&spars_words[0],i+cbc::SPARS_HEADER.first+j);
 
-	    n_clus += spars_raw_tmp.at(2*(i+16)+1);
+	  n_clus = cbc::get(&spars_words[0],cbc::at(i,cbc::SPARS_NCLUS)); // Number of clusters
 
-	    cout << n_clus << " clusters in chip " << chip_num << endl;
+	  cout << n_clus << " clusters in chip " << chip_num << endl;
 	    
-	    // Expect 11 bits per stored cluster, 8 for position and 3 for width
+	  // Expect 11 bits per stored cluster, 8 for position and 3 for width
 
-	    if (n_clus!=0) 
+	  if (n_clus!=0) 
+	  {
+	    cout << " Expect " << n_clus*cbc::CLUS_BITS << " clus info bits" << endl;
+
+	    for (int j=0;j<n_clus;++j)
 	    {
-	      cout << " Expect " << n_clus*11 << " clus info bits" << endl;
+	      clus_start = i+cbc::SPARS_CLUS+j*cbc::CLUS_BITS;
 
-	      i+=11*n_clus;
-	    } 
-	  
+	      if (clus_start+cbc::CLUS_BITS>bit_count) break;
 
-	    i+=16;
-	  }
+	      cout << " Cluster " << j << " : position " 
+		   << cbc::get(&spars_words[0],cbc::at(clus_start,cbc::CLUS_POS)) << " width "
+		   << cbc::get(&spars_words[0],cbc::at(clus_start,cbc::CLUS_WIDTH)) << endl;
+	    }
+	  } 
+
+	  i += cbc::SPARS_CLUS+cbc::CLUS_BITS*n_clus;
 	}
 
 
@@ -1146,3 +1211,48 @@ void patterngen::readConcOutput(std::string in)
   delete m_outfile;
 }
 
+
+// Same thing for a binary stream file (see ConcStream.h). The frames are 
+// decoded directly from the mapped file, one Trigger entry per frame, and
+// one Raw entry per L1A
+
+void patterngen::readConcBinary(std::string in)
+{
+  ConcReader stream;
+
+  if (stream.open(in))
+  {
+    std::cout << "Reading " << stream.nframes() << " BX frames" << std::endl;
+
+    const conc_frame_header *frame;
+    const uint64_t          *words;
+
+    for (long long i=0;i<stream.nframes();++i)
+    {
+      frame = stream.header(i);
+      words = stream.raw(i);
+
+      if (words)
+      {
+	m_raw_bx = frame->raw_bx;
+
+	for (int k=0;k<cbc::NCHIPS;++k) 
+	  CBCRawWord(&words[k*cbc::RAW_NW]).to_bits(m_raw_chp[k]);
+
+	m_raw_tree->Fill();
+      }
+
+      words = stream.trig(i);
+
+      m_tri_bx = frame->bx;
+
+      for (int k=0;k<cbc::NCHIPS;++k) CBCTrigWord(words[k]).to_bits(m_tri_chp[k]);
+
+      m_tri_tree->Fill();
+    }
+  }
+
+  m_outfile->Write();
+  
+  delete m_outfile;
+}
@@ -20,6 +20,11 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TChain.h"
+#include "FlatBranch.h"
+#include "ChipMap.h"
+#include "ConcStream.h"
+#include "CBCWord.h"
+#include "ChainReader.h"
 
 #include <fstream>
 #include <string>
@@ -37,7 +42,7 @@ using namespace std;
 //
 // filename : the name and directory of the input ROOT file containing the STUB information
 // outfile  : the name of the output ROOT file containing the pattern info (a text file with binary info is 
-//            also produced) 
+//            also produced, concentrator_input.txt, along with its packed version concentrator_input.bin) 
 // npatt    : the number of patterns you want to generate 
 //
 // Info about the code:
@@ -60,9 +65,15 @@ class patterngen
   patterngen(std::string filename, std::string outfile, int npatt);
 
   void  get_all_patterns(int npatt);  // The main method  
+  void  load_trig(int evt);           // Chip trigger data of event evt
+  void  load_raw(int evt);            // Chip raw data of event evt
+  void  draw_block(int first_bx, int nbx, int delta, int n_data, int idx); // Events of the next BXs
+  const std::vector<int> *block_trig(int evt, int k) const; // Chip idx+k data of a drawn event (0 if none)
+  const std::vector<int> *block_raw(int evt, int k) const;
   void  initVars();
   void  initTuple(std::string in,std::string out,int type);
   void  readConcOutput(std::string filename);
+  void  readConcBinary(std::string filename);
   void  ana_pix(int lay,int lad,int mod);
   void  get_MPA_input(int nevt);
   void  do_stub(int lay,int lad,int mod);
@@ -73,7 +84,8 @@ class patterngen
   TChain *PIX;      // The trees containing the input data
   TChain *MC;      // The trees containing the input data
 
-  ofstream m_outbinary; // txt file containing the output sequences
+  ofstream   m_outbinary; // txt file containing the output sequences
+  ConcWriter m_outstream; // Same thing, in binary format (see ConcStream.h)
 
   // Coding conventions for barrel and endcap module IDs
   
@@ -132,18 +144,19 @@ class patterngen
   std::vector<int>   m_clus_ladder;
   std::vector<int>   m_clus_module;
   std::vector<int>   m_clus_nrows;
-  std::vector<std::vector<int> >   m_clus_tp;
-  std::vector<std::vector<int> >   m_clus_pix;
+  std::vector<std::vector<int> >   m_clus_tp;  // Only filled if the file has the nested layout
+  std::vector<std::vector<int> >   m_clus_pix; // (always read via m_clus_tp/pix_branch)
   std::vector<int>    m_clus_nseg;
 
   std::vector<int>   *pm_clus_layer;
   std::vector<int>   *pm_clus_ladder;
   std::vector<int>   *pm_clus_module;
   std::vector<int>   *pm_clus_nrows;
-  std::vector<std::vector<int> >   *pm_clus_tp;
-  std::vector<std::vector<int> >   *pm_clus_pix;
   std::vector<int>   *pm_clus_nseg;
 
+  FlatBranch m_clus_tp_branch;  // CLUS_tp, nested or flat layout
+  FlatBranch m_clus_pix_branch; // CLUS_pix, nested or flat layout
+
 
   int m_stub;
   std::vector<int>    m_stub_layer;
@@ -185,16 +198,24 @@ class patterngen
   std::vector<int>    *pm_stub_clust1;
   std::vector<int>    *pm_stub_clust2;
 
-  std::multimap< int, std::vector<int> > m_chip_trig;  //
-  std::multimap< int, std::vector<int> > m_chip_raw;  //
+  ChipMap m_chip_trig;  // Chip -> stub (strip,bend) pairs, for event m_trig_evt
+  ChipMap m_chip_raw;   // Chip -> digi strips, for event m_raw_evt
+
+  int     m_trig_evt;   // Events currently loaded (-1 if none)
+  int     m_raw_evt;
 
-  std::multimap< int, std::vector<int> > m_pix_idx;  //
+  // Events drawn for the current block of BXs (see draw_block)
 
-  std::multimap< int, std::vector<int> >::const_iterator m_iter; 
+  static const int BLOCK_TRAINS = 512; // Trains of 8 BXs per block
 
+  std::vector<int> m_blk_trg;          // Trigger event of each BX
+  std::vector<int> m_blk_raw;          // Raw event of each BX (-1 if no L1A)
+  std::vector<int> m_blk_trg_evt;      // The different events, in entry order
+  std::vector<int> m_blk_raw_evt;
+  std::vector< std::vector<int> > m_blk_trg_data; // Their chip data, NCHIPS lists per event
+  std::vector< std::vector<int> > m_blk_raw_data;
 
-  std::vector<std::multimap< int, std::vector<int> > > m_data_trig;
-  std::vector<std::multimap< int, std::vector<int> > > m_data_raw;
+  ChipMap m_pix_idx;    // Module -> digi indexes
 
 
   int m_rate; // the input L1 rate, in kHz
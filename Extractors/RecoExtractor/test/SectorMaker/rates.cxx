@@ -5,8 +5,10 @@
 
 // Main constructor
 
-rates::rates(std::string filename, std::string outfile)
+rates::rates(std::string filename, std::string outfile, int nthreads)
 {
+  m_nthreads = (nthreads>1) ? nthreads : 1;
+
   rates::initTuple(filename,outfile);
   rates::initVars();
   rates::get_rates();
@@ -22,6 +24,139 @@ void rates::get_rates()
 {
   // Initialize some params
  
+  double eta_seg,phi_seg;
+
+  int n_entries = L1TT->GetEntries();
+
+  double fact = 1./static_cast<float>(n_entries);
+
+  evt_maxPSb = -1;
+  evt_maxSSb = -1;
+  evt_nsPSb = -1;
+  evt_nsSSb = -1;
+
+  n_max_PSb = 0;
+  n_max_SSb = 0;
+
+  // Then loop over events
+  //
+  // The entries are cut in contiguous blocks, one per thread. The block size is 
+  // a multiple of 8, as the concentrator occupancy is computed on groups of 8 events
+
+  int block = 8*((n_entries+8*m_nthreads-1)/(8*m_nthreads));
+  int nwork = (block>0) ? (n_entries+block-1)/block : 0;
+
+  std::vector<rates_acc*>  accs;
+  std::vector<std::thread> workers;
+
+  for (int i=0;i<nwork;++i) accs.push_back(new rates_acc());
+
+  if (nwork==1)
+  {
+    rates::process_events(accs.at(0),0,n_entries);
+  }
+  else if (nwork>1)
+  {
+    cout << "Processing " << n_entries << " events with " << nwork << " threads" << endl;
+
+    TThread::Initialize(); // Makes ROOT aware of the threads
+
+    for (int i=0;i<nwork;++i)
+      workers.push_back(std::thread(&rates::process_events,this,accs.at(i),
+				    i*block,std::min((i+1)*block,n_entries)));
+
+    for (unsigned int i=0;i<workers.size();++i) workers.at(i).join();
+  }
+
+  if (nwork>0) rates::reduce(accs,fact);
+
+  for (int i=0;i<nwork;++i) 
+  {
+    delete accs.at(i)->L1TT;
+    delete accs.at(i);
+  }
+
+  // The main tree is filled up at this point
+  // In the following we just fill up some infos
+
+
+  // Here we fill some debug information (modules are sorted by code, 
+  // barrel first, then endcap)
+
+  int code,i;
+
+  for (int im=0;im<m_modules.size();++im)
+  {
+    rates_module &mod = m_mod_rates[im];
+
+    code = m_modules.code(im);
+
+    (ModuleIndex::isBarrel(code))
+      ? i = code-ModuleIndex::barrelCode(0)
+      : i = code-ModuleIndex::endcapCode(0);
+
+    if (!ModuleIndex::isBarrel(code) && i>=140000) continue;
+
+    if (mod.rate_f+mod.rate_s+mod.rate_p==0.) continue;
+
+    if (mod.segmax-mod.segmin!=0)
+    {
+      eta_seg = (mod.etamax-mod.etamin)/(mod.segmax-mod.segmin);
+      mod.etamin = mod.etamin - (mod.segmin+0.5)*eta_seg;
+      mod.etamax = mod.etamin + mod.nseg*eta_seg;
+    }
+
+    if (mod.stmax-mod.stmin!=0)
+    {
+      if (mod.phimax<mod.phimin) mod.phimax+=8*atan(1.);
+
+      phi_seg = (mod.phimax-mod.phimin)/(mod.stmax-mod.stmin);
+
+      mod.phimin = mod.phimin - (mod.stmin+0.5)*phi_seg;
+      mod.phimax = mod.phimin + mod.nstrip*phi_seg;
+
+      if (mod.phimin<4*atan(1.) && mod.phimax>4*atan(1.)) mod.phimax-=8*atan(1.);  
+    }
+
+    for (int j=0;j<16;++j) 
+    {
+      (ModuleIndex::isBarrel(code))
+	? m_disk= 0
+	: m_disk= 1;
+      m_lay = static_cast<int>(i/10000);
+      m_lad = static_cast<int>((i-10000*m_lay)/100);
+      m_mod = static_cast<int>((i-10000*m_lay-100*m_lad));
+      m_sen = j/8+1;
+      m_chp = j%8+1;
+      m_rate= mod.rate[j];
+      m_ss = 0; 
+      m_cbc_ss = 0;
+      if (m_dbgtree) m_dbgtree->Fill(); 
+    }
+  }
+
+  // End of dbg loop, fill up root trees
+
+  if (m_outfile)
+  {
+    rates::fillRateTree();
+    m_outfile->Write();
+    delete m_outfile;
+  }
+
+  delete L1TT;
+}
+
+
+//////////////////////////////////////////////
+//
+// Event loop on the entries [first,last[ of the input, the results are 
+// accumulated in acc (one acc per thread)
+//
+//////////////////////////////////////////////
+
+void rates::process_events(rates_acc *acc, int first, int last)
+{
   int B_id,E_id; // The detector module IDs (defined in the header)
   int Bl_id,El_id; 
 
@@ -36,57 +171,54 @@ void rates::get_rates()
 
   int st,idx,seg,nseg;
   float phi,eta,r;
-  double eta_seg,phi_seg;
 
   int n_ss_half1;
   int n_ss_half2;
   int n_innef_ss;
   int n_cbc_innef_ss;
 
-  int n_entries = L1TT->GetEntries();
-
-  double fact = 1./static_cast<float>(n_entries);
-
-  // Then loop over events
+  int im; // Index of the module in acc->m_mod_counts
 
-  evt_maxPSb = -1;
-  evt_maxSSb = -1;
-  evt_nsPSb = -1;
-  evt_nsSSb = -1;
+  rates_evt evt;
 
-  n_max_PSb = 0;
-  n_max_SSb = 0;
+  rates::connect(acc);
 
-  for (int j=0;j<n_entries;++j)
+  for (int j=first;j<last;++j)
   {
-    L1TT->GetEntry(j); 
+    acc->L1TT->GetEntry(j); 
    
     if (j%8==0)
     {
-      for (int i=0;i<58000;++i) // Barrel
+      for (unsigned int k=0;k<acc->m_conc_touched.size();++k) // Barrel
       {   
-	n_conc_half1[i]     = 0;
-	n_conc_half2[i]     = 0;
+	acc->m_mod_counts[acc->m_conc_touched.at(k)].n_conc_half1 = 0;
+	acc->m_mod_counts[acc->m_conc_touched.at(k)].n_conc_half2 = 0;
       }
+
+      acc->m_conc_touched.clear();
     }
 
 
     for (int i=0;i<6;++i)
     {
-      m_bar_clus[i] = 0;
-      m_bar_stub[i] = 0;
+      evt.bar_clus[i] = 0;
+      evt.bar_stub[i] = 0;
     }
 
-    if (j%100==0) cout << j << endl;
+    if (j%100==0) 
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      cout << j << endl;
+    }
 
-    if (m_clus == 0) continue; // No clusters, don't go further
+    if (acc->m_clus == 0) continue; // No clusters, don't go further
 
-    for (int i=0;i<m_clus;++i)
+    for (int i=0;i<acc->m_clus;++i)
     {
       disk  = 0;
-      layer = m_clus_layer[i]; 
-      ladder= m_clus_ladder[i]; 
-      module= m_clus_module[i]; 
+      layer = acc->m_clus_layer[i]; 
+      ladder= acc->m_clus_ladder[i]; 
+      module= acc->m_clus_module[i]; 
 
       if (layer>10 && layer<=17) disk=(layer-10)%8;
       if (layer>17 && layer<=24) disk=(layer-17)%8+7;
@@ -97,41 +229,53 @@ void rates::get_rates()
       Bl_id = (layer-5)*100 + (module-1)/2;
       El_id = (disk-1)*100 + (ladder-1);
 
+      (disk==0)
+	? im = acc->module(ModuleIndex::barrelCode(B_id))
+	: im = acc->module(ModuleIndex::endcapCode(E_id));
+
+      if (im<0) continue; // Not a module of the outer tracker
+
       if (disk==0) // Barrel
       {
-	++m_bar_clus[layer-5];
-	m_b_crate[B_id]      += fact;
-	m_b_bylc_rate[Bl_id] += fact;
+	++evt.bar_clus[layer-5];
+	++acc->m_mod_counts[im].crate;
+	++acc->m_b_bylc_rate[Bl_id];
       }
       else 
       {
-	m_e_crate[E_id]      += fact;
-	m_e_bylc_rate[El_id] += fact;
+	++acc->m_mod_counts[im].crate;
+	++acc->m_e_bylc_rate[El_id];
       }
     }
 
-    if (m_stub == 0) continue; // No stubs, don't go further
+    if (acc->m_stub == 0) continue; // No stubs, don't go further
 
-    for (int i=0;i<58000;++i)
+    // Reset the modules used in the previous event
+
+    for (unsigned int l=0;l<acc->m_touched.size();++l)
     { 
-      tempo_ps_b[i] = 0;   
-      tempo_ss_b[i] = 0; 
+      rates_count &mod = acc->m_mod_counts[acc->m_touched.at(l)];
+
+      mod.tempo_ps = 0;   
+      mod.tempo_ss = 0; 
       
-      for (int k=0;k<16;++k) tempo_c_ps_b[k][i]=0;
-      for (int k=0;k<16;++k) tempo_c_ss_b[k][i]=0;
+      for (int k=0;k<16;++k) mod.tempo_c_ps[k]=0;
+      for (int k=0;k<16;++k) mod.tempo_c_ss[k]=0;
     }
 
-    for (int i=0;i<m_stub;++i)
+    acc->m_touched.clear();
+
+    for (int i=0;i<acc->m_stub;++i)
     {  
       // First of all we compute the ID of the stub's module
 
       disk  = 0;
-      layer = m_stub_layer[i]; 
-      ladder= m_stub_ladder[i]; 
-      module= m_stub_module[i]; 
-      seg   = m_stub_seg[i]; 
-      chip  = m_stub_chip[i]; 
-      nseg  = m_clus_nseg[m_stub_clust1[i]];
+      layer = acc->m_stub_layer[i]; 
+      ladder= acc->m_stub_ladder[i]; 
+      module= acc->m_stub_module[i]; 
+      seg   = acc->m_stub_seg[i]; 
+      chip  = acc->m_stub_chip[i]; 
+      nseg  = acc->m_clus_nseg[acc->m_stub_clust1[i]];
 
       if (seg/(nseg/2)==1) chip += 8;
 
@@ -144,17 +288,28 @@ void rates::get_rates()
       Bl_id = (layer-5)*100 + module;
       El_id = (disk-1)*100 + ladder;
 
+      (disk==0)
+	? im = acc->module(ModuleIndex::barrelCode(B_id))
+	: im = acc->module(ModuleIndex::endcapCode(E_id));
+
+      if (im<0) continue; // Not a module of the outer tracker
+
+      rates_count &mod = acc->m_mod_counts[im];
+
       if (disk==0)
       {
+	if (mod.tempo_ps==0 && mod.tempo_ss==0) 
+	  acc->m_touched.push_back(im);
+
 	if (nseg>2)
 	{ 
-	  ++tempo_ps_b[B_id];
-	  ++tempo_c_ps_b[chip][B_id];  
+	  ++mod.tempo_ps;
+	  ++mod.tempo_c_ps[chip];  
 	}
 	else
 	{
-	  ++tempo_ss_b[B_id];
-	  ++tempo_c_ss_b[chip][B_id];  
+	  ++mod.tempo_ss;
+	  ++mod.tempo_c_ss[chip];  
 	}
       }
       // Then we look if the stub is fake/secondary/primary 
@@ -163,57 +318,57 @@ void rates::get_rates()
       is_prim2=false;
       is_fake=false;
 
-      IP = sqrt(m_stub_X0[i]*m_stub_X0[i]+m_stub_Y0[i]*m_stub_Y0[i]);
-      PT = sqrt(m_stub_pxGEN[i]*m_stub_pxGEN[i]+m_stub_pyGEN[i]*m_stub_pyGEN[i]);
+      IP = sqrt(acc->m_stub_X0[i]*acc->m_stub_X0[i]+acc->m_stub_Y0[i]*acc->m_stub_Y0[i]);
+      PT = sqrt(acc->m_stub_pxGEN[i]*acc->m_stub_pxGEN[i]+acc->m_stub_pyGEN[i]*acc->m_stub_pyGEN[i]);
 
-      if (m_stub_tp[i]>=0 && IP<0.2)         is_prim=true; // OK, perfectible
-      if (m_stub_tp[i]<0)                    is_fake=true;
-      if (m_stub_tp[i]>=0 && IP<0.2 && PT>2) is_prim2=true; // OK, perfectible
+      if (acc->m_stub_tp[i]>=0 && IP<0.2)         is_prim=true; // OK, perfectible
+      if (acc->m_stub_tp[i]<0)                    is_fake=true;
+      if (acc->m_stub_tp[i]>=0 && IP<0.2 && PT>2) is_prim2=true; // OK, perfectible
 
 
       // Get some stub info (to get position on the module)
-      idx = m_stub_clust1[i];
-      st  = m_stub_strip[i];
+      idx = acc->m_stub_clust1[i];
+      st  = acc->m_stub_strip[i];
       
-      phi = atan2(m_clus_y[idx],m_clus_x[idx]);
-      r   = sqrt(m_clus_y[idx]*m_clus_y[idx]+m_clus_x[idx]*m_clus_x[idx]);
-      eta = -log(tan(atan2(r,m_clus_z[idx])/2.));
+      phi = atan2(acc->m_clus_y[idx],acc->m_clus_x[idx]);
+      r   = sqrt(acc->m_clus_y[idx]*acc->m_clus_y[idx]+acc->m_clus_x[idx]*acc->m_clus_x[idx]);
+      eta = -log(tan(atan2(r,acc->m_clus_z[idx])/2.));
 
       if (disk==0) // Barrel
       {
-	++m_bar_stub[layer-5];
-	m_b_rate[chip][B_id]  += fact;
-	m_b_nseg[B_id]   = m_clus_nseg[idx];
-	m_b_nstrip[B_id] = m_clus_nrows[idx];
-	m_b_byls_rate[Bl_id] += fact;
-
-	if (is_fake)              m_b_rate_f[B_id] += fact; 
-	if (!is_fake && !is_prim) m_b_rate_s[B_id] += fact; 
-	if (is_prim)              m_b_rate_p[B_id] += fact;
-	if (is_prim2)             m_b_rate_pp[B_id] += fact;
-
-	if (st>m_b_stmax[B_id])
+	++evt.bar_stub[layer-5];
+	++mod.rate[chip];
+	mod.nseg   = acc->m_clus_nseg[idx];
+	mod.nstrip = acc->m_clus_nrows[idx];
+	++acc->m_b_byls_rate[Bl_id];
+
+	if (is_fake)              ++mod.rate_f; 
+	if (!is_fake && !is_prim) ++mod.rate_s; 
+	if (is_prim)              ++mod.rate_p;
+	if (is_prim2)             ++mod.rate_pp;
+
+	if (st>mod.stmax)
 	{
-	  m_b_phimin[B_id]=phi; 
-	  m_b_stmax[B_id]=st; 
+	  mod.phimin=phi; 
+	  mod.stmax=st; 
 	}
 
-	if (st<m_b_stmin[B_id])
+	if (st<mod.stmin)
 	{
-	  m_b_phimax[B_id]=phi; 
-	  m_b_stmin[B_id]=st; 
+	  mod.phimax=phi; 
+	  mod.stmin=st; 
 	}
 
-	if (seg>m_b_segmax[B_id]) 
+	if (seg>mod.segmax) 
         {	  
-	  m_b_etamin[B_id]=eta; 
-	  m_b_segmax[B_id]=seg; 	  
+	  mod.etamin=eta; 
+	  mod.segmax=seg; 	  
 	}
 
-	if (seg<m_b_segmin[B_id])
+	if (seg<mod.segmin)
         {
-	  m_b_etamax[B_id]=eta; 
-	  m_b_segmin[B_id]=seg; 	  
+	  mod.etamax=eta; 
+	  mod.segmin=seg; 	  
 	}	
       }
       else 
@@ -222,38 +377,38 @@ void rates::get_rates()
 	{
 	  // Endcap +z: phi grows with strip, eta grows with seg
 
-	  m_e_rate[chip][E_id] += fact;
-	  m_e_nseg[E_id]   = m_clus_nseg[idx];
-	  m_e_nstrip[E_id] = m_clus_nrows[idx];
-	  m_e_bylc_rate[El_id] += fact;
+	  ++mod.rate[chip];
+	  mod.nseg   = acc->m_clus_nseg[idx];
+	  mod.nstrip = acc->m_clus_nrows[idx];
+	  ++acc->m_e_bylc_rate[El_id];
 
-	  if (is_fake)              m_e_rate_f[E_id] += fact; 
-	  if (!is_fake && !is_prim) m_e_rate_s[E_id] += fact; 
-	  if (is_prim)              m_e_rate_p[E_id] += fact;
-	  if (is_prim2)             m_e_rate_pp[E_id] += fact;
+	  if (is_fake)              ++mod.rate_f; 
+	  if (!is_fake && !is_prim) ++mod.rate_s; 
+	  if (is_prim)              ++mod.rate_p;
+	  if (is_prim2)             ++mod.rate_pp;
 	  
-	  if (st>m_e_stmax[E_id])
+	  if (st>mod.stmax)
 	  {
-	    m_e_phimax[E_id]=phi; 
-	    m_e_stmax[E_id]=st; 
+	    mod.phimax=phi; 
+	    mod.stmax=st; 
 	  }
 
-	  if (st<m_e_stmin[E_id])
+	  if (st<mod.stmin)
 	  {
-	    m_e_phimin[E_id]=phi; 
-	    m_e_stmin[E_id]=st; 
+	    mod.phimin=phi; 
+	    mod.stmin=st; 
 	  }
 
-	  if (seg>m_e_segmax[E_id]) 
+	  if (seg>mod.segmax) 
 	  {	  
-	    m_e_etamax[E_id]=eta; 
-	    m_e_segmax[E_id]=seg; 	  
+	    mod.etamax=eta; 
+	    mod.segmax=seg; 	  
 	  }
 
-	  if (seg<m_e_segmin[E_id])
+	  if (seg<mod.segmin)
 	  {
-	    m_e_etamin[E_id]=eta; 
-	    m_e_segmin[E_id]=seg; 	  
+	    mod.etamin=eta; 
+	    mod.segmin=seg; 	  
 	  }	
 	}
 	
@@ -261,38 +416,38 @@ void rates::get_rates()
 	{
 	  // Endcap +z: phi grows with strip, eta grows with seg
 
-	  m_e_rate[chip][E_id] += fact;
-	  m_e_nseg[E_id]   = m_clus_nseg[idx];
-	  m_e_nstrip[E_id] = m_clus_nrows[idx];
-	  m_e_byls_rate[El_id] += fact;
+	  ++mod.rate[chip];
+	  mod.nseg   = acc->m_clus_nseg[idx];
+	  mod.nstrip = acc->m_clus_nrows[idx];
+	  ++acc->m_e_byls_rate[El_id];
 
-	  if (is_fake)              m_e_rate_f[E_id]  += fact; 
-	  if (!is_fake && !is_prim) m_e_rate_s[E_id]  += fact; 
-	  if (is_prim)              m_e_rate_p[E_id]  += fact;
-	  if (is_prim2)             m_e_rate_pp[E_id] += fact;
+	  if (is_fake)              ++mod.rate_f; 
+	  if (!is_fake && !is_prim) ++mod.rate_s; 
+	  if (is_prim)              ++mod.rate_p;
+	  if (is_prim2)             ++mod.rate_pp;
 	  
-	  if (st>m_e_stmax[E_id])
+	  if (st>mod.stmax)
 	  {
-	    m_e_phimin[E_id]=phi; 
-	    m_e_stmax[E_id]=st; 
+	    mod.phimin=phi; 
+	    mod.stmax=st; 
 	  }
 
-	  if (st<m_e_stmin[E_id])
+	  if (st<mod.stmin)
 	  {
-	    m_e_phimax[E_id]=phi; 
-	    m_e_stmin[E_id]=st; 
+	    mod.phimax=phi; 
+	    mod.stmin=st; 
 	  }
 
-	  if (seg>m_e_segmax[E_id]) 
+	  if (seg>mod.segmax) 
 	  {	  
-	    m_e_etamin[E_id]=eta; 
-	    m_e_segmax[E_id]=seg; 	  
+	    mod.etamin=eta; 
+	    mod.segmax=seg; 	  
 	  }
 
-	  if (seg<m_e_segmin[E_id])
+	  if (seg<mod.segmin)
 	  {
-	    m_e_etamax[E_id]=eta; 
-	    m_e_segmin[E_id]=seg; 	  
+	    mod.etamax=eta; 
+	    mod.segmin=seg; 	  
 	  }	
 	}
       }
@@ -301,33 +456,41 @@ void rates::get_rates()
     n_cbc_innef_ss = 0;
     n_innef_ss     = 0;
 
-    m_rate= 0; 
-    m_disk= -1;
+    evt.rate = 0; 
+    evt.disk = -1;
 
-    for (int i=0;i<58000;++i) // Barrel
+    for (unsigned int l=0;l<acc->m_touched.size();++l) // Barrel modules with stubs
     {   
+      rates_count &mod = acc->m_mod_counts[acc->m_touched.at(l)];
+
       n_ss_half1     = 0;
       n_ss_half2     = 0;
 
       for (int k=0;k<16;++k) 
       {
-	if (tempo_c_ss_b[k][i]>3) ++n_cbc_innef_ss; 
+	if (mod.tempo_c_ss[k]>3) ++n_cbc_innef_ss; 
 	//	if (tempo_c_ps_b[k]>3) ++n_cbc_innef_ps; 
       }
 
       for (int k=0;k<8;++k) 
       {
-	(tempo_c_ss_b[k][i]<=3)
-	  ? n_ss_half1+=tempo_c_ss_b[k][i]
+	(mod.tempo_c_ss[k]<=3)
+	  ? n_ss_half1+=mod.tempo_c_ss[k]
 	  : n_ss_half1+=3;
 
-	(tempo_c_ss_b[k+8][i]<=3)
-	  ? n_ss_half2+=tempo_c_ss_b[k+8][i]
+	(mod.tempo_c_ss[k+8]<=3)
+	  ? n_ss_half2+=mod.tempo_c_ss[k+8]
 	  : n_ss_half2+=3;
       }
 
-      n_conc_half1[i]    += n_ss_half1;
-      n_conc_half2[i]    += n_ss_half2;
+      mod.n_conc_half1    += n_ss_half1;
+      mod.n_conc_half2    += n_ss_half2;
+
+      if (n_ss_half1+n_ss_half2>0 && mod.conc_stamp!=j/8+1)
+      {
+	mod.conc_stamp = j/8+1;
+	acc->m_conc_touched.push_back(acc->m_touched.at(l));
+      }
 
       if (n_ss_half1>22)
       {
@@ -336,139 +499,422 @@ void rates::get_rates()
 
       if (n_ss_half2>22) ++n_innef_ss;
 
-      if (j%8==7)
+      if (mod.tempo_ps>mod.max)
       {
-	m_disk= -2;
-
-	if (n_conc_half1[i]>22)
-	{
-	  ++m_rate;
-	}
-
-	if (n_conc_half2[i]>22) ++m_rate;
+	mod.max=mod.tempo_ps;
+	for (int k=0;k<16;++k) mod.c_max[k] = mod.tempo_c_ps[k]; 
       }
 
-      if (tempo_ps_b[i]>m_b_max[i])
+      if (mod.tempo_ss>mod.max)
       {
-	m_b_max[i]=tempo_ps_b[i];
-	for (int k=0;k<16;++k) m_b_c_max[k][i] = tempo_c_ps_b[k][i]; 
+	mod.max=mod.tempo_ss;
+	for (int k=0;k<16;++k) mod.c_max[k] = mod.tempo_c_ss[k]; 
       }
+    }
+
+    if (j%8==7) // Concentrator occupancy over the last 8 events
+    {
+      evt.disk = -2;
 
-      if (tempo_ss_b[i]>m_b_max[i])
+      for (unsigned int l=0;l<acc->m_conc_touched.size();++l)
       {
-	m_b_max[i]=tempo_ss_b[i];
-	for (int k=0;k<16;++k) m_b_c_max[k][i] = tempo_c_ss_b[k][i]; 
+	rates_count &mod = acc->m_mod_counts[acc->m_conc_touched.at(l)];
+
+	if (mod.n_conc_half1>22)
+	{
+	  ++evt.rate;
+	}
+
+	if (mod.n_conc_half2>22) ++evt.rate;
       }
     }
 
+    evt.ss     = n_innef_ss; 
+    evt.cbc_ss = n_cbc_innef_ss; 
+    acc->m_evts.push_back(evt); 
+
+  } // End of loop over events
+}
+
+
+//////////////////////////////////////////////
+//
+// Merging of the thread accumulators (in the block order), conversion
+// to rates, and filling of the per-event debug info
+//
+//////////////////////////////////////////////
+
+void rates::reduce(std::vector<rates_acc*> &accs, double fact)
+{
+  rates_acc *tot = accs.at(0);
+
+  for (unsigned int k=1;k<accs.size();++k) tot->merge(accs.at(k));
 
+  m_rate_sum.assign(1,0.);
 
-    m_lay = 0;
-    m_lad = 0; 
-    m_mod = 0; 
-    m_sen = 0;  
-    m_chp = 0; 
+  // The modules are sorted by code, so that the output does not depend
+  // on the order they were found
 
-    m_ss  = n_innef_ss; 
-    m_cbc_ss = n_cbc_innef_ss; 
-    m_dbgtree->Fill(); 
+  std::vector<int> perm;
 
+  m_modules = tot->m_modules;
+  m_modules.sort(perm);
 
-  } // End of loop over events
+  m_mod_rates.resize(perm.size());
 
-  // The main tree is filled up at this point
-  // In the following we just fill up some infos
+  for (unsigned int i=0;i<perm.size();++i)
+  {
+    rates_count  &cnt = tot->m_mod_counts.at(perm.at(i));
+    rates_module &mod = m_mod_rates.at(i);
+
+    for (int j=0;j<16;++j) mod.rate[j]  = rates::count2rate(cnt.rate[j],fact);
+    for (int j=0;j<16;++j) mod.c_max[j] = cnt.c_max[j];
+    mod.max     = cnt.max;
+    mod.rate_p  = rates::count2rate(cnt.rate_p,fact);
+    mod.rate_pp = rates::count2rate(cnt.rate_pp,fact);
+    mod.rate_s  = rates::count2rate(cnt.rate_s,fact);
+    mod.rate_f  = rates::count2rate(cnt.rate_f,fact);
+    mod.crate   = rates::count2rate(cnt.crate,fact);
+    mod.etamin  = cnt.etamin;
+    mod.etamax  = cnt.etamax;
+    mod.phimin  = cnt.phimin;
+    mod.phimax  = cnt.phimax;
+    mod.stmin   = cnt.stmin;
+    mod.stmax   = cnt.stmax;
+    mod.segmin  = cnt.segmin;
+    mod.segmax  = cnt.segmax;
+    mod.nseg    = cnt.nseg;
+    mod.nstrip  = cnt.nstrip;
+  }
+
+  for (int i=0;i<600;++i)
+  {
+    m_b_bylc_rate[i] = rates::count2rate(tot->m_b_bylc_rate[i],fact);
+    m_b_byls_rate[i] = rates::count2rate(tot->m_b_byls_rate[i],fact);
+  }
 
+  for (int i=0;i<1500;++i)
+  {
+    m_e_bylc_rate[i] = rates::count2rate(tot->m_e_bylc_rate[i],fact);
+    m_e_byls_rate[i] = rates::count2rate(tot->m_e_byls_rate[i],fact);
+  }
 
-  // Here we fill some debug information
+  // The per-event debug info, in the event order
 
+  m_lay = 0;
+  m_lad = 0; 
+  m_mod = 0; 
+  m_sen = 0;  
+  m_chp = 0; 
 
-  for (int i=0;i<58000;++i) // Barrel
+  for (unsigned int k=0;k<tot->m_evts.size();++k)
   {
-    if (m_b_rate_f[i]+m_b_rate_s[i]+m_b_rate_p[i]==0.) continue;
+    m_disk   = tot->m_evts.at(k).disk;
+    m_rate   = tot->m_evts.at(k).rate;
+    m_ss     = tot->m_evts.at(k).ss; 
+    m_cbc_ss = tot->m_evts.at(k).cbc_ss; 
 
-    if (m_b_segmax[i]-m_b_segmin[i]!=0)
+    for (int i=0;i<6;++i)
     {
-      eta_seg = (m_b_etamax[i]-m_b_etamin[i])/(m_b_segmax[i]-m_b_segmin[i]);
-      m_b_etamin[i] = m_b_etamin[i] - (m_b_segmin[i]+0.5)*eta_seg;
-      m_b_etamax[i] = m_b_etamin[i] + m_b_nseg[i]*eta_seg;
+      m_bar_clus[i] = tot->m_evts.at(k).bar_clus[i];
+      m_bar_stub[i] = tot->m_evts.at(k).bar_stub[i];
     }
 
-    if (m_b_stmax[i]-m_b_stmin[i]!=0)
-    {
-      if (m_b_phimax[i]<m_b_phimin[i]) m_b_phimax[i]+=8*atan(1.);
+    if (m_dbgtree) m_dbgtree->Fill(); 
+  }
+}
 
-      phi_seg = (m_b_phimax[i]-m_b_phimin[i])/(m_b_stmax[i]-m_b_stmin[i]);
 
-      m_b_phimin[i] = m_b_phimin[i] - (m_b_stmin[i]+0.5)*phi_seg;
-      m_b_phimax[i] = m_b_phimin[i] + m_b_nstrip[i]*phi_seg;
+// The rate corresponding to n stubs. The rates used to be obtained by adding 
+// fact for each stub, the same float sums are kept in m_rate_sum in order to 
+// get exactly the same values
 
-      if (m_b_phimin[i]<4*atan(1.) && m_b_phimax[i]>4*atan(1.)) m_b_phimax[i]-=8*atan(1.);  
-    }
+float rates::count2rate(int n, double fact)
+{
+  float sum;
 
-    for (int j=0;j<16;++j) 
+  while (static_cast<int>(m_rate_sum.size())<=n)
+  {
+    sum  = m_rate_sum.back();
+    sum += fact;
+    m_rate_sum.push_back(sum);
+  }
+
+  return m_rate_sum.at(n);
+}
+
+
+// The L1Rates tree keeps the B_id/E_id indexed arrays, which are only 
+// built here, just before the fill
+
+void rates::fillRateTree()
+{
+  std::vector<float> b_rate(16*58000,0.);
+  std::vector<int>   b_c_max(16*58000,0);
+  std::vector<int>   b_max(58000,0);
+  std::vector<float> b_rate_p(58000,0.);
+  std::vector<float> b_rate_pp(58000,0.);
+  std::vector<float> b_rate_s(58000,0.);
+  std::vector<float> b_rate_f(58000,0.);
+  std::vector<float> b_phimin(58000,1000.);
+  std::vector<float> b_phimax(58000,-1000.);
+  std::vector<float> b_etamin(58000,1000.);
+  std::vector<float> b_etamax(58000,-1000.);
+  std::vector<float> b_crate(58000,0.);
+  std::vector<float> b_drate(58000,0.);
+
+  std::vector<float> e_rate(16*142000,0.);
+  std::vector<float> e_rate_p(142000,0.);
+  std::vector<float> e_rate_pp(142000,0.);
+  std::vector<float> e_rate_s(142000,0.);
+  std::vector<float> e_rate_f(142000,0.);
+  std::vector<float> e_phimin(142000,1000.);
+  std::vector<float> e_phimax(142000,-1000.);
+  std::vector<float> e_etamin(142000,1000.);
+  std::vector<float> e_etamax(142000,-1000.);
+  std::vector<float> e_crate(142000,0.);
+  std::vector<float> e_drate(142000,0.);
+
+  int code,i;
+
+  for (int im=0;im<m_modules.size();++im)
+  {
+    rates_module &mod = m_mod_rates[im];
+
+    code = m_modules.code(im);
+
+    if (ModuleIndex::isBarrel(code))
     {
-      m_disk= 0;
-      m_lay = static_cast<int>(i/10000);
-      m_lad = static_cast<int>((i-10000*m_lay)/100);
-      m_mod = static_cast<int>((i-10000*m_lay-100*m_lad));
-      m_sen = j/8+1;
-      m_chp = j%8+1;
-      m_rate= m_b_rate[j][i];
-      m_ss = 0; 
-      m_cbc_ss = 0;
-      m_dbgtree->Fill(); 
+      i = code-ModuleIndex::barrelCode(0);
+
+      if (i>=58000) continue;
+
+      for (int j=0;j<16;++j) b_rate[j*58000+i]  = mod.rate[j];
+      for (int j=0;j<16;++j) b_c_max[j*58000+i] = mod.c_max[j];
+      b_max[i]     = mod.max;
+      b_rate_p[i]  = mod.rate_p;
+      b_rate_pp[i] = mod.rate_pp;
+      b_rate_s[i]  = mod.rate_s;
+      b_rate_f[i]  = mod.rate_f;
+      b_phimin[i]  = mod.phimin;
+      b_phimax[i]  = mod.phimax;
+      b_etamin[i]  = mod.etamin;
+      b_etamax[i]  = mod.etamax;
+      b_crate[i]   = mod.crate;
+    }
+    else
+    {
+      i = code-ModuleIndex::endcapCode(0);
+
+      for (int j=0;j<16;++j) e_rate[j*142000+i] = mod.rate[j];
+      e_rate_p[i]  = mod.rate_p;
+      e_rate_pp[i] = mod.rate_pp;
+      e_rate_s[i]  = mod.rate_s;
+      e_rate_f[i]  = mod.rate_f;
+      e_phimin[i]  = mod.phimin;
+      e_phimax[i]  = mod.phimax;
+      e_etamin[i]  = mod.etamin;
+      e_etamax[i]  = mod.etamax;
+      e_crate[i]   = mod.crate;
     }
   }
 
-  for (int i=0;i<140000;++i) // Endcap
+  m_ratetree->Branch("STUB_b_rates",         &b_rate[0],      "STUB_b_rates[16][58000]/F");
+  m_ratetree->Branch("STUB_b_c_max",         &b_c_max[0],     "STUB_b_c_max[16][58000]/I");
+  m_ratetree->Branch("STUB_b_max",           &b_max[0],       "STUB_b_max[58000]/I");
+  m_ratetree->Branch("STUB_b_rates_prim2",   &b_rate_pp[0],   "STUB_b_rates_prim2[58000]/F"); 
+  m_ratetree->Branch("STUB_b_rates_prim",    &b_rate_p[0],    "STUB_b_rates_prim[58000]/F"); 
+  m_ratetree->Branch("STUB_b_rates_sec",     &b_rate_s[0],    "STUB_b_rates_sec[58000]/F"); 
+  m_ratetree->Branch("STUB_b_rates_f",       &b_rate_f[0],    "STUB_b_rates_fake[58000]/F"); 
+  m_ratetree->Branch("STUB_b_phi_b",         &b_phimin[0],    "STUB_b_phi_b[58000]/F"); 
+  m_ratetree->Branch("STUB_b_phi_t",         &b_phimax[0],    "STUB_b_phi_t[58000]/F"); 
+  m_ratetree->Branch("STUB_b_eta_b",         &b_etamin[0],    "STUB_b_eta_b[58000]/F"); 
+  m_ratetree->Branch("STUB_b_eta_t",         &b_etamax[0],    "STUB_b_eta_t[58000]/F"); 
+  m_ratetree->Branch("CLUS_b_rates",         &b_crate[0],     "CLUS_b_rates[58000]/F");
+  m_ratetree->Branch("DIGI_b_rates",         &b_drate[0],     "DIGI_b_rates[58000]/F");
+  m_ratetree->Branch("STUB_b_l_rates",       &m_b_byls_rate,  "STUB_b_l_rates[600]/F");
+  m_ratetree->Branch("CLUS_b_l_rates",       &m_b_bylc_rate,  "CLUS_b_l_rates[600]/F");
+
+  m_ratetree->Branch("STUB_e_rates",         &e_rate[0],      "STUB_e_rates[16][142000]/F");
+  m_ratetree->Branch("STUB_e_rates_prim2",   &e_rate_pp[0],   "STUB_e_rates_prim2[142000]/F"); 
+  m_ratetree->Branch("STUB_e_rates_prim",    &e_rate_p[0],    "STUB_e_rates_prim[142000]/F"); 
+  m_ratetree->Branch("STUB_e_rates_sec",     &e_rate_s[0],    "STUB_e_rates_sec[142000]/F"); 
+  m_ratetree->Branch("STUB_e_rates_f",       &e_rate_f[0],    "STUB_e_rates_fake[142000]/F"); 
+  m_ratetree->Branch("STUB_e_phi_b",         &e_phimin[0],    "STUB_e_phi_b[142000]/F"); 
+  m_ratetree->Branch("STUB_e_phi_t",         &e_phimax[0],    "STUB_e_phi_t[142000]/F"); 
+  m_ratetree->Branch("STUB_e_eta_b",         &e_etamin[0],    "STUB_e_eta_b[142000]/F"); 
+  m_ratetree->Branch("STUB_e_eta_t",         &e_etamax[0],    "STUB_e_eta_t[142000]/F"); 
+  m_ratetree->Branch("CLUS_e_rates",         &e_crate[0],     "CLUS_e_rates[142000]/F");
+  m_ratetree->Branch("DIGI_e_rates",         &e_drate[0],     "DIGI_e_rates[142000]/F");
+  m_ratetree->Branch("STUB_e_l_rates",       &m_e_byls_rate,  "STUB_e_l_rates[1500]/F");
+  m_ratetree->Branch("CLUS_e_l_rates",       &m_e_bylc_rate,  "CLUS_e_l_rates[1500]/F");
+
+  m_ratetree->Fill();  
+
+  m_ratetree->ResetBranchAddresses(); // The buffers are local
+}
+
+
+/////////////////////////////////////////////////////////////
+//
+// The thread accumulators
+//
+/////////////////////////////////////////////////////////////
+
+
+rates_count::rates_count()
+{
+  for (int j=0;j<16;++j) rate[j]       = 0;
+  for (int j=0;j<16;++j) c_max[j]      = 0;
+  for (int j=0;j<16;++j) tempo_c_ps[j] = 0;
+  for (int j=0;j<16;++j) tempo_c_ss[j] = 0;
+
+  max     = 0;
+  rate_p  = 0;
+  rate_pp = 0;
+  rate_s  = 0;
+  rate_f  = 0;
+  crate   = 0;
+  etamin  = 1000.;
+  etamax  = -1000.;
+  phimin  = 1000.;
+  phimax  = -1000.;
+  stmin   = 2000.;
+  stmax   = -2000.;
+  segmin  = 2000.;
+  segmax  = -2000.;
+  nseg    = 0.;
+  nstrip  = 0.;
+
+  tempo_ps     = 0;
+  tempo_ss     = 0;
+  n_conc_half1 = 0;
+  n_conc_half2 = 0;
+  conc_stamp   = 0;
+}
+
+
+rates_acc::rates_acc()
+{
+  L1TT = 0;
+
+  m_mod_counts.clear();
+
+  for (int i=0;i<600;++i)
+  {
+    m_b_bylc_rate[i] = 0;
+    m_b_byls_rate[i] = 0;
+  }
+
+  for (int i=0;i<1500;++i)
+  {
+    m_e_bylc_rate[i] = 0;
+    m_e_byls_rate[i] = 0;
+  }
+}
+
+
+int rates_acc::module(int code)
+{
+  int idx = m_modules.add(code);
+
+  if (idx>=static_cast<int>(m_mod_counts.size())) m_mod_counts.push_back(rates_count());
+
+  return idx;
+}
+
+
+// Add the results of the following block of events. The result is the 
+// same as if the two blocks were processed one after the other: numbers
+// are added, and for the min/max bookkeeping the value (and its associated
+// phi/eta) of next is taken only if it is strictly better, as in the loop
+
+void rates_acc::merge(rates_acc *next)
+{
+  bool plusz; // Endcap +z modules have the opposite strip/phi and seg/eta conventions
+  int  code;
+
+  for (int in=0;in<next->m_modules.size();++in)
   {
-    if (m_e_rate_f[i]+m_e_rate_s[i]+m_e_rate_p[i]==0.) continue;
+    code = next->m_modules.code(in);
+
+    rates_count &nxt = next->m_mod_counts[in];
+    rates_count &mod = m_mod_counts[rates_acc::module(code)];
 
-    if (m_e_segmax[i]-m_e_segmin[i]!=0)
+    for (int j=0;j<16;++j) mod.rate[j] += nxt.rate[j];
+    mod.rate_p  += nxt.rate_p;
+    mod.rate_pp += nxt.rate_pp;
+    mod.rate_s  += nxt.rate_s;
+    mod.rate_f  += nxt.rate_f;
+    mod.crate   += nxt.crate;
+
+    if (nxt.max>mod.max)
     {
-      eta_seg = (m_e_etamax[i]-m_e_etamin[i])/(m_e_segmax[i]-m_e_segmin[i]);
-      m_e_etamin[i] = m_e_etamin[i] - (m_e_segmin[i]+0.5)*eta_seg;
-      m_e_etamax[i] = m_e_etamin[i] + m_e_nseg[i]*eta_seg;
+      mod.max=nxt.max;
+      for (int k=0;k<16;++k) mod.c_max[k] = nxt.c_max[k]; 
     }
 
+    if (nxt.rate_f+nxt.rate_s+nxt.rate_p==0) continue;
 
-    if (m_e_stmax[i]-m_e_stmin[i]!=0)
-    {
-      if (m_e_phimax[i]<m_e_phimin[i]) m_e_phimax[i]+=8*atan(1.);
+    mod.nseg   = nxt.nseg;
+    mod.nstrip = nxt.nstrip;
 
-      phi_seg = (m_e_phimax[i]-m_e_phimin[i])/(m_e_stmax[i]-m_e_stmin[i]);
+    // Barrel, or endcap with E_id = (disk-1)*10000 + ...
 
-      m_e_phimin[i] = m_e_phimin[i] - (m_e_stmin[i]+0.5)*phi_seg;
-      m_e_phimax[i] = m_e_phimin[i] + m_e_nstrip[i]*phi_seg;
+    plusz = (!ModuleIndex::isBarrel(code) && (code-ModuleIndex::endcapCode(0))/10000+1<=7); 
 
-      if (m_e_phimin[i]<4*atan(1.) && m_e_phimax[i]>4*atan(1.)) m_e_phimax[i]-=8*atan(1.);  
+    if (nxt.stmax>mod.stmax)
+    {
+      (plusz)
+	? mod.phimax=nxt.phimax
+	: mod.phimin=nxt.phimin; 
+      mod.stmax=nxt.stmax; 
     }
 
-    for (int j=0;j<16;++j) 
+    if (nxt.stmin<mod.stmin)
     {
-      m_disk= 1;
-      m_lay = static_cast<int>(i/10000);
-      m_lad = static_cast<int>((i-10000*m_lay)/100);
-      m_mod = static_cast<int>((i-10000*m_lay-100*m_lad));
-      m_sen = j/8+1;
-      m_chp = j%8+1;
-      m_rate= m_e_rate[j][i];
-      m_ss = 0; 
-      m_cbc_ss = 0;
-      m_dbgtree->Fill(); 
+      (plusz)
+	? mod.phimin=nxt.phimin
+	: mod.phimax=nxt.phimax; 
+      mod.stmin=nxt.stmin; 
     }
+
+    if (nxt.segmax>mod.segmax) 
+    {	  
+      (plusz)
+	? mod.etamax=nxt.etamax
+	: mod.etamin=nxt.etamin; 
+      mod.segmax=nxt.segmax; 	  
+    }
+
+    if (nxt.segmin<mod.segmin)
+    {
+      (plusz)
+	? mod.etamin=nxt.etamin
+	: mod.etamax=nxt.etamax; 
+      mod.segmin=nxt.segmin; 	  
+    }	
   }
 
-  // End of dbg loop, fill up root trees
+  for (int i=0;i<600;++i)
+  {
+    m_b_bylc_rate[i] += next->m_b_bylc_rate[i];
+    m_b_byls_rate[i] += next->m_b_byls_rate[i];
+  }
 
-  m_ratetree->Fill();  
-  m_outfile->Write();
-  delete L1TT;
-  delete m_outfile;
+  for (int i=0;i<1500;++i)
+  {
+    m_e_bylc_rate[i] += next->m_e_bylc_rate[i];
+    m_e_byls_rate[i] += next->m_e_byls_rate[i];
+  }
+
+  m_evts.insert(m_evts.end(),next->m_evts.begin(),next->m_evts.end());
 }
 
 
+
+
+
 /////////////////////////////////////////////////////////////
 //
 // Basic methods, initializations,...
@@ -478,28 +924,8 @@ void rates::get_rates()
 
 void rates::initVars()
 {
-  for (int i=0;i<58000;++i)
-  {
-    for (int j=0;j<16;++j) m_b_rate[j][i]   = 0.;
-    for (int j=0;j<16;++j) m_b_c_max[j][i]   = 0;
-    m_b_max[i]    = 0;
-    m_b_rate_p[i] = 0.;
-    m_b_rate_pp[i] = 0.;
-    m_b_rate_s[i] = 0.;
-    m_b_rate_f[i] = 0.;
-    m_b_etamin[i] = 1000.;
-    m_b_etamax[i] = -1000.;
-    m_b_phimin[i] = 1000.;
-    m_b_phimax[i] = -1000.;
-    m_b_stmin[i]  = 2000.;
-    m_b_stmax[i]  = -2000.;
-    m_b_segmin[i] = 2000.;
-    m_b_segmax[i] = -2000.;
-    m_b_nseg[i]   = 0.;
-    m_b_nstrip[i] = 0.;
-    m_b_crate[i]  = 0.;
-    m_b_drate[i]  = 0.;
-  }
+  m_modules.clear();
+  m_mod_rates.clear();
 
   for (int i=0;i<600;++i)
   {
@@ -512,27 +938,6 @@ void rates::initVars()
     m_e_bylc_rate[i] = 0.;
     m_e_byls_rate[i] = 0.;
   }
-
-  for (int i=0;i<142000;++i)
-  {
-    for (int j=0;j<16;++j) m_e_rate[j][i]   = 0.;
-    m_e_rate_p[i] = 0.;
-    m_e_rate_pp[i] = 0.;
-    m_e_rate_s[i] = 0.;
-    m_e_rate_f[i] = 0.;
-    m_e_etamin[i] = 1000.;
-    m_e_etamax[i] = -1000.;
-    m_e_phimin[i] = 1000.;
-    m_e_phimax[i] = -1000.;
-    m_e_stmin[i]  = 2000.;
-    m_e_stmax[i]  = -2000.;
-    m_e_segmin[i] = 2000.;
-    m_e_segmax[i] = -2000.;
-    m_e_nseg[i]   = 0.;
-    m_e_nstrip[i] = 0.;
-    m_e_crate[i]  = 0.;
-    m_e_drate[i]  = 0.;
-  }
 }
 
 
@@ -548,7 +953,7 @@ void rates::initTuple(std::string in,std::string out)
   // Case 1, it's a root file
   if (found!=std::string::npos)
   {
-    L1TT->Add(in.c_str());
+    m_files.push_back(in);
   }
   else // This is a list provided into a text file
   {
@@ -565,107 +970,26 @@ void rates::initTuple(std::string in,std::string out)
       getline(in2,STRING);
 
       found = STRING.find(".root");
-      if (found!=std::string::npos) L1TT->Add(STRING.c_str());
+      if (found!=std::string::npos) m_files.push_back(STRING);
     }
 
     in2.close();
   }
 
-  
-  pm_clus_x=&m_clus_x;
-  pm_clus_y=&m_clus_y;
-  pm_clus_z=&m_clus_z;
-  pm_clus_layer=&m_clus_layer;
-  pm_clus_ladder=&m_clus_ladder;
-  pm_clus_module=&m_clus_module;
-  pm_clus_nrows=&m_clus_nrows;
-  pm_clus_nseg=&m_clus_nseg;
-
-  pm_stub_layer=&m_stub_layer;
-  pm_stub_ladder=&m_stub_ladder;
-  pm_stub_module=&m_stub_module;
-  pm_stub_tp=&m_stub_tp;
-  pm_stub_pt=&m_stub_pt;
-  pm_stub_pxGEN=&m_stub_pxGEN;
-  pm_stub_pyGEN=&m_stub_pyGEN;
-  pm_stub_etaGEN=&m_stub_etaGEN;
-  pm_stub_X0=&m_stub_X0;
-  pm_stub_Y0=&m_stub_Y0;
-  pm_stub_x=&m_stub_x;
-  pm_stub_y=&m_stub_y;
-  pm_stub_z=&m_stub_z;
-  pm_stub_strip=&m_stub_strip;
-  pm_stub_seg=&m_stub_seg;
-  pm_stub_chip=&m_stub_chip;
-  pm_stub_pdgID=&m_stub_pdgID;
-  pm_stub_clust1=&m_stub_clust1;
-
-
-  L1TT->SetBranchAddress("STUB_n",         &m_stub);
-  L1TT->SetBranchAddress("STUB_layer",     &pm_stub_layer);
-  L1TT->SetBranchAddress("STUB_ladder",    &pm_stub_ladder);
-  L1TT->SetBranchAddress("STUB_module",    &pm_stub_module);
-  L1TT->SetBranchAddress("STUB_pxGEN",     &pm_stub_pxGEN);
-  L1TT->SetBranchAddress("STUB_pyGEN",     &pm_stub_pyGEN);
-  L1TT->SetBranchAddress("STUB_etaGEN",    &pm_stub_etaGEN);
-  L1TT->SetBranchAddress("STUB_tp",        &pm_stub_tp);
-  L1TT->SetBranchAddress("STUB_pt",        &pm_stub_pt);
-  L1TT->SetBranchAddress("STUB_X0",        &pm_stub_X0);
-  L1TT->SetBranchAddress("STUB_Y0",        &pm_stub_Y0);
-  L1TT->SetBranchAddress("STUB_x",         &pm_stub_x);
-  L1TT->SetBranchAddress("STUB_y",         &pm_stub_y);
-  L1TT->SetBranchAddress("STUB_z",         &pm_stub_z);
-  L1TT->SetBranchAddress("STUB_strip",     &pm_stub_strip);
-  L1TT->SetBranchAddress("STUB_seg",       &pm_stub_seg);
-  L1TT->SetBranchAddress("STUB_chip",      &pm_stub_chip);
-  L1TT->SetBranchAddress("STUB_pdgID",     &pm_stub_pdgID);
-  L1TT->SetBranchAddress("STUB_clust1",    &pm_stub_clust1);
-
-  L1TT->SetBranchAddress("CLUS_n",         &m_clus);
-  L1TT->SetBranchAddress("CLUS_layer",     &pm_clus_layer);
-  L1TT->SetBranchAddress("CLUS_ladder",    &pm_clus_ladder);
-  L1TT->SetBranchAddress("CLUS_module",    &pm_clus_module);
-  L1TT->SetBranchAddress("CLUS_x",         &pm_clus_x);
-  L1TT->SetBranchAddress("CLUS_y",         &pm_clus_y);
-  L1TT->SetBranchAddress("CLUS_z",         &pm_clus_z);
-  L1TT->SetBranchAddress("CLUS_nrows",     &pm_clus_nrows);
-  L1TT->SetBranchAddress("CLUS_PS",        &pm_clus_nseg);
+
+  for (unsigned int i=0;i<m_files.size();++i) L1TT->Add(m_files.at(i).c_str());
+
+  m_outfile  = 0;
+  m_ratetree = 0;
+  m_dbgtree  = 0;
+
+  if (out=="") return; // Rates kept in memory only
 
   m_outfile  = new TFile(out.c_str(),"recreate");
   m_ratetree = new TTree("L1Rates","L1Rates info");
   m_dbgtree  = new TTree("Details","Debug");
 
 
-  m_ratetree->Branch("STUB_b_rates",         &m_b_rate,      "STUB_b_rates[16][58000]/F");
-  m_ratetree->Branch("STUB_b_c_max",         &m_b_c_max,     "STUB_b_c_max[16][58000]/I");
-  m_ratetree->Branch("STUB_b_max",           &m_b_max,       "STUB_b_max[58000]/I");
-  m_ratetree->Branch("STUB_b_rates_prim2",   &m_b_rate_pp,   "STUB_b_rates_prim2[58000]/F"); 
-  m_ratetree->Branch("STUB_b_rates_prim",    &m_b_rate_p,    "STUB_b_rates_prim[58000]/F"); 
-  m_ratetree->Branch("STUB_b_rates_sec",     &m_b_rate_s,    "STUB_b_rates_sec[58000]/F"); 
-  m_ratetree->Branch("STUB_b_rates_f",       &m_b_rate_f,    "STUB_b_rates_fake[58000]/F"); 
-  m_ratetree->Branch("STUB_b_phi_b",         &m_b_phimin,    "STUB_b_phi_b[58000]/F"); 
-  m_ratetree->Branch("STUB_b_phi_t",         &m_b_phimax,    "STUB_b_phi_t[58000]/F"); 
-  m_ratetree->Branch("STUB_b_eta_b",         &m_b_etamin,    "STUB_b_eta_b[58000]/F"); 
-  m_ratetree->Branch("STUB_b_eta_t",         &m_b_etamax,    "STUB_b_eta_t[58000]/F"); 
-  m_ratetree->Branch("CLUS_b_rates",         &m_b_crate,     "CLUS_b_rates[58000]/F");
-  m_ratetree->Branch("DIGI_b_rates",         &m_b_drate,     "DIGI_b_rates[58000]/F");
-  m_ratetree->Branch("STUB_b_l_rates",       &m_b_byls_rate, "STUB_b_l_rates[600]/F");
-  m_ratetree->Branch("CLUS_b_l_rates",       &m_b_bylc_rate, "CLUS_b_l_rates[600]/F");
-
-  m_ratetree->Branch("STUB_e_rates",         &m_e_rate,      "STUB_e_rates[16][142000]/F");
-  m_ratetree->Branch("STUB_e_rates_prim2",    &m_e_rate_pp,    "STUB_e_rates_prim2[142000]/F"); 
-  m_ratetree->Branch("STUB_e_rates_prim",    &m_e_rate_p,    "STUB_e_rates_prim[142000]/F"); 
-  m_ratetree->Branch("STUB_e_rates_sec",     &m_e_rate_s,    "STUB_e_rates_sec[142000]/F"); 
-  m_ratetree->Branch("STUB_e_rates_f",       &m_e_rate_f,    "STUB_e_rates_fake[142000]/F"); 
-  m_ratetree->Branch("STUB_e_phi_b",         &m_e_phimin,    "STUB_e_phi_b[142000]/F"); 
-  m_ratetree->Branch("STUB_e_phi_t",         &m_e_phimax,    "STUB_e_phi_t[142000]/F"); 
-  m_ratetree->Branch("STUB_e_eta_b",         &m_e_etamin,    "STUB_e_eta_b[142000]/F"); 
-  m_ratetree->Branch("STUB_e_eta_t",         &m_e_etamax,    "STUB_e_eta_t[142000]/F"); 
-  m_ratetree->Branch("CLUS_e_rates",         &m_e_crate,     "CLUS_e_rates[142000]/F");
-  m_ratetree->Branch("DIGI_e_rates",         &m_e_drate,     "DIGI_e_rates[142000]/F");
-  m_ratetree->Branch("STUB_e_l_rates",       &m_e_byls_rate, "STUB_e_l_rates[1500]/F");
-  m_ratetree->Branch("CLUS_e_l_rates",       &m_e_bylc_rate, "CLUS_e_l_rates[1500]/F");
-
   m_dbgtree->Branch("disk",        &m_disk,   "disk/I"); 
   m_dbgtree->Branch("lay",         &m_lay,    "lay/I"); 
   m_dbgtree->Branch("lad",         &m_lad,    "lad/I"); 
@@ -679,3 +1003,77 @@ void rates::initTuple(std::string in,std::string out)
   m_dbgtree->Branch("bar_c_mult",  &m_bar_clus,"m_bar_clus[6]/I"); 
   m_dbgtree->Branch("bar_s_mult",  &m_bar_stub,"m_bar_stub[6]/I"); 
 }
+
+
+// Each thread reads the data with its own chain, connected to the acc buffers.
+// The chain creation is protected, as ROOT is not thread-safe at this level
+
+void rates::connect(rates_acc *acc)
+{
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  acc->L1TT = new TChain("L1TrackTrigger"); 
+
+  for (unsigned int i=0;i<m_files.size();++i) acc->L1TT->Add(m_files.at(i).c_str());
+
+  acc->pm_clus_x=&acc->m_clus_x;
+  acc->pm_clus_y=&acc->m_clus_y;
+  acc->pm_clus_z=&acc->m_clus_z;
+  acc->pm_clus_layer=&acc->m_clus_layer;
+  acc->pm_clus_ladder=&acc->m_clus_ladder;
+  acc->pm_clus_module=&acc->m_clus_module;
+  acc->pm_clus_nrows=&acc->m_clus_nrows;
+  acc->pm_clus_nseg=&acc->m_clus_nseg;
+
+  acc->pm_stub_layer=&acc->m_stub_layer;
+  acc->pm_stub_ladder=&acc->m_stub_ladder;
+  acc->pm_stub_module=&acc->m_stub_module;
+  acc->pm_stub_tp=&acc->m_stub_tp;
+  acc->pm_stub_pt=&acc->m_stub_pt;
+  acc->pm_stub_pxGEN=&acc->m_stub_pxGEN;
+  acc->pm_stub_pyGEN=&acc->m_stub_pyGEN;
+  acc->pm_stub_etaGEN=&acc->m_stub_etaGEN;
+  acc->pm_stub_X0=&acc->m_stub_X0;
+  acc->pm_stub_Y0=&acc->m_stub_Y0;
+  acc->pm_stub_x=&acc->m_stub_x;
+  acc->pm_stub_y=&acc->m_stub_y;
+  acc->pm_stub_z=&acc->m_stub_z;
+  acc->pm_stub_strip=&acc->m_stub_strip;
+  acc->pm_stub_seg=&acc->m_stub_seg;
+  acc->pm_stub_chip=&acc->m_stub_chip;
+  acc->pm_stub_pdgID=&acc->m_stub_pdgID;
+  acc->pm_stub_clust1=&acc->m_stub_clust1;
+
+
+  acc->L1TT->SetBranchAddress("STUB_n",         &acc->m_stub);
+  acc->L1TT->SetBranchAddress("STUB_layer",     &acc->pm_stub_layer);
+  acc->L1TT->SetBranchAddress("STUB_ladder",    &acc->pm_stub_ladder);
+  acc->L1TT->SetBranchAddress("STUB_module",    &acc->pm_stub_module);
+  acc->L1TT->SetBranchAddress("STUB_pxGEN",     &acc->pm_stub_pxGEN);
+  acc->L1TT->SetBranchAddress("STUB_pyGEN",     &acc->pm_stub_pyGEN);
+  acc->L1TT->SetBranchAddress("STUB_etaGEN",    &acc->pm_stub_etaGEN);
+  acc->L1TT->SetBranchAddress("STUB_tp",        &acc->pm_stub_tp);
+  acc->L1TT->SetBranchAddress("STUB_pt",        &acc->pm_stub_pt);
+  acc->L1TT->SetBranchAddress("STUB_X0",        &acc->pm_stub_X0);
+  acc->L1TT->SetBranchAddress("STUB_Y0",        &acc->pm_stub_Y0);
+  acc->L1TT->SetBranchAddress("STUB_x",         &acc->pm_stub_x);
+  acc->L1TT->SetBranchAddress("STUB_y",         &acc->pm_stub_y);
+  acc->L1TT->SetBranchAddress("STUB_z",         &acc->pm_stub_z);
+  acc->L1TT->SetBranchAddress("STUB_strip",     &acc->pm_stub_strip);
+  acc->L1TT->SetBranchAddress("STUB_seg",       &acc->pm_stub_seg);
+  acc->L1TT->SetBranchAddress("STUB_chip",      &acc->pm_stub_chip);
+  acc->L1TT->SetBranchAddress("STUB_pdgID",     &acc->pm_stub_pdgID);
+  acc->L1TT->SetBranchAddress("STUB_clust1",    &acc->pm_stub_clust1);
+
+  acc->L1TT->SetBranchAddress("CLUS_n",         &acc->m_clus);
+  acc->L1TT->SetBranchAddress("CLUS_layer",     &acc->pm_clus_layer);
+  acc->L1TT->SetBranchAddress("CLUS_ladder",    &acc->pm_clus_ladder);
+  acc->L1TT->SetBranchAddress("CLUS_module",    &acc->pm_clus_module);
+  acc->L1TT->SetBranchAddress("CLUS_x",         &acc->pm_clus_x);
+  acc->L1TT->SetBranchAddress("CLUS_y",         &acc->pm_clus_y);
+  acc->L1TT->SetBranchAddress("CLUS_z",         &acc->pm_clus_z);
+  acc->L1TT->SetBranchAddress("CLUS_nrows",     &acc->pm_clus_nrows);
+  acc->L1TT->SetBranchAddress("CLUS_PS",        &acc->pm_clus_nseg);
+
+  ChainReader::optimize(acc->L1TT); // Only the branches above are read
+}
@@ -14,10 +14,15 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TChain.h"
+#include "TThread.h"
+#include "ModuleIndex.h"
+#include "ChainReader.h"
 
 #include <fstream>
 #include <string>
 #include <sstream> 
+#include <thread>
+#include <mutex>
 
 using namespace std;
 
@@ -29,7 +34,8 @@ using namespace std;
 // Input infos are :
 //
 // filename : the name and directory of the input ROOT file containing the STUB information
-// outfile  : the name of the output ROOT file containing the rates 
+// outfile  : the name of the output ROOT file containing the rates (if empty, no file is
+//            written, the rates are only kept in memory, see modules()/moduleRates())
 //
 // Info about the code:
 //
@@ -38,6 +44,11 @@ using namespace std;
 // This code was developped for the BE classic geometry, but also works for 
 // the 5 disks alternative
 //
+// nthreads : the number of threads used for the event loop (the entries are 
+//            cut in contiguous blocks, each thread has its own rates_acc, and 
+//            the accumulators are merged in the block order, so the output 
+//            does not depend on the number of threads)
+//
 //  Author: viret@in2p3_dot_fr
 //  Date: 23/05/2013
 //
@@ -45,98 +56,114 @@ using namespace std;
 
 
 
-class rates
+// Info stored for the Details tree, for each event containing stubs
+
+struct rates_evt
 {
- public:
+  int   disk;
+  float rate;
+  int   ss;
+  int   cbc_ss;
+  int   bar_clus[6];
+  int   bar_stub[6];
+};
 
-  rates(std::string filename, std::string outfile);
 
-  void  get_rates();  // The main method  
-  void  initVars();
-  void  initTuple(std::string in,std::string out);
+// Per-module info, for the modules of the ModuleIndex (see ModuleIndex.h)
 
- private:
+struct rates_count // Numbers of stubs/clusters, plus the per-event work tables (rates_acc)
+{
+  rates_count();
+
+  int   rate[16];    // Stubs per chip
+  int   c_max[16];   // Chip contents for the event with the max number of stubs
+  int   max;         // Max number of stubs in one event
+  int   rate_p;      // Primary stubs
+  int   rate_pp;     // Primary stubs with pT>2GeV
+  int   rate_s;      // Secondary stubs
+  int   rate_f;      // Fake stubs
+  int   crate;       // Clusters
+
+  float etamin;      // Eta of the stubs with the max and min segment (see rates::process_events)
+  float etamax;
+  float phimin;      // Phi of the stubs with the max and min strip
+  float phimax;
+  float stmin;       // Min/max strip number
+  float stmax;
+  float segmin;      // Min/max segment number
+  float segmax;
+  float nseg;        // Number of segments in the module
+  float nstrip;      // Number of strips in the module
+
+  // Per-event work tables (barrel only)
+
+  int   tempo_ps;
+  int   tempo_ss;
+  int   n_conc_half1;
+  int   n_conc_half2;
+  int   conc_stamp;  // Last group of 8 events (j/8+1) where the module was added in m_conc_touched
+  int   tempo_c_ps[16];
+  int   tempo_c_ss[16];
+};
 
-  TChain *L1TT;      // The trees containing the input data
+struct rates_module // Final rates (in stubs/bx) and position (rates::m_mod_rates)
+{
+  float rate[16];  
+  int   c_max[16]; 
+  int   max;
+  float rate_p;
+  float rate_pp;
+  float rate_s;
+  float rate_f;
+  float crate;
+  float etamin;
+  float etamax;
+  float phimin;
+  float phimax;
+  float stmin;
+  float stmax;
+  float segmin;
+  float segmax;
+  float nseg;
+  float nstrip;
+};
 
-  TFile *m_outfile;  // The output file
-  TTree *m_ratetree; // The tree containing the rate information
-  TTree *m_dbgtree;  // Debug tree 
 
-  // Coding conventions for barrel and endcap module IDs
-  
-  // We define a barrel ID and an endcap ID as follows:
+// Everything one thread of rates::get_rates needs: its own chain and branch 
+// buffers, the per-event work tables, and the accumulators. The accumulators
+// contain numbers of stubs/clusters, they are converted to rates (in stubs/bx) 
+// once all the blocks are merged (see rates::reduce) 
+//
+// Only the modules seen by the thread are in its tables, in the order they were found
 
-  // B_id = (layer-1)*10000 + ladder*100 + module (0 to 57523)
+class rates_acc
+{
+ public:
 
-  // E_id = (disk-1)*10000 + ladder*100 + module (0 to 131377)
+  rates_acc();
 
-  // Disks 0 to 6  (towards positive Z)  (0 to  4 for 5D)
-  // Disks 7 to 13 (towards negative Z)  (7 to 11 for 5D)
+  int  module(int code);       // Index of the module in m_mod_counts (created if needed, -1 if code is invalid)
+  void merge(rates_acc *next); // Adds the block following this one
 
+  TChain *L1TT;
 
-  // Following tables are for rates
-  float m_b_rate[16][58000]; // Contains the barrel chips module rates (in stubs/bx)
-  int   m_b_c_max[16][58000]; 
-  int   m_b_max[58000];     
-  float m_b_rate_p[58000];   // Contains the barrel primary stubs module rates (in stubs/bx)
-  float m_b_rate_pp[58000];   // Contains the barrel primary stubs module rates (in stubs/bx)
-  float m_b_rate_s[58000];   // Contains the barrel secondary stubs module rates (in stubs/bx)
-  float m_b_rate_f[58000];   // Contains the barrel fake stubs module rates (in stubs/bx)
-  float m_b_crate[58000];    // Contains the barrel cluster module rates (in stubs/bx)
-  float m_b_drate[58000];    // Contains the barrel digi module rates (in stubs/bx)
-  float m_b_bylc_rate[600];  // Contains the barrel clus ladder rates (in stubs/bx)
-  float m_b_byls_rate[600];  // Contains the barrel clus ladder rates (in stubs/bx)
- 
-  float m_e_rate[16][142000];// Contains the endcap chips module rates (in stubs/bx)
-  float m_e_rate_p[142000];  // Contains the endcap primary stubs module rates (in stubs/bx)
-  float m_e_rate_pp[142000];  // Contains the endcap primary stubs module rates (in stubs/bx)
-  float m_e_rate_s[142000];  // Contains the endcap secondary stubs module rates (in stubs/bx)
-  float m_e_rate_f[142000];  // Contains the endcap fake stubs module rates (in stubs/bx)
-  float m_e_crate[142000];    // Contains the barrel cluster module rates (in stubs/bx)
-  float m_e_drate[142000];    // Contains the barrel digi module rates (in stubs/bx)
-  float m_e_bylc_rate[1500];  // Contains the barrel clus ladder rates (in stubs/bx)
-  float m_e_byls_rate[1500];  // Contains the barrel clus ladder rates (in stubs/bx)
+  ModuleIndex              m_modules;
+  std::vector<rates_count> m_mod_counts;
 
-  // Following tables are for sector definition
-  float m_b_etamin[58000];   // Contains the barrel module min eta value
-  float m_b_etamax[58000];   // Contains the barrel module max eta value
-  float m_b_phimin[58000];   // Contains the barrel module min phi value
-  float m_b_phimax[58000];   // Contains the barrel module max phi value
-  float m_e_etamin[142000];  // Contains the endcap module min eta value
-  float m_e_etamax[142000];  // Contains the endcap module max eta value
-  float m_e_phimin[142000];  // Contains the endcap module min phi value
-  float m_e_phimax[142000];  // Contains the endcap module max phi value
-  float m_e_stmin[142000];   // Minimum strip number 
-  float m_e_stmax[142000];   // Maximum strip number 
-  float m_e_segmin[142000];  // Minimum segment number  
-  float m_e_segmax[142000];  // Maximum segment number   
-  float m_e_nseg[142000];    // Number of segments in the module  
-  float m_e_nstrip[142000];  // Number of strips in the module  
-  float m_b_stmin[58000];    // 
-  float m_b_stmax[58000];    //
-  float m_b_segmin[58000];   // Idem for barrel
-  float m_b_segmax[58000];   //
-  float m_b_nseg[58000];     // 
-  float m_b_nstrip[58000];   // 
-
-  int tempo_ps_b[58000];   //
-  int tempo_ss_b[58000];   //
-
-  int n_conc_half1[58000];
-  int n_conc_half2[58000];
-
-  int tempo_c_ps_b[16][58000];   //
-  int tempo_c_ss_b[16][58000];   //
+  int   m_b_bylc_rate[600]; 
+  int   m_b_byls_rate[600]; 
+  int   m_e_bylc_rate[1500]; 
+  int   m_e_byls_rate[1500]; 
 
-  int evt_maxPSb;
-  int evt_maxSSb;
+  std::vector<rates_evt> m_evts; // Details tree info, in the event order
 
-  int evt_nsPSb;
-  int evt_nsSSb;
+  // The per-event work tables of m_mod_counts are kept at 0 outside of the modules 
+  // listed in m_touched (barrel modules with stubs in the current event) and 
+  // m_conc_touched (barrel modules with 2S stubs in the current group of 8 
+  // events), so that the per-event cost scales with the number of stubs
 
-  int n_max_PSb;
-  int n_max_SSb;
+  std::vector<int> m_touched;
+  std::vector<int> m_conc_touched;
 
   // Here are the parameters needed from the data
   // Details on these might be found on
@@ -144,7 +171,6 @@ class rates
   // https://github.com/sviret/HL_LHC/blob/master/Extractors/RecoExtractor/interface/L1TrackTrigger_analysis.h
   //
 
-
   int m_clus;
   std::vector<float> m_clus_x;
   std::vector<float> m_clus_y;
@@ -202,7 +228,75 @@ class rates
   std::vector<int>   *pm_stub_chip;
   std::vector<int>   *pm_stub_pdgID;
   std::vector<int>   *pm_stub_clust1;
+};
+
+
+class rates
+{
+ public:
+
+  rates(std::string filename, std::string outfile, int nthreads);
 
+  void  get_rates();  // The main method  
+  void  initVars();
+  void  initTuple(std::string in,std::string out);
+
+  void  connect(rates_acc *acc);                                  // Chain of one thread
+  void  process_events(rates_acc *acc, int first, int last);      // Event loop on a block
+  void  reduce(std::vector<rates_acc*> &accs, double fact);       // Merge and conversion to rates
+  float count2rate(int n, double fact);
+  void  fillRateTree();                                           // Module tables -> L1Rates arrays
+
+  // The final tables (modules sorted by code), as they are written in the L1Rates tree
+
+  const ModuleIndex               &modules() const     {return m_modules;}
+  const std::vector<rates_module> &moduleRates() const {return m_mod_rates;}
+
+ private:
+
+  int        m_nthreads;
+  std::mutex m_lock;                // For the chain creation and the printouts
+
+  std::vector<std::string> m_files; // The input files
+  std::vector<float> m_rate_sum;    // m_rate_sum[n] is fact added n times, as in the serial loop
+
+  TChain *L1TT;      // The trees containing the input data
+
+  TFile *m_outfile;  // The output file
+  TTree *m_ratetree; // The tree containing the rate information
+  TTree *m_dbgtree;  // Debug tree 
+
+  // Coding conventions for barrel and endcap module IDs
+  
+  // We define a barrel ID and an endcap ID as follows:
+
+  // B_id = (layer-1)*10000 + ladder*100 + module (0 to 57523)
+
+  // E_id = (disk-1)*10000 + ladder*100 + module (0 to 131377)
+
+  // Disks 0 to 6  (towards positive Z)  (0 to  4 for 5D)
+  // Disks 7 to 13 (towards negative Z)  (7 to 11 for 5D)
+
+
+  // Module dictionary (sorted by code) and the corresponding rate and 
+  // eta/phi tables (the L1Rates tree keeps the B_id/E_id arrays layout)
+
+  ModuleIndex               m_modules;
+  std::vector<rates_module> m_mod_rates;
+
+  float m_b_bylc_rate[600];  // Contains the barrel clus ladder rates (in stubs/bx)
+  float m_b_byls_rate[600];  // Contains the barrel clus ladder rates (in stubs/bx)
+  float m_e_bylc_rate[1500];  // Contains the barrel clus ladder rates (in stubs/bx)
+  float m_e_byls_rate[1500];  // Contains the barrel clus ladder rates (in stubs/bx)
+
+  int evt_maxPSb;
+  int evt_maxSSb;
+
+  int evt_nsPSb;
+  int evt_nsSSb;
+
+  int n_max_PSb;
+  int n_max_SSb;
 
   // Some parameters for the debug tree
 
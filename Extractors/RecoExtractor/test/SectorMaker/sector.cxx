@@ -13,40 +13,116 @@ sector::sector(std::string filename,std::string outfile, int neta,int nphi,int o
                  // its active area with the sector
                  // It is not taken into account
 
-  sector::initTuple(filename,outfile);
+  m_outname = outfile;
+
+  sector::initTuple(filename);
   sector::initVars();
   sector::do_sector();
+}
+
+sector::sector(const rates *r,std::string outfile, int neta,int nphi,int oeta,int ophi)
+{
+  m_nphi = nphi;
+  m_neta = neta;
+  m_ophi = ophi;
+  m_oeta = oeta;
+  m_cov  = 0.01; 
+
+  m_outname  = outfile;
+  m_infile   = 0;
+  m_ratetree = 0;
+
+  sector::readRates(r);
+  sector::initVars();
+  sector::do_sector();
+}
 
+sector::sector(std::string filename)
+{
+  m_nphi = 0;
+  m_neta = 0;
+  m_ophi = 0;
+  m_oeta = 0;
+  m_cov  = 0.01; 
+
+  sector::initTuple(filename);
+  sector::initVars();
 }
 
+sector::~sector()
+{
+  delete m_grid;
+}
+
+
 void sector::do_sector()
+{
+  float eta_size,phi_size,eta_step,phi_step;
+
+  sector::sizes(m_neta,m_nphi,m_oeta,m_ophi,eta_size,phi_size,eta_step,phi_step);
+
+  cout << m_neta << "/" << eta_size << "/" << eta_step << endl;
+  cout << m_nphi << "/" << phi_size << "/" << phi_step << endl;
+
+  sector_layout &lay = m_layout;
+
+  lay.neta = m_neta;
+  lay.nphi = m_nphi;
+  lay.oeta = m_oeta;
+  lay.ophi = m_ophi;
+
+  sector::make_layout(lay);
+
+  cout << "We have made " << lay.barrel.size() << " sectors " << endl; 
+
+  if (m_outname!="") sector::write_layout(lay,m_outname);
+}
+
+
+// Sector determination for the configuration (neta,nphi,oeta,ophi) of lay
+
+void sector::make_layout(sector_layout &lay) const
 {
   float phi_min;
   float phi_max;
   float eta_min;
   float eta_max;
 
-  // Get the rate information
-  m_ratetree->GetEntry(0);
+  float eta_size,phi_size,eta_step,phi_step;
 
-  float lay_rate[20];
+  float PI = 4.*atan(1.);
 
-  m_sec = 0;
+  int code,i,im;
+
+  std::vector<float> lay_rate(20);
+  std::vector<int>   cand;
+
+  float rate_tot;
+
+  sector::sizes(lay.neta,lay.nphi,lay.oeta,lay.ophi,eta_size,phi_size,eta_step,phi_step);
+
+  lay.barrel.clear();
+  lay.endcap.clear();
+  lay.sectors.clear();
+  lay.coords.clear();
+  lay.lay_rate.clear();
+  lay.rate.clear();
+  lay.counter.assign(m_modules.size(),0);
 
   // Loop over the sectors
-  for (int k=0;k<m_neta;++k)
+  for (int k=0;k<lay.neta;++k)
   { 
-    for (int j=0;j<m_nphi;++j)
+    for (int j=0;j<lay.nphi;++j)
     { 
       for (int i=0;i<20;++i) lay_rate[i]=0.;
-      m_rate_tot=0.;
+      rate_tot=0.;
 
       // Define The sector coordinates
 
-      phi_min = j*m_phi_step-m_phi_size/2.;;
-      phi_max = j*m_phi_step+m_phi_size/2.;
-      eta_min = -2.5+(k+0.5)*m_eta_step-m_eta_size/2.;
-      eta_max = -2.5+(k+0.5)*m_eta_step+m_eta_size/2.;
+      phi_min = j*phi_step-phi_size/2.;;
+      phi_max = j*phi_step+phi_size/2.;
+      eta_min = -2.5+(k+0.5)*eta_step-eta_size/2.;
+      eta_max = -2.5+(k+0.5)*eta_step+eta_size/2.;
 
       std::vector<int> barrel_mod;
       std::vector<int> endcap_mod;
@@ -59,82 +135,132 @@ void sector::do_sector()
       coord.clear();
       
       // Adapt to CMS coordinate system
-      if (phi_min>m_PI) phi_min-=2*m_PI;
-      if (phi_max>m_PI) phi_max-=2*m_PI;
+      if (phi_min>PI) phi_min-=2*PI;
+      if (phi_max>PI) phi_max-=2*PI;
       
       coord.push_back(phi_min);
       coord.push_back(phi_max);
       coord.push_back(eta_min);
       coord.push_back(eta_max);
       
-      // Loop over barrel modules to check if they are in the sector
-      for (int i=0;i<58000;++i)
-      { 
-	if (!sector::is_in_eta(m_b_etamax[i],m_b_etamin[i],eta_min,eta_max,m_cov)) continue;
-	if (!sector::is_in_phi(m_b_phimax[i],m_b_phimin[i],phi_min,phi_max,m_cov)) continue;
+      // Loop over the modules close to the sector to check if they are in it 
+      // (the candidates are sorted, so the barrel modules come first)
+      m_grid->candidates(eta_min,eta_max,phi_min,phi_max,cand);
 
-	// Module is in, add it...
-	lay_rate[i/10000]+=m_b_rate[i];
-	barrel_mod.push_back(i);
-	sector.push_back(i+50000);
-      }
-	
-      // Loop over endcap modules to check if they are in the sector
-      for (int i=0;i<142000;++i)
+      for (unsigned int l=0;l<cand.size();++l)
       { 
-	if (!sector::is_in_eta(m_e_etamax[i],m_e_etamin[i],eta_min,eta_max,m_cov)) continue;
-	if (!sector::is_in_phi(m_e_phimax[i],m_e_phimin[i],phi_min,phi_max,m_cov)) continue;
-	
+	im = cand.at(l);
+
+	if (!sector::is_in_eta(m_mod_etamax[im],m_mod_etamin[im],eta_min,eta_max,m_cov)) continue;
+	if (!sector::is_in_phi(m_mod_phimax[im],m_mod_phimin[im],phi_min,phi_max,m_cov)) continue;
+
 	// Module is in, add it...
-	lay_rate[i/10000+6]+=m_e_rate[i];
-	endcap_mod.push_back(i);
-	sector.push_back(i+110000);
+	code = m_modules.code(im);
+
+	if (ModuleIndex::isBarrel(code))
+	{
+	  i = code-ModuleIndex::barrelCode(0);
+	  lay_rate[i/10000]+=m_mod_rate[im];
+	  barrel_mod.push_back(i);
+	}
+	else
+	{
+	  i = code-ModuleIndex::endcapCode(0);
+	  lay_rate[i/10000+6]+=m_mod_rate[im];
+	  endcap_mod.push_back(i);
+	}
+
+	sector.push_back(code);
+	++lay.counter[im];
       }
 
       // End of modules loop 
-      // Push the sectors in the sector trees
+      // Push the sectors in the layout
 
-      m_endcap_mod_tot->push_back(endcap_mod);
-      m_barrel_mod_tot->push_back(barrel_mod);
-      m_sectors->push_back(sector);
-      m_coords->push_back(coord);
+      for (int i=0;i<20;++i) rate_tot+=lay_rate[i];
 
-      for (int i=0;i<20;++i) m_rate_tot+=lay_rate[i];
-      
-      for (int i=0;i<20;++i)
-      {
-	m_lay = i;
-	m_rate= lay_rate[i];
+      lay.endcap.push_back(endcap_mod);
+      lay.barrel.push_back(barrel_mod);
+      lay.sectors.push_back(sector);
+      lay.coords.push_back(coord);
+      lay.lay_rate.push_back(lay_rate);
+      lay.rate.push_back(rate_tot);
+    }
+  }
+}
 
-	m_sec_det_tree->Fill();
-      }
 
-      ++m_sec;
-    }
+// Write the Sectors and Sec_Rates trees of a layout
+
+void sector::write_layout(const sector_layout &lay, std::string outfile)
+{
+  TFile *out             = new TFile(outfile.c_str(),"recreate");
+  TTree *sec_tree        = new TTree("Sectors","Tree containing tracker sec info");
+  TTree *sec_det_tree    = new TTree("Sec_Rates","Tree containing tracker sec info");
+
+  std::vector< std::vector<int> >   *barrel_mod_tot = new std::vector< std::vector<int> >(lay.barrel);
+  std::vector< std::vector<int> >   *endcap_mod_tot = new std::vector< std::vector<int> >(lay.endcap);
+  std::vector< std::vector<int> >   *sectors        = new std::vector< std::vector<int> >(lay.sectors);
+  std::vector< std::vector<float> > *coords         = new std::vector< std::vector<float> >(lay.coords);
+
+  int   sec;
+  int   layer;
+  float rate;
+  float rate_tot;
+
+  // The counters are stored in B_id/E_id indexed arrays
+
+  std::vector<int> counter_barrel(58000,0);
+  std::vector<int> counter_endcap(142000,0);
+
+  int code;
+
+  for (int im=0;im<m_modules.size();++im)
+  { 
+    code = m_modules.code(im);
+
+    (ModuleIndex::isBarrel(code))
+      ? counter_barrel[code-ModuleIndex::barrelCode(0)] = lay.counter[im]
+      : counter_endcap[code-ModuleIndex::endcapCode(0)] = lay.counter[im];
   }
 
-  cout << "We have made " << m_barrel_mod_tot->size() << " sectors " << endl; 
+  sec_tree->Branch("sectors_barrel",   &barrel_mod_tot);
+  sec_tree->Branch("sectors_endcap",   &endcap_mod_tot);
+  sec_tree->Branch("sectors",          &sectors);
+  sec_tree->Branch("sectors_coord",    &coords);
+  sec_tree->Branch("counter_barrel",   &counter_barrel[0] , "counter_barrel[58000]/I");
+  sec_tree->Branch("counter_endcap",   &counter_endcap[0] , "counter_endcap[142000]/I");
 
-  // Increment the counter tables
+  sec_det_tree->Branch("sec",         &sec);
+  sec_det_tree->Branch("lay",         &layer);
+  sec_det_tree->Branch("rate",        &rate);
+  sec_det_tree->Branch("rate_tot",    &rate_tot);
 
-  for (int i=0;i<static_cast<int>(m_barrel_mod_tot->size());++i)
+  for (unsigned int k=0;k<lay.rate.size();++k)
   {
-    for (int j=0;j<static_cast<int>(m_barrel_mod_tot->at(i).size());++j) 
-      ++m_counter_barrel[m_barrel_mod_tot->at(i).at(j)];
-  }
+    sec      = k;
+    rate_tot = lay.rate.at(k);
 
-  for (int i=0;i<static_cast<int>(m_endcap_mod_tot->size());++i)
-  { 
-    for (int j=0;j<static_cast<int>(m_endcap_mod_tot->at(i).size());++j) 
-      ++m_counter_endcap[m_endcap_mod_tot->at(i).at(j)];
+    for (int i=0;i<20;++i)
+    {
+      layer = i;
+      rate  = lay.lay_rate.at(k).at(i);
+
+      sec_det_tree->Fill();
+    }
   }
 
   // Fill the data
 
-  m_sectree->Fill();
-  m_outfile->Write();
-  m_outfile->Close();
+  sec_tree->Fill();
+  out->Write();
+  out->Close();
 
+  delete out;
+  delete barrel_mod_tot;
+  delete endcap_mod_tot;
+  delete sectors;
+  delete coords;
 }
 
 /////////////////////////////////////////////////////////////
@@ -148,7 +274,7 @@ void sector::do_sector()
 // the eta range of the sector
 
 
-bool sector::is_in_eta(float mod_max,float mod_min,float sec_min,float sec_max,float cov)
+bool sector::is_in_eta(float mod_max,float mod_min,float sec_min,float sec_max,float cov) const
 {  
   if (mod_max<sec_min) return false; 
   if (mod_min>sec_max) return false;
@@ -172,7 +298,7 @@ bool sector::is_in_eta(float mod_max,float mod_min,float sec_min,float sec_max,f
 // !!! The PI/-PI transition requires a special attention
 
 
-bool sector::is_in_phi(float mod_max,float mod_min,float sec_min,float sec_max,float cov)
+bool sector::is_in_phi(float mod_max,float mod_min,float sec_min,float sec_max,float cov) const
 { 
   if (sec_min>sec_max) // The sector is at the PI/-PI transition
   {
@@ -206,68 +332,152 @@ bool sector::is_in_phi(float mod_max,float mod_min,float sec_min,float sec_max,f
   }
 }
 
+// Sector sizes and steps (in eta and phi) of a configuration
+
+void sector::sizes(int neta,int nphi,int oeta,int ophi,
+		   float &eta_size,float &phi_size,float &eta_step,float &phi_step) const
+{
+  eta_size = 5.*(100.+static_cast<float>(oeta))/(100.*static_cast<float>(neta));
+  phi_size = 8.*atan(1.)*(100.+static_cast<float>(ophi))/(100.*static_cast<float>(nphi));
+
+  eta_step = 5./static_cast<float>(neta);
+  phi_step = 8.*atan(1.)/static_cast<float>(nphi);
+}
+
+
+// Index of the module areas, to test only the modules close to a sector
+
 void sector::initVars()
 {
+  m_grid = new ModuleGrid(m_mod_etamin,m_mod_etamax,m_mod_phimin,m_mod_phimax);
+}
 
-  m_barrel_mod_tot = new std::vector< std::vector<int> >;
-  m_endcap_mod_tot = new std::vector< std::vector<int> >;
-  m_sectors        = new std::vector< std::vector<int> >;
-  m_coords         = new std::vector< std::vector<float> >;
 
-  m_barrel_mod_tot->clear();
-  m_endcap_mod_tot->clear();
-  m_sectors->clear();
-  m_coords->clear();
+void sector::initTuple(std::string in)
+{
+  m_infile   = TFile::Open(in.c_str());
+  m_ratetree = (TTree*)m_infile->Get("L1Rates");
 
+  sector::readRates();
+}
 
-  for (int i=0;i<58000;++i) m_counter_barrel[i]=0;
-  for (int i=0;i<142000;++i) m_counter_endcap[i]=0;
 
-  m_eta_size = 5.*(100.+static_cast<float>(m_oeta))/(100.*static_cast<float>(m_neta));
-  m_phi_size = 8.*atan(1.)*(100.+static_cast<float>(m_ophi))/(100.*static_cast<float>(m_nphi));
+// Get the rate and eta/phi tables from the L1Rates tree (B_id/E_id indexed
+// arrays), and keep the modules containing stubs. The other ones still have 
+// their initial eta range ([1000,-1000]) and can't be in any sector.
+//
+// The module rate is the sum of the chip rates (STUB_X_rates[16][N])
 
-  m_eta_step = 5./static_cast<float>(m_neta);
-  m_phi_step = 8.*atan(1.)/static_cast<float>(m_nphi);
+void sector::readRates()
+{
+  std::vector<float> b_rate(16*58000);
+  std::vector<float> b_phimin(58000);
+  std::vector<float> b_phimax(58000);
+  std::vector<float> b_etamin(58000);
+  std::vector<float> b_etamax(58000);
+
+  std::vector<float> e_rate(16*142000);
+  std::vector<float> e_phimin(142000);
+  std::vector<float> e_phimax(142000);
+  std::vector<float> e_etamin(142000);
+  std::vector<float> e_etamax(142000);
+
+  m_ratetree->SetBranchAddress("STUB_b_rates",         &b_rate[0]);
+  m_ratetree->SetBranchAddress("STUB_b_phi_b",         &b_phimin[0]);
+  m_ratetree->SetBranchAddress("STUB_b_phi_t",         &b_phimax[0]);
+  m_ratetree->SetBranchAddress("STUB_b_eta_b",         &b_etamin[0]);
+  m_ratetree->SetBranchAddress("STUB_b_eta_t",         &b_etamax[0]);
+
+  m_ratetree->SetBranchAddress("STUB_e_rates",         &e_rate[0]);
+  m_ratetree->SetBranchAddress("STUB_e_phi_b",         &e_phimin[0]);
+  m_ratetree->SetBranchAddress("STUB_e_phi_t",         &e_phimax[0]);
+  m_ratetree->SetBranchAddress("STUB_e_eta_b",         &e_etamin[0]);
+  m_ratetree->SetBranchAddress("STUB_e_eta_t",         &e_etamax[0]);
 
-  cout << m_neta << "/" << m_eta_size << "/" << m_eta_step << endl;
-  cout << m_nphi << "/" << m_phi_size << "/" << m_phi_step << endl;
+  m_ratetree->GetEntry(0);
+  m_ratetree->ResetBranchAddresses(); // The buffers are local
 
-  m_PI = 4.*atan(1.);
-}
+  m_modules.clear();
+  m_mod_rate.clear();
+  m_mod_etamin.clear();
+  m_mod_etamax.clear();
+  m_mod_phimin.clear();
+  m_mod_phimax.clear();
 
+  float rate;
+
+  for (int i=0;i<58000;++i)
+  {
+    if (b_etamin[i]==1000. && b_etamax[i]==-1000.) continue;
+    if (m_modules.add(ModuleIndex::barrelCode(i))<0) continue;
+
+    rate = 0.;
+    for (int j=0;j<16;++j) rate += b_rate[j*58000+i];
+
+    m_mod_rate.push_back(rate);
+    m_mod_etamin.push_back(b_etamin[i]);
+    m_mod_etamax.push_back(b_etamax[i]);
+    m_mod_phimin.push_back(b_phimin[i]);
+    m_mod_phimax.push_back(b_phimax[i]);
+  }
 
+  for (int i=0;i<142000;++i)
+  {
+    if (e_etamin[i]==1000. && e_etamax[i]==-1000.) continue;
+    if (m_modules.add(ModuleIndex::endcapCode(i))<0) continue;
+
+    rate = 0.;
+    for (int j=0;j<16;++j) rate += e_rate[j*142000+i];
+
+    m_mod_rate.push_back(rate);
+    m_mod_etamin.push_back(e_etamin[i]);
+    m_mod_etamax.push_back(e_etamax[i]);
+    m_mod_phimin.push_back(e_phimin[i]);
+    m_mod_phimax.push_back(e_phimax[i]);
+  }
+
+  cout << "Rates read for " << m_modules.size() << " modules" << endl;
+}
 
 
-void sector::initTuple(std::string in,std::string out)
+// Same thing, from the tables of a rates object. The modules are taken as
+// they would be read back from its L1Rates tree: same order (by code), same 
+// selection, and same sums
+
+void sector::readRates(const rates *r)
 {
-  m_infile   = TFile::Open(in.c_str());
-  m_ratetree = (TTree*)m_infile->Get("L1Rates");
+  m_modules.clear();
+  m_mod_rate.clear();
+  m_mod_etamin.clear();
+  m_mod_etamax.clear();
+  m_mod_phimin.clear();
+  m_mod_phimax.clear();
+
+  const ModuleIndex               &modules = r->modules();
+  const std::vector<rates_module> &mods    = r->moduleRates();
+
+  float rate;
+  int   code;
+
+  for (int im=0;im<modules.size();++im)
+  {
+    const rates_module &mod = mods.at(im);
+
+    code = modules.code(im);
+
+    if (ModuleIndex::isBarrel(code) && code-ModuleIndex::barrelCode(0)>=58000) continue; // Not in L1Rates
+    if (mod.etamin==1000. && mod.etamax==-1000.) continue;
+    if (m_modules.add(code)<0) continue;
+
+    rate = 0.;
+    for (int j=0;j<16;++j) rate += mod.rate[j];
+
+    m_mod_rate.push_back(rate);
+    m_mod_etamin.push_back(mod.etamin);
+    m_mod_etamax.push_back(mod.etamax);
+    m_mod_phimin.push_back(mod.phimin);
+    m_mod_phimax.push_back(mod.phimax);
+  }
 
-  m_outfile = new TFile(out.c_str(),"recreate");
-  m_sectree = new TTree("Sectors","Tree containing tracker sec info");
-  m_sec_det_tree = new TTree("Sec_Rates","Tree containing tracker sec info");
-
-  m_ratetree->SetBranchAddress("STUB_b_rates",         &m_b_rate);
-  m_ratetree->SetBranchAddress("STUB_b_phi_b",         &m_b_phimin);
-  m_ratetree->SetBranchAddress("STUB_b_phi_t",         &m_b_phimax);
-  m_ratetree->SetBranchAddress("STUB_b_eta_b",         &m_b_etamin);
-  m_ratetree->SetBranchAddress("STUB_b_eta_t",         &m_b_etamax);
-
-  m_ratetree->SetBranchAddress("STUB_e_rates",         &m_e_rate);
-  m_ratetree->SetBranchAddress("STUB_e_phi_b",         &m_e_phimin);
-  m_ratetree->SetBranchAddress("STUB_e_phi_t",         &m_e_phimax);
-  m_ratetree->SetBranchAddress("STUB_e_eta_b",         &m_e_etamin);
-  m_ratetree->SetBranchAddress("STUB_e_eta_t",         &m_e_etamax);
-
-  m_sectree->Branch("sectors_barrel",   &m_barrel_mod_tot);
-  m_sectree->Branch("sectors_endcap",   &m_endcap_mod_tot);
-  m_sectree->Branch("sectors",          &m_sectors);
-  m_sectree->Branch("sectors_coord",    &m_coords);
-  m_sectree->Branch("counter_barrel",   &m_counter_barrel , "counter_barrel[58000]/I");
-  m_sectree->Branch("counter_endcap",   &m_counter_endcap , "counter_endcap[142000]/I");
-
-  m_sec_det_tree->Branch("sec",         &m_sec);
-  m_sec_det_tree->Branch("lay",         &m_lay);
-  m_sec_det_tree->Branch("rate",        &m_rate);
-  m_sec_det_tree->Branch("rate_tot",    &m_rate_tot);
+  cout << "Rates taken for " << m_modules.size() << " modules" << endl;
 }
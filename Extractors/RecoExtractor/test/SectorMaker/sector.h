@@ -11,6 +11,9 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TChain.h"
+#include "ModuleIndex.h"
+#include "ModuleGrid.h"
+#include "rates.h"
 
 #include <fstream>
 #include <string>
@@ -22,7 +25,8 @@
 //
 // filename : the name and directory of the input ROOT file containing the STUB rates
 // outfile  : the name of the output ROOT file containing the sector definition along with the 
-//            multiplicities (ie in how many sectors each module is?)
+//            multiplicities (ie in how many sectors each module is?). If empty, the sectors are
+//            only kept in memory (see layout())
 // neta     : the number of divisions in eta (default : 1)
 // nphi     : the number of divisions in phi (default : 8)
 // oeta     : the percentage of eta overlap between 2 sectors (default : 0)
@@ -31,6 +35,9 @@
 // This code was developped for the BE classic geometry, but also works for 
 // the 5 disks alternative
 //
+// The rates can also be taken directly from a rates object (filename is then replaced 
+// by the rates object, see the AM_ana pipeline option), instead of its output file
+//
 // !!!! It is however strongly advised to use the sectors files made from the TkLayout tool
 //
 // Info about the code:
@@ -44,26 +51,57 @@
 
 using namespace std;
 
+
+// The result of the sector determination for one configuration
+
+struct sector_layout
+{
+  int neta;
+  int nphi;
+  int oeta;
+  int ophi;
+
+  std::vector< std::vector<int> >   barrel;   // Barrel module lists (B_id) of sectors 
+  std::vector< std::vector<int> >   endcap;   // Endcap module lists (E_id) of sectors 
+  std::vector< std::vector<int> >   sectors;  // Total module lists (codes) of sectors 
+  std::vector< std::vector<float> > coords;   // Eta/phi coordinates of sectors
+  std::vector< std::vector<float> > lay_rate; // Stub rate per layer (20) of sectors
+  std::vector<float>                rate;     // Total stub rate of sectors
+  std::vector<int>                  counter;  // Sector multiplicity of each module (ModuleIndex order)
+};
+
+
 class sector
 {
  public:
   sector(std::string filename,std::string outfile,
 	 int neta,int nphi,int oeta,int ophi);
+  sector(const rates *r,std::string outfile,
+	 int neta,int nphi,int oeta,int ophi);
+  sector(std::string filename); // Only reads the rates (see sector_optimizer)
+  ~sector();
 
   void   do_sector();    
+  void   make_layout(sector_layout &lay) const; // Thread-safe, only uses the module tables
+  void   write_layout(const sector_layout &lay, std::string outfile);
   void   initVars();
-  void   initTuple(std::string in,std::string out);
+  void   initTuple(std::string in);
+  void   readRates();
+  void   readRates(const rates *r);
+  void   sizes(int neta,int nphi,int oeta,int ophi,
+	       float &eta_size,float &phi_size,float &eta_step,float &phi_step) const;
 
-  bool is_in_eta(float mod_max,float mod_min,float sec_min,float sec_max,float cov);
-  bool is_in_phi(float mod_max,float mod_min,float sec_min,float sec_max,float cov);
+  int    nModules() const {return m_modules.size();}
+
+  const sector_layout &layout() const {return m_layout;} // The sectors made by do_sector
+
+  bool is_in_eta(float mod_max,float mod_min,float sec_min,float sec_max,float cov) const;
+  bool is_in_phi(float mod_max,float mod_min,float sec_min,float sec_max,float cov) const;
 
  private:
 
   TFile *m_infile;
-  TFile *m_outfile;
   TTree *m_ratetree;
-  TTree *m_sectree;
-  TTree *m_sec_det_tree;
   // Coding conventions for barrel and endcap module IDs
   
   // We define a barrel ID and an endcap ID as follows:
@@ -75,72 +113,27 @@ class sector
   // Disks 0 to 6  (towards positive Z)  (0 to  4 for 5D)
   // Disks 7 to 13 (towards negative Z)  (7 to 11 for 5D)
 
-  // Following tables are for rates
-  float m_b_rate[58000];     // Contains the barrel module rates (in stubs/bx)
-  float m_b_rate_p[58000];   // Contains the barrel primary stubs module rates (in stubs/bx)
-  float m_b_rate_s[58000];   // Contains the barrel secondary stubs module rates (in stubs/bx)
-  float m_b_rate_f[58000];   // Contains the barrel fake stubs module rates (in stubs/bx)
-
-  float m_e_rate[142000];    // Contains the endcap module rates (in stubs/bx)
-  float m_e_rate_p[142000];  // Contains the endcap primary stubs module rates (in stubs/bx)
-  float m_e_rate_s[142000];  // Contains the endcap secondary stubs module rates (in stubs/bx)
-  float m_e_rate_f[142000];  // Contains the endcap fake stubs module rates (in stubs/bx)
-
-  // Following tables are for sector definition
-  float m_b_etamin[58000];   // Contains the barrel module min eta value
-  float m_b_etamax[58000];   // Contains the barrel module max eta value
-  float m_b_phimin[58000];   // Contains the barrel module min phi value
-  float m_b_phimax[58000];   // Contains the barrel module max phi value
-  float m_e_etamin[142000];  // Contains the endcap module min eta value
-  float m_e_etamax[142000];  // Contains the endcap module max eta value
-  float m_e_phimin[142000];  // Contains the endcap module min phi value
-  float m_e_phimax[142000];  // Contains the endcap module max phi value
-  float m_e_stmin[142000];   // Minimum strip number 
-  float m_e_stmax[142000];   // Maximum strip number 
-  float m_e_segmin[142000];  // Minimum segment number  
-  float m_e_segmax[142000];  // Maximum segment number   
-  float m_e_nseg[142000];    // Number of segments in the module  
-  float m_e_nstrip[142000];  // Number of strips in the module  
-  float m_b_stmin[58000];    // 
-  float m_b_stmax[58000];    //
-  float m_b_segmin[58000];   // Idem for barrel
-  float m_b_segmax[58000];   //
-  float m_b_nseg[58000];     // 
-  float m_b_nstrip[58000];   // 
-
-
-  // The vector containing the barrel module lists of sectors 
-  std::vector< std::vector<int> >   *m_barrel_mod_tot; 
-  // The vector containing the endcap module lists of sectors 
-  std::vector< std::vector<int> >   *m_endcap_mod_tot;
-  // The vector containing eta/phi coordinates of sectors
-  std::vector< std::vector<float> > *m_coords;
-  // The vector containing the total module lists of sectors 
-  std::vector< std::vector<int> >   *m_sectors; 
-
-  int m_counter_barrel[58000];  // Sector multiplicity of each barrel module
-  int m_counter_endcap[142000]; // Sector multiplicity of each endcap module
-
-
-  float m_eta_size;
-  float m_phi_size;
-
-  float m_eta_step;
-  float m_phi_step; 
-
-  float m_PI;
+  // Following tables are for rates and sector definition. They only contain the 
+  // modules with stubs in the rates file, sorted by code (see ModuleIndex.h)
+
+  ModuleIndex        m_modules;
+  std::vector<float> m_mod_rate;    // Module rates (in stubs/bx)
+  std::vector<float> m_mod_etamin;  // Module min eta value
+  std::vector<float> m_mod_etamax;  // Module max eta value
+  std::vector<float> m_mod_phimin;  // Module min phi value
+  std::vector<float> m_mod_phimax;  // Module max phi value
+
+  ModuleGrid        *m_grid;        // Index of the module areas
+
+  sector_layout      m_layout;
+
+  std::string m_outname;
 
   int m_nphi;
   int m_neta;
   int m_ophi;
   int m_oeta;
   float m_cov; 
-
-
-  int   m_sec;
-  int   m_lay;
-  float m_rate;
-  float m_rate_tot;
 };
 
 #endif
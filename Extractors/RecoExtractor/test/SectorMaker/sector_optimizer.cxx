@@ -0,0 +1,219 @@
+// Class for the sector configuration scan
+// For more info, look at the header file
+
+#include "sector_optimizer.h"
+#include <algorithm>
+
+sector_optimizer::sector_optimizer(std::string filename, std::string outfile,
+				   int maxeta, int maxphi, int maxoeta, int maxophi, int nthreads)
+{
+  m_outname  = outfile;
+  m_nthreads = (nthreads>1) ? nthreads : 1;
+  m_next     = 0;
+
+  m_sectors  = new sector(filename);
+
+  // The configuration grid (the scores are filled by the threads)
+
+  layout_score sc;
+
+  for (int k=1;k<=maxeta;++k)
+  {
+    for (int j=1;j<=maxphi;++j)
+    {
+      for (int oe=0;oe<=maxoeta;oe+=5)
+      {
+	for (int op=0;op<=maxophi;op+=5)
+	{
+	  sc.neta = k;
+	  sc.nphi = j;
+	  sc.oeta = oe;
+	  sc.ophi = op;
+
+	  m_scores.push_back(sc);
+	}
+      }
+    }
+  }
+
+  sector_optimizer::do_scan();
+}
+
+sector_optimizer::~sector_optimizer()
+{
+  delete m_sectors;
+}
+
+
+void sector_optimizer::do_scan()
+{
+  int nwork = std::min(m_nthreads,static_cast<int>(m_scores.size()));
+
+  cout << "Testing " << m_scores.size() << " sector configurations with "
+       << nwork << " threads" << endl;
+
+  if (nwork<=1)
+  {
+    sector_optimizer::scan_layouts();
+  }
+  else
+  {
+    std::vector<std::thread> workers;
+
+    for (int i=0;i<nwork;++i)
+      workers.push_back(std::thread(&sector_optimizer::scan_layouts,this));
+
+    for (int i=0;i<nwork;++i) workers.at(i).join();
+  }
+
+  sector_optimizer::write_scores();
+  sector_optimizer::write_best();
+}
+
+
+// Each thread takes the next configuration to do until there is none. The
+// configurations are independent, and make_layout only reads the module tables
+
+void sector_optimizer::scan_layouts()
+{
+  int i;
+
+  sector_layout lay;
+
+  while ((i=m_next++)<static_cast<int>(m_scores.size()))
+  {
+    layout_score &sc = m_scores.at(i);
+
+    lay.neta = sc.neta;
+    lay.nphi = sc.nphi;
+    lay.oeta = sc.oeta;
+    lay.ophi = sc.ophi;
+
+    m_sectors->make_layout(lay);
+    sector_optimizer::score(lay,sc);
+  }
+}
+
+
+void sector_optimizer::score(const sector_layout &lay, layout_score &sc) const
+{
+  int nmod = static_cast<int>(lay.counter.size());
+  int nin  = 0;
+  int mult = 0;
+
+  sc.nsec     = static_cast<int>(lay.rate.size());
+  sc.rate_max = 0.;
+  sc.mult_max = 0;
+  sc.n_out    = 0;
+
+  for (int i=0;i<sc.nsec;++i)
+    if (lay.rate.at(i)>sc.rate_max) sc.rate_max = lay.rate.at(i);
+
+  for (int i=0;i<nmod;++i)
+  {
+    if (lay.counter.at(i)==0)
+    {
+      ++sc.n_out;
+      continue;
+    }
+
+    ++nin;
+    mult += lay.counter.at(i);
+    if (lay.counter.at(i)>sc.mult_max) sc.mult_max = lay.counter.at(i);
+  }
+
+  (nin>0)
+    ? sc.mult_mean = static_cast<float>(mult)/static_cast<float>(nin)
+    : sc.mult_mean = 0.;
+
+  sc.score = sc.rate_max*sc.mult_mean;
+}
+
+
+// Ranking of the configurations (a before b?). In case of equal scores
+// the configuration with less sectors, then the smaller one, comes first
+
+bool sector_optimizer::better(const layout_score &a, const layout_score &b)
+{
+  if ((a.n_out==0)!=(b.n_out==0)) return (a.n_out==0);
+  if (a.n_out!=b.n_out) return (a.n_out<b.n_out);
+  if (a.score!=b.score) return (a.score<b.score);
+  if (a.nsec!=b.nsec)   return (a.nsec<b.nsec);
+  if (a.oeta!=b.oeta)   return (a.oeta<b.oeta);
+  return (a.ophi<b.ophi);
+}
+
+
+// The Layouts tree, one entry per configuration (in the scan order)
+
+void sector_optimizer::write_scores()
+{
+  TFile *out  = new TFile(m_outname.c_str(),"recreate");
+  TTree *tree = new TTree("Layouts","Scores of the sector configurations");
+
+  layout_score sc;
+
+  tree->Branch("neta",      &sc.neta,      "neta/I");
+  tree->Branch("nphi",      &sc.nphi,      "nphi/I");
+  tree->Branch("oeta",      &sc.oeta,      "oeta/I");
+  tree->Branch("ophi",      &sc.ophi,      "ophi/I");
+  tree->Branch("nsec",      &sc.nsec,      "nsec/I");
+  tree->Branch("rate_max",  &sc.rate_max,  "rate_max/F");
+  tree->Branch("mult_mean", &sc.mult_mean, "mult_mean/F");
+  tree->Branch("mult_max",  &sc.mult_max,  "mult_max/I");
+  tree->Branch("n_out",     &sc.n_out,     "n_out/I");
+  tree->Branch("score",     &sc.score,     "score/F");
+
+  for (unsigned int i=0;i<m_scores.size();++i)
+  {
+    sc = m_scores.at(i);
+    tree->Fill();
+  }
+
+  out->Write();
+  out->Close();
+
+  delete out;
+}
+
+
+// The best configurations are made again, and written in the sector format
+
+void sector_optimizer::write_best()
+{
+  std::vector<layout_score> ranked = m_scores;
+
+  std::stable_sort(ranked.begin(),ranked.end(),sector_optimizer::better);
+
+  std::string base = m_outname;
+
+  if (base.size()>5 && base.substr(base.size()-5)==".root")
+    base = base.substr(0,base.size()-5);
+
+  sector_layout lay;
+
+  for (int i=0;i<std::min(static_cast<int>(NBEST),static_cast<int>(ranked.size()));++i)
+  {
+    const layout_score &sc = ranked.at(i);
+
+    cout << "Configuration " << i+1 << " : "
+	 << sc.neta << "/" << sc.nphi << "/" << sc.oeta << "/" << sc.ophi
+	 << " -> " << sc.nsec << " sectors, max rate " << sc.rate_max
+	 << ", mean multiplicity " << sc.mult_mean
+	 << ", " << sc.n_out << " modules out" << endl;
+
+    lay.neta = sc.neta;
+    lay.nphi = sc.nphi;
+    lay.oeta = sc.oeta;
+    lay.ophi = sc.ophi;
+
+    m_sectors->make_layout(lay);
+
+    std::ostringstream name;
+
+    name << base << "_" << i+1 << "_Eta" << sc.neta << "Phi" << sc.nphi
+	 << "_oeta" << sc.oeta << "_ophi" << sc.ophi << ".root";
+
+    m_sectors->write_layout(lay,name.str());
+  }
+}
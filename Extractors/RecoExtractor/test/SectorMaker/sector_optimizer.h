@@ -0,0 +1,92 @@
+#ifndef SECTOR_OPTIMIZER_H
+#define SECTOR_OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cmath>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "sector.h"
+
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+///////////////////////////////////
+//
+//
+// Scan of the sector configurations
+//
+// The rates file is read once (see sector::readRates), then all the configurations
+// (neta,nphi,oeta,ophi) of the grid below are made in parallel, and scored:
+//
+// neta : 1 to maxeta
+// nphi : 1 to maxphi
+// oeta : 0 to maxoeta, by steps of 5%
+// ophi : 0 to maxophi, by steps of 5%
+//
+// filename : the name and directory of the input ROOT file containing the STUB rates
+// outfile  : the name of the output ROOT file containing the scores of all the
+//            configurations (tree Layouts). The NBEST best configurations are written
+//            in their own sector files (outfile_RANK_EtaXPhiY_oetaZ_ophiT.root),
+//            in the sector format (trees Sectors and Sec_Rates)
+// nthreads : the number of threads used for the scan
+//
+// The score of a configuration is the max sector rate (in stubs/bx) times the mean module
+// multiplicity (in how many sectors each module is?): the lower, the better. Configurations
+// leaving modules out of all the sectors are ranked after the other ones.
+//
+///////////////////////////////////
+
+using namespace std;
+
+
+// The summary of one configuration (the sector lists are not kept)
+
+struct layout_score
+{
+  int   neta;
+  int   nphi;
+  int   oeta;
+  int   ophi;
+  int   nsec;      // Number of sectors
+  float rate_max;  // Max sector rate
+  float mult_mean; // Mean module multiplicity
+  int   mult_max;  // Max module multiplicity
+  int   n_out;     // Number of modules in no sector
+  float score;     // rate_max*mult_mean
+};
+
+
+class sector_optimizer
+{
+ public:
+
+  sector_optimizer(std::string filename, std::string outfile,
+		   int maxeta, int maxphi, int maxoeta, int maxophi, int nthreads);
+  ~sector_optimizer();
+
+  void   do_scan();
+  void   scan_layouts();            // Thread loop, takes the next configuration to do
+  void   score(const sector_layout &lay, layout_score &sc) const;
+  void   write_scores();
+  void   write_best();
+
+  static bool better(const layout_score &a, const layout_score &b);
+
+  static const int NBEST = 5; // Number of configurations written
+
+ private:
+
+  sector      *m_sectors;   // Module tables, and sector determination
+
+  std::string m_outname;
+  int         m_nthreads;
+
+  std::vector<layout_score> m_scores; // One per configuration
+  std::atomic<int>          m_next;   // Next configuration to do
+};
+
+#endif
@@ -2,17 +2,46 @@
 // For more info, look at the header file
 
 #include "sector_test.h"
+#include <algorithm>
+#include <queue>
+#include <bitset>
 
 sector_test::sector_test(std::string filename, std::string secfilename, 
 			 std::string pattfilename, std::string outfile
-			 , int nevt, bool dbg)
+			 , int nevt, bool dbg, int nthreads)
 {  
-  m_dbg    = dbg;
+  if (!sector_test::init(filename,pattfilename,outfile,dbg,nthreads)) return;
+
+  if (!sector_test::convert(secfilename)) return; // Don't go further if there is no sector file
+
+  sector_test::do_test(nevt); // Launch the test loop over n events
+}
+
+// Same thing, with the sectors made in the same job
+
+sector_test::sector_test(std::string filename, const sector_layout &secs, 
+			 std::string pattfilename, std::string outfile
+			 , int nevt, bool dbg, int nthreads)
+{  
+  if (!sector_test::init(filename,pattfilename,outfile,dbg,nthreads)) return;
+
+  if (!sector_test::convert(secs)) return; // Too many sectors for the efficiency tree
+
+  sector_test::do_test(nevt); // Launch the test loop over n events
+}
+
+bool sector_test::init(std::string filename, std::string pattfilename, std::string outfile,
+		       bool dbg, int nthreads)
+{
+  m_dbg      = dbg;
+  m_nthreads = (nthreads>1) ? nthreads : 1;
   evtIDmax = 0;
 
   if (pattfilename!="") 
   {
-    sector_test::translateTuple(pattfilename,"rewritten.root",m_dbg); // Merging and reordering stage
+    // Merging and reordering stage, we don't go further if it failed
+    if (!sector_test::translateTuple(pattfilename,"rewritten.root",m_dbg)) return false;
+
     sector_test::initTuple(filename,"rewritten.root",outfile);
   }
   else
@@ -21,9 +50,7 @@ sector_test::sector_test(std::string filename, std::string secfilename,
     evtIDmax = m_L1TT->GetEntries();
   }
 
-  if (!sector_test::convert(secfilename)) return; // Don't go further if there is no sector file
-
-  sector_test::do_test(nevt); // Launch the test loop over n events
+  return true;
 }
 
 
@@ -37,7 +64,7 @@ sector_test::sector_test(std::string filename, std::string secfilename,
 
 void sector_test::do_test(int nevt)
 {
-  int id;
+  int id,kk,stub;
 
   const int m_nsec = m_sec_mult; // How many sectors are in the file
   const int m_nevt = evtIDmax;   // The max eventID in the sample
@@ -50,11 +77,9 @@ void sector_test::do_test(int nevt)
   int is_sec_there[m_nsec];
   int ladder,module,layer;
   int n_per_lay[20];
-  int n_per_lay_patt[20];
   int n_rods[6] = {16,24,34,48,62,76};
-  int nhits_p;
 
-  for (int j=0;j<500;++j) mult[j]=0;
+  for (int j=0;j<MAX_NB_SECTORS;++j) mult[j]=0;
 
   m_primaries.clear(); 
 
@@ -64,6 +89,12 @@ void sector_test::do_test(int nevt)
   std::vector<int> stubs;
   std::vector<int> parts;
 
+  std::vector<int> stub_patt_off;           // Stub -> patterns index (CSR)
+  std::vector<int> stub_patt;
+  std::vector<int> stub_pos;
+  std::vector< std::bitset<20> > patt_lays; // Layers/disks of the current primary in the patterns
+  std::vector<int> touched;                 // Patterns containing the current primary
+
 
   // We do a linking 
   // the older version of the PatternExtractor (before Sept. 20th 2013)) 
@@ -115,7 +146,7 @@ void sector_test::do_test(int nevt)
     // The info is then stored in the m_primaries vector
     //
 
-    bool already_there = 0;
+    int prim;
 
     for (int j=0;j<m_stub;++j)
     {  
@@ -139,20 +170,15 @@ void sector_test::do_test(int nevt)
       if (sqrt(m_stub_pxGEN[j]*m_stub_pxGEN[j]+m_stub_pyGEN[j]*m_stub_pyGEN[j])<0.2) continue;
       //  if (sqrt(m_stub_X0[j]*m_stub_X0[j]+m_stub_Y0[j]*m_stub_Y0[j])>2.) continue; 
 
-      already_there = false;
+      prim = m_prim_index.add(m_stub_tp[j]); // Check if it's already been found
 
-      for (unsigned int k=0;k<m_primaries.size();++k) // Check if it's already been found
+      if (prim<static_cast<int>(m_primaries.size()))
       {  
-	if (m_primaries.at(k).at(0)!=m_stub_tp[j]) continue;
-
-	stub_tp->at(j)=k;  
-	already_there = true;
-	m_primaries.at(k).push_back(j); // If yes, just put the stub index
-	break;
+	stub_tp->at(j)=prim;  
+	m_primaries.at(prim).push_back(j); // If yes, just put the stub index
+	continue;
       }
 
-      if (already_there == true) continue;   
-
       // Here we have a new primary, we create a new entry
 
       ++n_part;
@@ -180,6 +206,65 @@ void sector_test::do_test(int nevt)
 		<< " primary particles in the event" << i << std::endl; 
 
 
+    //
+    // Then we index the pattern content: for each stub, the list of patterns
+    // containing it (in increasing order). The stubs in a pattern are also 
+    // flagged at this stage
+    //
+
+    bool good_prim = false;
+
+    for (unsigned int k=0;k<m_primaries.size();++k)
+      if (m_primaries.at(k).size()>=4) good_prim = true;
+
+    stub_patt_off.assign(m_stub+1,0);
+    stub_patt.clear();
+
+    if (do_patt && good_prim && nb_patterns>0)
+    {
+      for(int kk=0;kk<nb_patterns;kk++)
+      {
+	for(unsigned int m=0;m<m_links.at(kk).size();m++)
+	{
+	  stub = m_links.at(kk).at(m);
+
+	  if (stub>=m_stub || stub<0)
+	  {
+	    cout << " !!! Reordering problem !!! " << m_stub << endl;
+	    cout << stub << " / " << m_stub << endl;
+	    cout << evt << " // " << event_id << endl;
+	    continue;
+	  }
+
+	  ++stub_patt_off[stub+1];
+
+	  if (stub_inpatt->at(stub)==0)
+	  {
+	    stub_inpatt->at(stub)=1;
+	    ++n_stub;
+	  }	
+	}
+      }
+
+      for (int j=0;j<m_stub;++j) stub_patt_off[j+1] += stub_patt_off[j];
+
+      stub_patt.resize(stub_patt_off[m_stub]);
+      stub_pos.assign(stub_patt_off.begin(),stub_patt_off.end()-1);
+
+      for(int kk=0;kk<nb_patterns;kk++)
+      {
+	for(unsigned int m=0;m<m_links.at(kk).size();m++)
+	{
+	  stub = m_links.at(kk).at(m);
+	  if (stub>=m_stub || stub<0) continue;
+
+	  stub_patt[stub_pos[stub]++] = kk;
+	}
+      }
+
+      patt_lays.assign(nb_patterns,std::bitset<20>());
+    }
+
     //
     // Then, in the second loop, we test all the primaries 
     // in order to check if they have matched a pattern
@@ -192,7 +277,6 @@ void sector_test::do_test(int nevt)
       if (m_primaries.at(k).size()<4) continue; // Less then 4 stubs, give up this one
 
       for (int j=0;j<20;++j) n_per_lay[j]=0;
-      for (int j=0;j<20;++j) n_per_lay_patt[j]=0;
 
       for (int j=0;j<m_nsec;++j)
       {
@@ -221,18 +305,17 @@ void sector_test::do_test(int nevt)
 
 	///////
 	// This hack is temporary and is due to a numbering problem in the TkLayout tool
-	if (layer<=10) ladder = (ladder+n_rods[layer-5]/4)%(n_rods[layer-5]);
+	if (m_tklayout && layer<=10) ladder = (ladder+n_rods[layer-5]/4)%(n_rods[layer-5]);
 	///////
 
 	id = 10000*layer+100*ladder+module; // Get the module ID
       
-	if (m_modules.at(id).size()>1)
+	IntSpan secs = m_secmap.sectors(id);
+
+	for (int kk=0;kk<secs.size();++kk) // In which sector the module is
 	{
-	  for (unsigned int kk=1;kk<m_modules.at(id).size();++kk) // In which sector the module is
-	  {
-	    ++mult[m_modules.at(id).at(kk)];
-	    ++is_sec_there[m_modules.at(id).at(kk)]; 
-	  }
+	  ++mult[secs[kk]];
+	  ++is_sec_there[secs[kk]]; 
 	}
 
 	++n_per_lay[layer-5];
@@ -265,61 +348,50 @@ void sector_test::do_test(int nevt)
       part_nsec->at(k) = nsec;   
       part_nhits->at(k)= nhits;   
 
-      // Finally we do the pattern loop
+      // Finally we do the pattern loop, using the stub -> patterns index: 
+      // for each pattern containing stubs of the primary, we get the
+      // layers/disks of these stubs
       
       if (do_patt)
       {
 	ntotpatt = nb_patterns; // The total number of patterns in the sector/event
 	npatt    = 0;           // The patterns containing at least 4 prim hits
-	
-	if (nb_patterns>0)
-	{	  
-	  for(int kk=0;kk<nb_patterns;kk++)
+
+	touched.clear();
+
+	for (unsigned int j=1;j<m_primaries.at(k).size();++j)
+	{
+	  idx   = m_primaries.at(k).at(j);
+	  layer = m_stub_layer[idx]-5;
+
+	  if (layer<0 || layer>=20) continue;
+
+	  for (int m=stub_patt_off[idx];m<stub_patt_off[idx+1];++m)
 	  {
-	    for (int j=0;j<20;++j) n_per_lay_patt[j]=0;
-	   
-	    // First we count the number of prim stubs in the 
-	    // pattern layers/disks
-	
-	    if (m_links.at(kk).size()==0) continue;
-
-	    for(unsigned int m=0;m<m_links.at(kk).size();m++)
-	    {
-	      if (m_links.at(kk).at(m)>=m_stub || m_links.at(kk).at(m)<0)
-	      {
-		cout << " !!! Reordering problem !!! " << m_stub << endl;
-		cout << m_links.at(kk).at(m) << " / " << m_stub << endl;
-		//cout << m_evtid << " // " << event_id << endl;
-		cout << evt << " // " << event_id << endl;
-	      }
-	      
-	      if (m_stub_tp[m_links.at(kk).at(m)]==m_primaries.at(k).at(0))
-		n_per_lay_patt[m_stub_layer[m_links.at(kk).at(m)]-5]++;
-
-	      if (stub_inpatt->at(m_links.at(kk).at(m))==0)
-	      {
-		stub_inpatt->at(m_links.at(kk).at(m))=1;
-		++n_stub;
-	      }	
-	    }
-	   
-	    // First we get the number of different layers/disks hit by the primary
-	    // in the pattern
-
-	    nhits_p=0; 
-      
-	    for (int jk=0;jk<20;++jk)
-	    {
-	      if (n_per_lay_patt[jk]!=0) ++nhits_p;
-	    }
-
-	    if (nhits_p>=4) 
-	    {
-	      ++npatt; // More than 4, the pattern is good
-	      patt_parts->at(kk).push_back(k); 
-	    }
-	  }	  	  
-	}	
+	    kk = stub_patt[m];
+
+	    if (patt_lays[kk].none()) touched.push_back(kk);
+	    patt_lays[kk].set(layer);
+	  }
+	}
+
+	std::sort(touched.begin(),touched.end());
+
+	for (unsigned int m=0;m<touched.size();++m)
+	{
+	  kk = touched.at(m);
+
+	  // We get the number of different layers/disks hit by the primary
+	  // in the pattern
+
+	  if (patt_lays[kk].count()>=4) 
+	  {
+	    ++npatt; // More than 4, the pattern is good
+	    patt_parts->at(kk).push_back(k); 
+	  }
+
+	  patt_lays[kk].reset();
+	}
       }
       
       part_npatt->at(k) = npatt; 
@@ -422,6 +494,8 @@ void sector_test::initTuple(std::string test,std::string patt,std::string out)
   m_L1TT->SetBranchAddress("CLUS_y",         &pm_clus_y);
   m_L1TT->SetBranchAddress("CLUS_z",         &pm_clus_z);
 
+  ChainReader::optimize(m_L1TT); // Only the branches above are read
+
 
 
   // Output file definition (see the header)
@@ -442,6 +516,34 @@ void sector_test::initTuple(std::string test,std::string patt,std::string out)
   m_efftree->Branch("d0",         &d0,      "d0/F"); 
   m_efftree->Branch("mult",       &mult,    "mult[500]/I"); 
 
+  stub_x      = new std::vector<float>;
+  stub_y      = new std::vector<float>;
+  stub_z      = new std::vector<float>;
+  stub_x_2    = new std::vector<float>;
+  stub_y_2    = new std::vector<float>;
+  stub_z_2    = new std::vector<float>;
+  stub_layer  = new std::vector<int>;
+  stub_ladder = new std::vector<int>;
+  stub_module = new std::vector<int>;
+  stub_seg    = new std::vector<int>;
+  stub_strip  = new std::vector<float>;
+  stub_tp     = new std::vector<int>;
+  stub_inpatt = new std::vector<int>;
+
+  part_pdg    = new std::vector<int>;
+  part_nsec   = new std::vector<int>;
+  part_nhits  = new std::vector<int>;
+  part_npatt  = new std::vector<int>;
+  part_pt     = new std::vector<float>;
+  part_rho    = new std::vector<float>;
+  part_z0     = new std::vector<float>;
+  part_eta    = new std::vector<float>;
+  part_phi    = new std::vector<float>;
+
+  patt_sec    = new std::vector<int>;
+  patt_parts  = new std::vector< std::vector<int> >;
+  patt_stubs  = new std::vector< std::vector<int> >;
+
   m_finaltree = new TTree("FullInfo","");
 
   m_finaltree->Branch("evt",          &evt); 
@@ -497,10 +599,61 @@ void sector_test::initTuple(std::string test,std::string patt,std::string out)
     m_PATT->SetBranchAddress("PATT_n",         &nb_patterns);
     m_PATT->SetBranchAddress("PATT_links",     &pm_links);
     m_PATT->SetBranchAddress("PATT_secID",     &pm_secid);
+
+    ChainReader::optimize(m_PATT);
   }
 }
 
 
+// Read the next record of a run file (see patt_scan): 1 if a record was read,
+// 0 at the end of the file, -1 if the file is truncated or can't be read
+
+static int read_record(FILE *in, std::vector<int> &rec)
+{
+  int size = 3;
+  int nstubs;
+
+  rec.resize(3);
+
+  size_t n = fread(&rec[0],sizeof(int),3,in);
+
+  if (n==0 && feof(in)) return 0;
+  if (n!=3) return -1;
+
+  for (int k=0;k<rec[2];++k) // Patterns
+  {
+    rec.resize(size+2);
+    if (fread(&rec[size],sizeof(int),2,in)!=2) return -1;
+
+    nstubs = rec[size+1];
+    size  += 2;
+
+    if (nstubs<0) return -1;
+
+    rec.resize(size+nstubs);
+    if (nstubs>0 && fread(&rec[size],sizeof(int),nstubs,in)!=static_cast<size_t>(nstubs)) return -1;
+
+    size += nstubs;
+  }
+
+  return 1;
+}
+
+
+// Removal of the run files, and of the partial output, when the reordering fails
+
+static void abort_runs(std::vector<FILE*> &files, const std::vector<std::string> &runs)
+{
+  for (unsigned int r=0;r<runs.size();++r)
+  {
+    if (r<files.size() && files.at(r)) fclose(files.at(r));
+    remove(runs.at(r).c_str());
+  }
+
+  cout << "The pattern file reordering is aborted" << endl;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////
 //
 // ==> sector_test::translateTuple(std::string pattin,std::string pattout)
@@ -510,8 +663,13 @@ void sector_test::initTuple(std::string test,std::string patt,std::string out)
 // The input file (pattin) contains a rough merging of all the PR output files from CMSSW jobs.
 // It is obtained via hadd, and therefore has still to be reordered.
 //
-// The method loops over all pattin entries in order to get the number of different events 
-// contained into it, and then group the results for all these event.
+// The input entries are read sequentially (by m_nthreads readers, each one doing a contiguous
+// block of entries), and written in sorted runs on disk (see patt_scan), so that the memory 
+// used does not depend on the input size. The runs are then merged, and the results for each 
+// event are grouped, in the entry order.
+//
+// If a run file can't be written or read back, the reordering is aborted (false
+// is returned), rather than producing a pattern file with missing entries.
 //
 // The output file pattout contains the same tree than pattin, but with only one entry per event.
 // This entry contains all the pattern matched for this event, for all the sectors (the sector ID info 
@@ -519,107 +677,143 @@ void sector_test::initTuple(std::string test,std::string patt,std::string out)
 //
 /////////////////////////////////////////////////////////////////////////////////
 
-void sector_test::translateTuple(std::string pattin,std::string pattout,bool m_dbg)
+bool sector_test::translateTuple(std::string pattin,std::string pattout,bool m_dbg)
 {
-  std::vector< std::vector<int> > m_links;
-  std::vector<int> m_secid;
-  std::vector< std::vector<int> > *pm_links = new std::vector< std::vector<int> >;
-  std::vector<int> *pm_secid = new std::vector<int> ;
+  TChain *data = new TChain((m_dbg) ? "Patterns" : "L1PatternReco");
+  data->Add(pattin.c_str());
 
-  pm_links=&m_links;
-  pm_secid=&m_secid;
+  int ndat = data->GetEntries();
 
-  std::vector<int> links;
+  delete data;
 
-  int evtID;
-  int m_patt;
+  // First step: sequential reading of pattin, and writing of the sorted runs 
 
-  const int MAX_NB_PATTERNS = 1500;
-  const int MAX_NB_HITS     = 100;
+  int block = (ndat+m_nthreads-1)/m_nthreads;
+  int nwork = (block>0) ? (ndat+block-1)/block : 0;
 
-  int   pattern_sector_id[MAX_NB_PATTERNS];  
-  int   nbHitPerPattern[MAX_NB_PATTERNS];
-  int   hit_idx[MAX_NB_PATTERNS*MAX_NB_HITS];
+  std::vector<patt_scan*>  scans;
+  std::vector<std::thread> workers;
 
-  if (m_dbg) // The file from a standalone PR (use for debugging)
+  for (int i=0;i<nwork;++i) 
   {
-    data = new TChain("Patterns");
+    patt_scan *scan = new patt_scan();
+
+    scan->first    = i*block;
+    scan->last     = std::min((i+1)*block,ndat);
+    scan->evtIDmax = -1;
+    scan->failed   = false;
 
-    data->SetBranchAddress("eventID",             &evtID);         
-    data->SetBranchAddress("nbPatterns",          &m_patt);
-    data->SetBranchAddress("sectorID",            pattern_sector_id); 
-    data->SetBranchAddress("nbStubs",             nbHitPerPattern);   
-    data->SetBranchAddress("stub_idx",            hit_idx);      
+    scans.push_back(scan);
   }
-  else // The classic PR output (using CMSSW)
+
+  if (nwork==1)
   {
-    data = new TChain("L1PatternReco");
-    
-    data->SetBranchAddress("evt",            &evtID); // Simple evt number or event ID
-    data->SetBranchAddress("PATT_n",         &m_patt);
-    data->SetBranchAddress("PATT_links",     &pm_links);
-    data->SetBranchAddress("PATT_secID",     &pm_secid);
+    sector_test::scan_patterns(scans.at(0),pattin,pattout+".run0_",m_dbg);
   }
+  else if (nwork>1)
+  {
+    cout << "Reading " << ndat << " pattern entries with " << nwork << " threads" << endl;
 
-  data->Add(pattin.c_str());
+    TThread::Initialize(); // Makes ROOT aware of the threads
 
-  std::vector< std::vector<int> > *f_links = new std::vector< std::vector<int> >;
-  std::vector<int> *f_secid = new std::vector<int> ;
+    for (int i=0;i<nwork;++i)
+    {
+      std::ostringstream runbase;
+      runbase << pattout << ".run" << i << "_";
 
-  int f_evtID;
-  int f_patt;
+      workers.push_back(std::thread(&sector_test::scan_patterns,this,scans.at(i),
+				    pattin,runbase.str(),m_dbg));
+    }
 
-  TFile hfile(pattout.c_str(),"RECREATE","");
+    for (unsigned int i=0;i<workers.size();++i) workers.at(i).join();
+  }
 
-  TTree *m_tree_L1PatternReco = new TTree("L1PatternReco","L1PatternReco Analysis info");  
-  
-  /// Branches definition
+  // We have the maximum event number contained in pattin. 
 
-  m_tree_L1PatternReco->Branch("evt",            &f_evtID); // Simple evt number or event ID
-  m_tree_L1PatternReco->Branch("PATT_n",         &f_patt);
-  m_tree_L1PatternReco->Branch("PATT_links",     &f_links);
-  m_tree_L1PatternReco->Branch("PATT_secID",     &f_secid);
+  evtIDmax = -1;
 
-  int ndat = data->GetEntries();
+  std::vector<std::string> runs;
+  bool failed = false;
 
-  evtIDmax = -1;
+  for (int i=0;i<nwork;++i)
+  {
+    if (scans.at(i)->evtIDmax>evtIDmax) evtIDmax=scans.at(i)->evtIDmax;
+    if (scans.at(i)->failed) failed = true;
+    runs.insert(runs.end(),scans.at(i)->runs.begin(),scans.at(i)->runs.end());
 
-  std::vector<int> indexes;
-  std::vector< std::vector<int> > indexes_ordered;
+    delete scans.at(i);
+  }
 
-  indexes.clear();
+  evtIDmax+=1;
 
-  // First loop is over all pattin entries
-    
-  for(int i=0;i<ndat;i++)
-  {    
-    data->GetEntry(i);
+  // Second step: merging of the runs. The current record of each run is kept,
+  // and the runs are ordered by the (evtID,entry) of this record
+
+  int nruns = static_cast<int>(runs.size());
 
-    if (evtID>evtIDmax) evtIDmax=evtID;
+  std::vector<FILE*>              files(nruns,static_cast<FILE*>(0));
+  std::vector< std::vector<int> > recs(nruns);  // Current records
 
-    indexes.push_back(evtID);
+  if (failed)
+  {
+    abort_runs(files,runs);
+    return false;
   }
- 
 
-  // We have the maximum event number contained in pattin. We create index table of this size
-  //
+  std::priority_queue< std::pair<std::pair<int,int>,int>,
+		       std::vector< std::pair<std::pair<int,int>,int> >,
+		       std::greater< std::pair<std::pair<int,int>,int> > > next;
 
+  int status;
 
-  evtIDmax+=1;
+  for (int r=0;r<nruns;++r) 
+  {
+    files.at(r) = fopen(runs.at(r).c_str(),"rb");
+
+    if (!files.at(r))
+    {
+      cout << "Can't read the run file " << runs.at(r) << endl;
+      abort_runs(files,runs);
+      return false;
+    }
+
+    status = read_record(files.at(r),recs.at(r));
+
+    if (status<0)
+    {
+      cout << "The run file " << runs.at(r) << " is corrupted" << endl;
+      abort_runs(files,runs);
+      return false;
+    }
 
-  indexes_ordered.resize(evtIDmax);
+    if (status>0)
+      next.push(std::make_pair(std::make_pair(recs.at(r)[0],recs.at(r)[1]),r));
+  }
 
-  for(int i=0;i<evtIDmax;i++) indexes_ordered[i].clear();
-  for(int i=0;i<ndat;i++)     indexes_ordered[indexes[i]].push_back(i);
+  std::vector< std::vector<int> > *f_links = new std::vector< std::vector<int> >;
+  std::vector<int> *f_secid = new std::vector<int> ;
 
-  // index_ordered contains, for each evtid, a vector containing 
-  // the related entries of pattin related to this evtid 
+  int f_evtID;
+  int f_patt;
+
+  TFile hfile(pattout.c_str(),"RECREATE","");
+
+  TTree *m_tree_L1PatternReco = new TTree("L1PatternReco","L1PatternReco Analysis info");  
+  
+  /// Branches definition
+
+  m_tree_L1PatternReco->Branch("evt",            &f_evtID); // Simple evt number or event ID
+  m_tree_L1PatternReco->Branch("PATT_n",         &f_patt);
+  m_tree_L1PatternReco->Branch("PATT_links",     &f_links);
+  m_tree_L1PatternReco->Branch("PATT_secID",     &f_secid);
+
+  std::vector<int> links;
+
+  int r,pos,nstubs;
 
   // Then we fill the new rootuple 
   //
 
-  int hitIndex;
-
   for(int i=0;i<evtIDmax;i++)
   { 
     if (i%100000==0)
@@ -627,55 +821,206 @@ void sector_test::translateTuple(std::string pattin,std::string pattout,bool m_d
   
     //f_evtID = i+1;
     f_evtID = i;
-    f_patt = 0;
+    f_patt = -1; // This event is not in the PR output, unless we find a record
     f_links->clear();
     f_secid->clear();
-    hitIndex = 0; 
 
-    if (indexes_ordered[i].size()!=0) 
+    while (!next.empty() && next.top().first.first==i)
     {
-      for(unsigned int j=0;j<indexes_ordered[i].size();j++)
-      {    
-	data->GetEntry(indexes_ordered[i].at(j));
-      
-	if (evtID!=i) continue; 
-	if (m_patt==0) continue;
+      r = next.top().second;
+      next.pop();
 
-	f_patt += m_patt;
+      // This record belongs to event i, add its patterns 
 
-	for(int k=0;k<m_patt;k++)
-	{ 
-	  if (m_dbg) // Debug mode
-	  {
-	    links.clear();
+      const std::vector<int> &rec = recs.at(r);
 
-	    for(int m=0;m<nbHitPerPattern[k];m++)
-	    {
-	      links.push_back(hit_idx[hitIndex]);
-	      hitIndex++;
-	    }
+      if (f_patt<0) f_patt = 0;
 
-	    f_links->push_back(links);
-	    f_secid->push_back(pattern_sector_id[k]);
-	  }
-	  else
-	  {
-	    f_links->push_back(m_links.at(k));
-	    f_secid->push_back(m_secid.at(k));
-	  }
-	}
+      f_patt += rec[2];
+      pos     = 3;
+
+      for(int k=0;k<rec[2];k++)
+      { 
+	nstubs = rec[pos+1];
+
+	links.assign(rec.begin()+pos+2,rec.begin()+pos+2+nstubs);
+
+	f_links->push_back(links);
+	f_secid->push_back(rec[pos]);
+
+	pos += 2+nstubs;
       }
-    }
-    else // This event is not in the PR output, skip it
-    {
-      f_patt = -1;
+
+      status = read_record(files.at(r),recs.at(r));
+
+      if (status<0)
+      {
+	cout << "The run file " << runs.at(r) << " is corrupted" << endl;
+	hfile.Close();
+	remove(pattout.c_str());
+	abort_runs(files,runs);
+	return false;
+      }
+
+      if (status>0)
+	next.push(std::make_pair(std::make_pair(recs.at(r)[0],recs.at(r)[1]),r));
     }
 
     m_tree_L1PatternReco->Fill();
   }
 
+  for (int r=0;r<nruns;++r)
+  {
+    if (files.at(r)) fclose(files.at(r));
+    remove(runs.at(r).c_str());
+  }
+
   hfile.Write();
   hfile.Close();
+
+  return true;
+}
+
+
+// One reader of the reordering stage, it reads the entries [first,last[ of pattin
+
+void sector_test::scan_patterns(patt_scan *scan, std::string pattin, std::string runbase, bool dbg)
+{
+  const int MAX_NB_PATTERNS = 1500;
+  const int MAX_NB_HITS     = 100;
+
+  scan->pattern_sector_id.resize(MAX_NB_PATTERNS);
+  scan->nbHitPerPattern.resize(MAX_NB_PATTERNS);
+  scan->hit_idx.resize(MAX_NB_PATTERNS*MAX_NB_HITS);
+
+  scan->pm_links = &scan->m_links;
+  scan->pm_secid = &scan->m_secid;
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (dbg) // The file from a standalone PR (use for debugging)
+    {
+      scan->data = new TChain("Patterns");
+
+      scan->data->SetBranchAddress("eventID",             &scan->evtID);         
+      scan->data->SetBranchAddress("nbPatterns",          &scan->m_patt);
+      scan->data->SetBranchAddress("sectorID",            &scan->pattern_sector_id[0]); 
+      scan->data->SetBranchAddress("nbStubs",             &scan->nbHitPerPattern[0]);   
+      scan->data->SetBranchAddress("stub_idx",            &scan->hit_idx[0]);      
+    }
+    else // The classic PR output (using CMSSW)
+    {
+      scan->data = new TChain("L1PatternReco");
+    
+      scan->data->SetBranchAddress("evt",            &scan->evtID); // Simple evt number or event ID
+      scan->data->SetBranchAddress("PATT_n",         &scan->m_patt);
+      scan->data->SetBranchAddress("PATT_links",     &scan->pm_links);
+      scan->data->SetBranchAddress("PATT_secID",     &scan->pm_secid);
+    }
+
+    scan->data->Add(pattin.c_str());
+
+    ChainReader::optimize(scan->data);
+  }
+
+  int hitIndex;
+
+  for(int i=scan->first;i<scan->last;i++)
+  {    
+    scan->data->GetEntry(i);
+
+    if (scan->evtID>scan->evtIDmax) scan->evtIDmax=scan->evtID;
+    if (scan->evtID<0) continue;
+
+    scan->starts.push_back(static_cast<int>(scan->buffer.size()));
+    scan->buffer.push_back(scan->evtID);
+    scan->buffer.push_back(i);
+    scan->buffer.push_back(scan->m_patt);
+
+    hitIndex = 0; 
+
+    for(int k=0;k<scan->m_patt;k++)
+    { 
+      if (dbg) // Debug mode
+      {
+	scan->buffer.push_back(scan->pattern_sector_id[k]);
+	scan->buffer.push_back(scan->nbHitPerPattern[k]);
+
+	for(int m=0;m<scan->nbHitPerPattern[k];m++)
+	{
+	  scan->buffer.push_back(scan->hit_idx[hitIndex]);
+	  hitIndex++;
+	}
+      }
+      else
+      {
+	scan->buffer.push_back(scan->m_secid.at(k));
+	scan->buffer.push_back(static_cast<int>(scan->m_links.at(k).size()));
+	scan->buffer.insert(scan->buffer.end(),scan->m_links.at(k).begin(),scan->m_links.at(k).end());
+      }
+    }
+
+    if (static_cast<int>(scan->buffer.size())>=RUN_SIZE/m_nthreads &&
+	!sector_test::write_run(scan,runbase)) break; // No need to go further
+  }
+
+  if (!scan->failed) sector_test::write_run(scan,runbase);
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    delete scan->data;
+  }
+}
+
+
+// Sort the records of the reader buffer by evtID (the entries of an event 
+// stay in the reading order), and write them in a new run file. If the file
+// can't be written the reader is marked as failed (see translateTuple)
+
+bool sector_test::write_run(patt_scan *scan, std::string runbase)
+{
+  if (scan->starts.empty()) return true;
+
+  const std::vector<int> &buf = scan->buffer;
+
+  std::stable_sort(scan->starts.begin(),scan->starts.end(),
+		   [&buf](int a,int b) {return buf[a]<buf[b];});
+
+  std::ostringstream name;
+  name << runbase << scan->runs.size();
+
+  FILE *out = fopen(name.str().c_str(),"wb");
+  bool  ok  = (out!=0);
+
+  int pos,end;
+
+  for (unsigned int i=0;ok && i<scan->starts.size();++i)
+  {
+    pos = scan->starts.at(i);
+    end = pos+3;
+
+    for (int k=0;k<buf[pos+2];++k) end += 2+buf[end+1];
+
+    ok = (fwrite(&buf[pos],sizeof(int),end-pos,out)==static_cast<size_t>(end-pos));
+  }
+
+  if (out) ok = (fclose(out)==0) && ok;
+
+  scan->buffer.clear();
+  scan->starts.clear();
+
+  if (!ok)
+  {
+    cout << "Can't write the run file " << name.str() << endl;
+    remove(name.str().c_str());
+    scan->failed = true;
+    return false;
+  }
+
+  scan->runs.push_back(name.str());
+
+  return true;
 }
 
 
@@ -689,56 +1034,41 @@ void sector_test::translateTuple(std::string pattin,std::string pattout,bool m_d
 //
 // The role of this method is to create the opposite, ie a vector containing, for every module the list of sectors belonging to it
 //
+// This is done by SectorMap, which also keeps a binary copy of the result next to the CSV file,
+// used directly by the next jobs
+//
 /////////////////////////////////////////////////////////////////////////////////
 
 bool sector_test::convert(std::string sectorfilename) 
 {
   m_sec_mult = 0;
+  m_tklayout = true;
 
-  std::vector<int> module;
+  if (!m_secmap.read(sectorfilename)) return false;
 
-  m_modules.clear();
+  m_sec_mult = m_secmap.nsec();
 
-  for (int i=0;i<230000;++i)
-  {
-    module.clear();
-    module.push_back(-1);
-    m_modules.push_back(module);
-  }
+  return true;
+}
 
-  std::string STRING;
-  std::ifstream in(sectorfilename.c_str());
-  if (!in) 
-  {
-    std::cout << "Please provide a valid csv sector filename" << std::endl; 
-    return false;
-  }    
-  
-  int npar = 0;
+// The sectors made by the sector class use the module codes of the 
+// extracted data (see ModuleIndex.h), no renumbering is needed
 
-  while (!in.eof()) 
-  {
-    ++m_sec_mult;
-    if (m_sec_mult<=2) continue;
-
-    getline(in,STRING);
-    std::istringstream ss(STRING);
-    npar = 0;
-    while (ss)
-    {
-      std::string s;
-      if (!getline( ss, s, ',' )) break;
+bool sector_test::convert(const sector_layout &secs) 
+{
+  m_sec_mult = 0;
+  m_tklayout = false;
 
-      ++npar;
-      if (npar<=2) continue;
+  m_secmap.build(secs.sectors);
 
-      m_modules.at(atoi(s.c_str())).push_back(m_sec_mult-4);
-    }
+  if (m_secmap.nsec()>MAX_NB_SECTORS)
+  {
+    cout << "The layout contains " << m_secmap.nsec() << " sectors, the test only handles "
+	 << MAX_NB_SECTORS << " of them, use larger sectors" << endl;
+    return false;
   }
 
-  in.close();
-
-  m_sec_mult -= 5;
+  m_sec_mult = m_secmap.nsec();
 
   return true;
 }
@@ -748,6 +1078,7 @@ void sector_test::reset()
 {
   ntotpatt=0; 
   m_primaries.clear(); 
+  m_prim_index.clear(); 
 
   n_stub_total=0; 
   n_stub=0; 
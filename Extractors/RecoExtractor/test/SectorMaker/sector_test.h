@@ -13,10 +13,17 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TChain.h"
+#include "TThread.h"
+#include "SectorMap.h"
+#include "KeyIndex.h"
+#include "ChainReader.h"
+#include "sector.h"
 
 #include <fstream>
 #include <string>
 #include <sstream> 
+#include <thread>
+#include <mutex>
 
 ///////////////////////////////////
 //
@@ -29,11 +36,13 @@
 //
 // filename    : the name and directory of the input ROOT file containing the particle to test
 // secfilename : the name and directory of the input ROOT file containing the sectors definition
+//               (or the sectors made in the same job, see sector::layout())
 // pattfilename: the name and directory of the input ROOT file containing the pattern reco output
 // outfile     : the name of the output ROOT file containing the efficiency results 
 //           
 // nevt        : the number of particles to test
 // dbg         : debug mode (true if the pattern file comes from the standalone preco, false otherwise) 
+// nthreads    : the number of threads reading the pattern file in the reordering stage
 //
 // Info about the code:
 //
@@ -49,31 +58,82 @@
 
 using namespace std;
 
+
+// Reordering stage (translateTuple): one sequential reader of the pattern file. 
+// Its entries are stored as int records:
+//
+// evtID, entry, npatt, then for each pattern: sector ID, nstubs, stub indexes
+//
+// When the buffer is full, it is sorted by (evtID,entry) and written in a run file
+
+struct patt_scan
+{
+  TChain *data;
+
+  int first;    // Entries read are [first,last[
+  int last;
+  int evtIDmax; // Max evtID seen
+  bool failed;  // A run file could not be written
+
+  std::vector<int>          buffer;  // Records not written yet
+  std::vector<int>          starts;  // Start of the records in buffer
+  std::vector<std::string>  runs;    // The run files written
+
+  // Branch buffers
+
+  int evtID;
+  int m_patt;
+
+  std::vector< std::vector<int> > m_links;
+  std::vector<int>                m_secid;
+  std::vector< std::vector<int> > *pm_links;
+  std::vector<int>                *pm_secid;
+
+  std::vector<int> pattern_sector_id;  
+  std::vector<int> nbHitPerPattern;
+  std::vector<int> hit_idx;
+};
+
+
 class sector_test
 {
  public:
 
   sector_test(std::string filename, std::string secfilename, 
-	      std::string pattfilename, std::string outfile, int nevt, bool dbg);
+	      std::string pattfilename, std::string outfile, int nevt, bool dbg,
+	      int nthreads=1);
 
+  sector_test(std::string filename, const sector_layout &secs, 
+	      std::string pattfilename, std::string outfile, int nevt, bool dbg,
+	      int nthreads=1);
+
+  bool   init(std::string filename, std::string pattfilename, std::string outfile,
+	      bool dbg, int nthreads); // False if the pattern file can't be reordered
   void   do_test(int nevt);    
 
-  void   translateTuple(std::string pattin,std::string pattout, bool dbg);
+  bool   translateTuple(std::string pattin,std::string pattout, bool dbg);
+  void   scan_patterns(patt_scan *scan, std::string pattin, std::string runbase, bool dbg);
+  bool   write_run(patt_scan *scan, std::string runbase);
   void   initTuple(std::string test,std::string patt,std::string out);
   bool   convert(std::string sectorfilename); 
+  bool   convert(const sector_layout &secs); // False if there are more than MAX_NB_SECTORS sectors
   void   reset();
     
  private:
 
   bool do_patt;
   bool m_dbg;
+  int  m_nthreads;
+
+  static const int RUN_SIZE = 32000000; // Max size of a reader buffer (in ints) before writing a run
+
+  std::mutex m_lock; // For the chain creation in the threads
 
   TFile  *m_infile;
   TFile  *m_testfile;
   TFile  *m_outfile;
   TFile  *m_pattfile;
   TChain *m_L1TT;
-  TChain *data;
 
   TTree  *m_efftree;
   TTree  *m_finaltree;
@@ -83,6 +143,7 @@ class sector_test
   // for a given event 
 
   std::vector< std::vector<int> >   m_primaries;
+  KeyIndex                          m_prim_index; // TP id -> index in m_primaries
 
 
   // Coding conventions for barrel and endcap module IDs
@@ -99,7 +160,8 @@ class sector_test
   int m_sec_mult;
   int evtIDmax;
 
-  std::vector< std::vector<int> >   m_modules; 
+  SectorMap m_secmap;   // Sectors containing each module
+  bool      m_tklayout; // Sectors from the TkLayout CSV file (ladder numbering hack needed)
 
 
   int m_evtid;
@@ -159,7 +221,9 @@ class sector_test
   float d0;         // The origin radius
   int   npatt;      // The number of patterns containing at least 5 stubs of the prim. track
   int   ntotpatt;   // The total number of patterns 
-  int   mult[500];  // The total number of stubs per sector 
+  static const int MAX_NB_SECTORS = 500; // Size of mult (and of its branch)
+
+  int   mult[MAX_NB_SECTORS];  // The total number of stubs per sector 
   int   nhits;      // The total number of layers/disks hit by the prim track
   int   nplay[20];  // The total number of prim stubs per layer 
 